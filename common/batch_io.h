@@ -0,0 +1,446 @@
+#ifndef BATCH_IO_H
+#define BATCH_IO_H
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#define DEFAULT_BATCH_SIZE 32
+#define MAX_BATCH_SIZE 1024        // UIO_MAXIOV - giới hạn của sendmmsg/recvmmsg
+#define BATCH_INLINE_SIZE 128      // Dữ liệu nhỏ (ACK, control) được copy vào batch
+#define UDP_GSO_MAX_SEGMENTS 64    // UDP_MAX_SEGMENTS của kernel cũ (bản mới cho 128)
+#define UDP_GSO_MAX_BYTES 65507    // Một datagram IPv4 tối đa (65535 - IP 20 - UDP 8)
+#define UDP_GRO_BUFFER_SIZE 65536  // Buffer nhận một datagram gộp bằng GRO
+#define BATCH_SEND_RETRIES 16      // Số lần gửi lại message khi socket tạm hết buffer (ENOBUFS/EAGAIN)
+#define BATCH_SEND_WAIT_MS 1       // Chờ POLLOUT tối đa trước mỗi lần gửi lại
+#define BATCH_SEND_BACKOFF_US 50   // ENOBUFS: nghỉ thêm retries * chừng này (poll không thấy hàng đợi thiết bị)
+
+// Kích thước segment trong cmsg UDP_GRO của datagram nhận được, 0 nếu không gộp
+inline size_t groSegmentSize(struct msghdr& hdr) {
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(&hdr); cm != nullptr; cm = CMSG_NXTHDR(&hdr, cm)) {
+        if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+            int segment_size;
+            memcpy(&segment_size, CMSG_DATA(cm), sizeof(segment_size));
+            return segment_size > 0 ? segment_size : 0;
+        }
+    }
+    return 0;
+}
+
+// Bộ đếm cho mỗi lần gọi sendmmsg/recvmmsg
+struct BatchStats {
+    uint64_t calls = 0;      // Số syscall
+    uint64_t packets = 0;    // Số datagram đi qua các syscall đó
+    uint64_t max_batch = 0;  // Batch lớn nhất trong một syscall
+    uint64_t dropped = 0;    // Datagram bị bỏ vì syscall báo lỗi (giao thức tự gửi lại)
+    int last_error = 0;      // errno của lần bỏ gần nhất
+
+    void record(int count) {
+        calls++;
+        packets += count;
+        if ((uint64_t)count > max_batch) {
+            max_batch = count;
+        }
+    }
+
+    void drop(uint64_t count, int error) {
+        dropped += count;
+        last_error = error;
+    }
+
+    double packetsPerCall() const {
+        return calls > 0 ? (double)packets / calls : 0;
+    }
+};
+
+// Gom nhiều datagram rồi gửi bằng một lần sendmmsg.
+// Mỗi datagram gồm tối đa iov_per_msg iovec; con trỏ dữ liệu phải còn hợp lệ
+// cho tới khi flush(), trừ khi dùng addCopy().
+// Với UDP GSO (enableGso), các datagram liên tiếp cùng đích và cùng kích
+// thước được nối vào một message (super-buffer tới ~64 KB) kèm cmsg
+// UDP_SEGMENT; kernel chỉ đi qua network stack một lần rồi cắt lại thành
+// từng datagram ở cuối đường gửi. Datagram ngắn hơn được nối làm đoạn cuối.
+class BatchSender {
+public:
+    BatchSender(int sock, size_t batch_size, size_t iov_per_msg = 2)
+        : sock_(sock),
+          batch_size_(batch_size),
+          iov_per_msg_(iov_per_msg),
+          capacity_(batch_size),
+          gso_(false),
+          msgs_(batch_size),
+          iovs_(batch_size * iov_per_msg),
+          addrs_(batch_size),
+          msg_info_(batch_size),
+          control_(batch_size * CMSG_SPACE(sizeof(uint16_t))),
+          inline_(batch_size * BATCH_INLINE_SIZE),
+          count_(0),
+          msg_count_(0),
+          iov_count_(0),
+          gso_buffers_(0),
+          gso_segments_(0),
+          gso_error_(0) {}
+
+    size_t size() const { return count_; }
+    bool full() const { return count_ >= capacity_ || msg_count_ >= batch_size_; }
+    const BatchStats& stats() const { return stats_; }
+
+    // Bật UDP GSO: mỗi message trong batch chứa tới UDP_GSO_MAX_SEGMENTS datagram.
+    // false nếu kernel không hỗ trợ UDP_SEGMENT.
+    bool enableGso() {
+        int zero = 0;  // Kích thước segment đặt riêng cho từng message qua cmsg
+        if (setsockopt(sock_, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) < 0) {
+            return false;
+        }
+        gso_ = true;
+        capacity_ = batch_size_ * UDP_GSO_MAX_SEGMENTS;
+        iovs_.resize(capacity_ * iov_per_msg_);
+        inline_.resize(capacity_ * BATCH_INLINE_SIZE);
+        return true;
+    }
+    bool gso() const { return gso_; }
+    // errno khiến GSO bị tắt giữa chừng, 0 nếu chưa tắt
+    int gsoError() const { return gso_error_; }
+    // Số super-buffer (message nhiều segment) đã gửi và tổng số segment trong đó
+    uint64_t gsoBuffers() const { return gso_buffers_; }
+    uint64_t gsoSegments() const { return gso_segments_; }
+
+    // Thêm datagram gồm tối đa 2 phần (vd: header + payload), không copy
+    void add(const struct sockaddr_in& addr, const void* part1, size_t len1,
+             const void* part2 = nullptr, size_t len2 = 0) {
+        struct iovec* iov = &iovs_[iov_count_];
+        iov[0].iov_base = (void*)part1;
+        iov[0].iov_len = len1;
+        size_t iovlen = 1;
+        if (part2 != nullptr && len2 > 0) {
+            iov[1].iov_base = (void*)part2;
+            iov[1].iov_len = len2;
+            iovlen = 2;
+        }
+        push(addr, iovlen, len1 + (iovlen == 2 ? len2 : 0));
+    }
+
+    // Thêm datagram nhỏ (<= BATCH_INLINE_SIZE), dữ liệu được copy vào batch
+    void addCopy(const struct sockaddr_in& addr, const void* data, size_t len) {
+        char* dst = &inline_[count_ * BATCH_INLINE_SIZE];
+        memcpy(dst, data, len);
+        add(addr, dst, len);
+    }
+
+    // Gửi toàn bộ datagram đang chờ, trả về số datagram đã gửi được
+    int flush() {
+        for (size_t i = 0; i < msg_count_; i++) {
+            if (msg_info_[i].segments > 1) {
+                setSegmentSize(i);
+            }
+        }
+
+        // sendmmsg dừng ở message lỗi đầu tiên: lỗi tạm thời thì gửi lại, lỗi
+        // khác thì chỉ bỏ message đó rồi gửi tiếp phần sau (ACK, control...)
+        size_t sent_total = 0;
+        size_t datagrams_total = 0;
+        int retries = 0;
+        while (sent_total < msg_count_) {
+            int sent = sendmmsg(sock_, &msgs_[sent_total], msg_count_ - sent_total, 0);
+            if (sent <= 0) {
+                int error = sent < 0 ? errno : EIO;
+                if (waitRetry(error, retries)) {
+                    continue;
+                }
+                if (msg_info_[sent_total].segments > 1 && (error == EIO || error == EINVAL)) {
+                    // Thiết bị/đường đi không nhận GSO: tắt hẳn, gửi lại từng datagram
+                    disableGso(error);
+                    datagrams_total += sendSegments(sent_total);
+                } else {
+                    stats_.drop(msg_info_[sent_total].segments, error);
+                }
+                sent_total++;
+                retries = 0;
+                continue;
+            }
+            retries = 0;
+            size_t datagrams = 0;
+            for (size_t i = sent_total; i < sent_total + sent; i++) {
+                datagrams += msg_info_[i].segments;
+                if (msg_info_[i].segments > 1) {
+                    gso_buffers_++;
+                    gso_segments_ += msg_info_[i].segments;
+                }
+            }
+            stats_.record(datagrams);
+            sent_total += sent;
+            datagrams_total += datagrams;
+        }
+        count_ = 0;
+        msg_count_ = 0;
+        iov_count_ = 0;
+        return (int)datagrams_total;
+    }
+
+private:
+    // Thông tin GSO của một message
+    struct MessageInfo {
+        size_t segment_size;   // Kích thước mọi segment trừ segment cuối
+        size_t bytes;          // Tổng payload của message
+        uint32_t segments;
+        bool closed;           // Đã có segment ngắn hơn: không nối thêm được
+    };
+
+    void push(const struct sockaddr_in& addr, size_t iovlen, size_t len) {
+        if (gso_ && msg_count_ > 0 && appendable(msg_count_ - 1, addr, len)) {
+            MessageInfo& info = msg_info_[msg_count_ - 1];
+            msgs_[msg_count_ - 1].msg_hdr.msg_iovlen += iovlen;
+            info.bytes += len;
+            info.segments++;
+            info.closed = len < info.segment_size;
+            iov_count_ += iovlen;
+            count_++;
+            return;
+        }
+
+        addrs_[msg_count_] = addr;
+        struct mmsghdr& m = msgs_[msg_count_];
+        memset(&m, 0, sizeof(m));
+        m.msg_hdr.msg_name = &addrs_[msg_count_];
+        m.msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        m.msg_hdr.msg_iov = &iovs_[iov_count_];
+        m.msg_hdr.msg_iovlen = iovlen;
+        msg_info_[msg_count_] = MessageInfo{len, len, 1, false};
+        iov_count_ += iovlen;
+        msg_count_++;
+        count_++;
+    }
+
+    // Datagram len byte tới addr nối được vào message i không
+    bool appendable(size_t i, const struct sockaddr_in& addr, size_t len) const {
+        const MessageInfo& info = msg_info_[i];
+        return !info.closed && len > 0 && len <= info.segment_size && info.segments < UDP_GSO_MAX_SEGMENTS &&
+               info.bytes + len <= UDP_GSO_MAX_BYTES &&
+               addrs_[i].sin_addr.s_addr == addr.sin_addr.s_addr && addrs_[i].sin_port == addr.sin_port;
+    }
+
+    void disableGso(int error) {
+        if (gso_) {
+            gso_ = false;
+            gso_error_ = error;
+        }
+    }
+
+    // Gửi từng segment của message GSO i thành datagram riêng (không cmsg
+    // UDP_SEGMENT). Các iovec của message được chia lại theo segment_size.
+    // Trả về số datagram đã gửi, datagram lỗi bị đếm vào stats_.dropped
+    size_t sendSegments(size_t i) {
+        const struct msghdr& hdr = msgs_[i].msg_hdr;
+        const MessageInfo& info = msg_info_[i];
+        split_.assign(info.segments, mmsghdr());
+        size_t iov = 0;
+        for (uint32_t k = 0; k < info.segments; k++) {
+            struct msghdr& out = split_[k].msg_hdr;
+            out.msg_name = hdr.msg_name;
+            out.msg_namelen = hdr.msg_namelen;
+            out.msg_iov = &hdr.msg_iov[iov];
+            size_t len = 0;
+            while (iov < hdr.msg_iovlen && (len == 0 || len < info.segment_size)) {
+                len += hdr.msg_iov[iov].iov_len;
+                out.msg_iovlen++;
+                iov++;
+            }
+        }
+
+        size_t sent_total = 0;
+        size_t delivered = 0;
+        int retries = 0;
+        while (sent_total < split_.size()) {
+            int sent = sendmmsg(sock_, &split_[sent_total], split_.size() - sent_total, 0);
+            if (sent <= 0) {
+                int error = sent < 0 ? errno : EIO;
+                if (waitRetry(error, retries)) {
+                    continue;
+                }
+                stats_.drop(1, error);
+                sent_total++;
+                retries = 0;
+                continue;
+            }
+            retries = 0;
+            stats_.record(sent);
+            sent_total += sent;
+            delivered += sent;
+        }
+        return delivered;
+    }
+
+    // Lỗi tạm thời thì chờ rồi cho gửi lại (true), tối đa BATCH_SEND_RETRIES
+    // lần liền cho mỗi message. EAGAIN: chờ buffer socket có chỗ (POLLOUT).
+    // ENOBUFS đến từ hàng đợi qdisc/thiết bị mà socket vẫn báo POLLOUT, nên
+    // nghỉ thêm tăng dần để hàng đợi kịp vơi.
+    bool waitRetry(int error, int& retries) {
+        if (error == EINTR) {
+            return true;
+        }
+        if ((error != ENOBUFS && error != EAGAIN && error != EWOULDBLOCK) || ++retries >= BATCH_SEND_RETRIES) {
+            return false;
+        }
+        struct pollfd pfd;
+        pfd.fd = sock_;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, BATCH_SEND_WAIT_MS) > 0 && error == ENOBUFS) {
+            usleep(BATCH_SEND_BACKOFF_US * retries);
+        }
+        return true;
+    }
+
+    void setSegmentSize(size_t i) {
+        struct msghdr& hdr = msgs_[i].msg_hdr;
+        hdr.msg_control = &control_[i * CMSG_SPACE(sizeof(uint16_t))];
+        hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&hdr);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t segment_size = msg_info_[i].segment_size;
+        memcpy(CMSG_DATA(cm), &segment_size, sizeof(segment_size));
+    }
+
+    int sock_;
+    size_t batch_size_;         // Số message tối đa mỗi lần sendmmsg
+    size_t iov_per_msg_;
+    size_t capacity_;           // Số datagram tối đa trước khi phải flush
+    bool gso_;
+    std::vector<struct mmsghdr> msgs_;
+    std::vector<struct iovec> iovs_;
+    std::vector<struct sockaddr_in> addrs_;
+    std::vector<MessageInfo> msg_info_;
+    std::vector<char> control_;
+    std::vector<char> inline_;
+    size_t count_;              // Số datagram đang chờ
+    size_t msg_count_;          // Số message đang chờ
+    size_t iov_count_;          // Số iovec đã dùng (các message nằm liền nhau)
+    uint64_t gso_buffers_;
+    uint64_t gso_segments_;
+    int gso_error_;
+    std::vector<struct mmsghdr> split_;   // Message GSO được chia lại khi tắt GSO
+    BatchStats stats_;
+};
+
+// Nhận nhiều datagram trong một lần recvmmsg vào các buffer cấp phát sẵn.
+// Với UDP GRO (enableGro), kernel gộp các datagram liên tiếp của cùng luồng
+// thành một buffer lớn kèm cmsg UDP_GRO (kích thước segment); receive() tách
+// lại nên người dùng vẫn thấy từng datagram như trước.
+class BatchReceiver {
+public:
+    BatchReceiver(int sock, size_t batch_size, size_t buffer_size)
+        : sock_(sock),
+          batch_size_(batch_size),
+          buffer_size_(buffer_size),
+          gro_(false),
+          msgs_(batch_size),
+          iovs_(batch_size),
+          addrs_(batch_size),
+          buffers_(batch_size * buffer_size) {}
+
+    const BatchStats& stats() const { return stats_; }
+
+    // Bật UDP GRO: mỗi buffer nhận đủ một datagram gộp tối đa. false nếu kernel không hỗ trợ.
+    bool enableGro() {
+        int one = 1;
+        if (setsockopt(sock_, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0) {
+            return false;
+        }
+        gro_ = true;
+        buffer_size_ = std::max<size_t>(buffer_size_, UDP_GRO_BUFFER_SIZE);
+        buffers_.resize(batch_size_ * buffer_size_);
+        control_.resize(batch_size_ * CMSG_SPACE(sizeof(int)));
+        segments_.reserve(batch_size_ * UDP_GSO_MAX_SEGMENTS);
+        return true;
+    }
+    bool gro() const { return gro_; }
+    // Số buffer gộp nhiều datagram đã nhận và tổng số datagram trong đó
+    uint64_t groBuffers() const { return gro_buffers_; }
+    uint64_t groSegments() const { return gro_segments_; }
+
+    // flags: MSG_WAITFORONE để chờ (theo SO_RCVTIMEO) datagram đầu tiên rồi
+    // lấy thêm những gì đã có sẵn; MSG_DONTWAIT để không chờ.
+    // Trả về số datagram nhận được, -1 nếu timeout hoặc lỗi.
+    int receive(int flags) {
+        for (size_t i = 0; i < batch_size_; i++) {
+            iovs_[i].iov_base = &buffers_[i * buffer_size_];
+            iovs_[i].iov_len = buffer_size_;
+            memset(&msgs_[i], 0, sizeof(msgs_[i]));
+            msgs_[i].msg_hdr.msg_name = &addrs_[i];
+            msgs_[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+            msgs_[i].msg_hdr.msg_iovlen = 1;
+            if (gro_) {
+                msgs_[i].msg_hdr.msg_control = &control_[i * CMSG_SPACE(sizeof(int))];
+                msgs_[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(int));
+            }
+        }
+
+        int received = recvmmsg(sock_, msgs_.data(), batch_size_, flags, nullptr);
+        if (received > 0 && gro_) {
+            received = split(received);
+        }
+        if (received > 0) {
+            stats_.record(received);
+        }
+        return received;
+    }
+
+    char* data(int i) { return gro_ ? segments_[i].data : &buffers_[i * buffer_size_]; }
+    size_t length(int i) const { return gro_ ? segments_[i].len : msgs_[i].msg_len; }
+    const struct sockaddr_in& source(int i) const { return gro_ ? addrs_[segments_[i].msg] : addrs_[i]; }
+
+private:
+    // Một datagram nằm trong buffer của message msg
+    struct Segment {
+        char* data;
+        size_t len;
+        int msg;
+    };
+
+    // Tách các buffer gộp theo kích thước segment, trả về tổng số datagram
+    int split(int received) {
+        segments_.clear();
+        for (int i = 0; i < received; i++) {
+            char* data = &buffers_[i * buffer_size_];
+            size_t len = msgs_[i].msg_len;
+            size_t segment_size = groSegmentSize(msgs_[i].msg_hdr);
+            if (segment_size == 0 || segment_size >= len) {
+                segments_.push_back(Segment{data, len, i});
+                continue;
+            }
+            gro_buffers_++;
+            for (size_t offset = 0; offset < len; offset += segment_size) {
+                segments_.push_back(Segment{data + offset, std::min(segment_size, len - offset), i});
+                gro_segments_++;
+            }
+        }
+        return (int)segments_.size();
+    }
+
+    int sock_;
+    size_t batch_size_;
+    size_t buffer_size_;
+    bool gro_;
+    std::vector<struct mmsghdr> msgs_;
+    std::vector<struct iovec> iovs_;
+    std::vector<struct sockaddr_in> addrs_;
+    std::vector<char> buffers_;
+    std::vector<char> control_;
+    std::vector<Segment> segments_;
+    uint64_t gro_buffers_ = 0;
+    uint64_t gro_segments_ = 0;
+    BatchStats stats_;
+};
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_X86 1
+#endif
+
+// Kiểm tra toàn vẹn dữ liệu:
+//  - CRC32C (Castagnoli) cho từng chunk: lệnh crc32 của SSE4.2 xử lý 8 byte
+//    mỗi lệnh; CPU không có SSE4.2 thì dùng bảng slicing-by-8. CPU được dò
+//    một lần lúc chạy như Gf256, không cần cờ biên dịch.
+//  - XXH64 cho cả file (hoặc đoạn file của một stream), cập nhật dần theo thứ
+//    tự byte nên sender/receiver tính được ngay khi dữ liệu đi qua.
+
+#define CRC32C_POLYNOMIAL 0x82F63B78   // Dạng đảo bit của 0x1EDC6F41
+
+inline uint32_t crc32cSoftware(uint32_t crc, const uint8_t* data, size_t len, const uint32_t (*table)[256]) {
+    crc = ~crc;
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, data, 4);
+        memcpy(&hi, data + 4, 4);
+        lo ^= crc;
+        crc = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff] ^ table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff] ^ table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24];
+        data += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#ifdef CHECKSUM_X86
+__attribute__((target("sse4.2")))
+inline uint32_t crc32cSse42(uint32_t crc, const uint8_t* data, size_t len) {
+    crc = ~crc;
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, data, 8);
+        crc64 = _mm_crc32_u64(crc64, v);
+        data += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while (len >= 4) {
+        uint32_t v;
+        memcpy(&v, data, 4);
+        crc = _mm_crc32_u32(crc, v);
+        data += 4;
+        len -= 4;
+    }
+    while (len-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return ~crc;
+}
+#endif
+
+class Crc32c {
+public:
+    static const Crc32c& instance() {
+        static Crc32c crc;
+        return crc;
+    }
+
+    // CRC32C của len byte, nối tiếp từ crc (0 cho đoạn đầu tiên)
+    uint32_t compute(const void* data, size_t len, uint32_t crc = 0) const {
+#ifdef CHECKSUM_X86
+        if (hardware_) {
+            return crc32cSse42(crc, (const uint8_t*)data, len);
+        }
+#endif
+        return crc32cSoftware(crc, (const uint8_t*)data, len, table_);
+    }
+
+    const char* kernel() const { return hardware_ ? "sse4.2" : "slicing-by-8"; }
+
+private:
+    Crc32c() : hardware_(false) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+            }
+            table_[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int t = 1; t < 8; t++) {
+                table_[t][i] = (table_[t - 1][i] >> 8) ^ table_[0][table_[t - 1][i] & 0xff];
+            }
+        }
+#ifdef CHECKSUM_X86
+        hardware_ = __builtin_cpu_supports("sse4.2");
+#endif
+    }
+
+    uint32_t table_[8][256];   // table_[t][b]: CRC của byte b theo sau t byte 0
+    bool hardware_;
+};
+
+inline uint32_t crc32c(const void* data, size_t len) {
+    return Crc32c::instance().compute(data, len);
+}
+
+// CRC của packet mang dữ liệu: phủ cả header (trừ chính trường crc) để chunk
+// hỏng số thứ tự không bị ghi nhầm chỗ
+inline uint32_t packetCrc(const void* header, size_t header_len, const void* payload, size_t len) {
+    const Crc32c& crc = Crc32c::instance();
+    return crc.compute(payload, len, crc.compute(header, header_len));
+}
+
+// CRC của data packet: pkt_num, các trường sau crc (header nén) rồi payload.
+// header_len là độ dài header trên đường truyền (CrcPacketHeader hoặc dài hơn)
+inline uint32_t dataPacketCrc(const void* header, size_t header_len, const void* payload, size_t len) {
+    const Crc32c& crc = Crc32c::instance();
+    const uint8_t* fields = (const uint8_t*)header;
+    uint32_t value = crc.compute(fields, 4);
+    if (header_len > 8) {
+        value = crc.compute(fields + 8, header_len - 8, value);
+    }
+    return crc.compute(payload, len, value);
+}
+
+// XXH64 dạng streaming (update nhiều lần rồi digest), kết quả giống XXH64 một lần
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0) {
+        v_[0] = seed + PRIME1 + PRIME2;
+        v_[1] = seed + PRIME2;
+        v_[2] = seed;
+        v_[3] = seed - PRIME1;
+        seed_ = seed;
+        total_ = 0;
+        buffered_ = 0;
+    }
+
+    void update(const void* data, size_t len) {
+        const uint8_t* p = (const uint8_t*)data;
+        total_ += len;
+        if (buffered_ + len < 32) {
+            memcpy(buffer_ + buffered_, p, len);
+            buffered_ += len;
+            return;
+        }
+        if (buffered_ > 0) {
+            size_t fill = 32 - buffered_;
+            memcpy(buffer_ + buffered_, p, fill);
+            stripe(buffer_);
+            p += fill;
+            len -= fill;
+            buffered_ = 0;
+        }
+        while (len >= 32) {
+            stripe(p);
+            p += 32;
+            len -= 32;
+        }
+        memcpy(buffer_, p, len);
+        buffered_ = len;
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (total_ >= 32) {
+            h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+            for (int i = 0; i < 4; i++) {
+                h = (h ^ round(0, v_[i])) * PRIME1 + PRIME4;
+            }
+        } else {
+            h = seed_ + PRIME5;
+        }
+        h += total_;
+
+        const uint8_t* p = buffer_;
+        size_t len = buffered_;
+        while (len >= 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * PRIME1 + PRIME4;
+            p += 8;
+            len -= 8;
+        }
+        if (len >= 4) {
+            uint32_t v;
+            memcpy(&v, p, 4);
+            h ^= (uint64_t)v * PRIME1;
+            h = rotl(h, 23) * PRIME2 + PRIME3;
+            p += 4;
+            len -= 4;
+        }
+        while (len-- > 0) {
+            h ^= (*p++) * PRIME5;
+            h = rotl(h, 11) * PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    uint64_t size() const { return total_; }
+
+private:
+    static const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    static const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+    static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+    static const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    static uint64_t read64(const uint8_t* p) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * PRIME2;
+        return rotl(acc, 31) * PRIME1;
+    }
+
+    void stripe(const uint8_t* p) {
+        for (int i = 0; i < 4; i++) {
+            v_[i] = round(v_[i], read64(p + i * 8));
+        }
+    }
+
+    uint64_t v_[4];
+    uint64_t seed_;
+    uint64_t total_;
+    uint8_t buffer_[32];
+    size_t buffered_;
+};
+
+#endif
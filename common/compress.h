@@ -0,0 +1,311 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "protocol.h"
+
+// Nén từng block độc lập (FEATURE_COMPRESS):
+//  - LZ4: định dạng block chuẩn của LZ4 (đọc được bằng LZ4_decompress_safe),
+//    tự cài đặt nên không cần thư viện. Nhanh, hợp khi đường truyền chỉ chậm
+//    hơn CPU một chút.
+//  - zstd: tỷ lệ nén cao hơn nhưng tốn CPU hơn, cần biên dịch với
+//    -DHAVE_ZSTD -lzstd.
+// Trước khi nén cả block, vài mẫu nhỏ trong block được nén thử: dữ liệu đã nén
+// sẵn (video, ảnh, zip) bị bỏ qua ngay mà không tốn CPU nén cả block.
+
+#define COMPRESS_SAMPLE_BYTES 4096   // Mỗi mẫu nén thử
+#define COMPRESS_SAMPLES 3           // Mẫu ở đầu, giữa và cuối block
+#define COMPRESS_SAMPLE_RATIO 0.9    // Mẫu phải nhỏ đi ít nhất 10% mới nén cả block
+#define COMPRESS_ZSTD_LEVEL 3
+#define COMPRESS_ZSTD_SAMPLE_LEVEL 1
+
+#define LZ4_HASH_BITS 14
+#define LZ4_SMALL_HASH_BITS 10       // Bảng nhỏ cho mẫu: xóa bảng không tốn hơn nén mẫu
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5          // 5 byte cuối block luôn là literal
+#define LZ4_MATCH_LIMIT 12           // Match không bắt đầu trong 12 byte cuối
+#define LZ4_MAX_OFFSET 65535
+
+inline uint32_t lz4Read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+// Độ dài từ 15 trở lên: thêm các byte 255 rồi phần dư
+inline bool lz4WriteLength(uint8_t*& op, const uint8_t* end, size_t len) {
+    while (len >= 255) {
+        if (op >= end) {
+            return false;
+        }
+        *op++ = 255;
+        len -= 255;
+    }
+    if (op >= end) {
+        return false;
+    }
+    *op++ = (uint8_t)len;
+    return true;
+}
+
+inline bool lz4ReadLength(const uint8_t*& ip, const uint8_t* end, size_t& len) {
+    uint8_t b;
+    do {
+        if (ip >= end) {
+            return false;
+        }
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+// Một sequence: literal_len byte literal rồi match (offset, match_len);
+// match_len = 0 là sequence cuối, chỉ có literal
+inline bool lz4WriteSequence(uint8_t*& op, const uint8_t* end, const uint8_t* literal, size_t literal_len,
+                             size_t offset, size_t match_len) {
+    if (op >= end) {
+        return false;
+    }
+    uint8_t* token = op++;
+    *token = (uint8_t)(std::min<size_t>(literal_len, 15) << 4);
+    if (literal_len >= 15 && !lz4WriteLength(op, end, literal_len - 15)) {
+        return false;
+    }
+    if ((size_t)(end - op) < literal_len) {
+        return false;
+    }
+    memcpy(op, literal, literal_len);
+    op += literal_len;
+    if (match_len == 0) {
+        return true;
+    }
+
+    if (end - op < 2) {
+        return false;
+    }
+    op[0] = (uint8_t)(offset & 0xff);
+    op[1] = (uint8_t)(offset >> 8);
+    op += 2;
+    size_t code = match_len - LZ4_MIN_MATCH;
+    *token |= (uint8_t)std::min<size_t>(code, 15);
+    return code < 15 || lz4WriteLength(op, end, code - 15);
+}
+
+// Nén len byte vào dst; 0 nếu kết quả không vừa capacity byte. Bảng băm giữ
+// vị trí gần nhất của mỗi 4 byte, dữ liệu không khớp thì bước nhảy tăng dần
+// (như LZ4 gốc) nên phần không nén được đi qua rất nhanh.
+inline size_t lz4Compress(const char* src, size_t len, char* dst, size_t capacity) {
+    const uint8_t* in = (const uint8_t*)src;
+    uint8_t* op = (uint8_t*)dst;
+    const uint8_t* end = op + capacity;
+    size_t anchor = 0;
+
+    if (len > LZ4_MATCH_LIMIT) {
+        uint32_t table[1 << LZ4_HASH_BITS];
+        unsigned bits = len <= (1u << (LZ4_SMALL_HASH_BITS + 2)) ? LZ4_SMALL_HASH_BITS : LZ4_HASH_BITS;
+        memset(table, 0, sizeof(uint32_t) << bits);
+
+        size_t match_limit = len - LZ4_MATCH_LIMIT;
+        size_t extend_limit = len - LZ4_LAST_LITERALS;
+        size_t ip = 0;
+        while (ip < match_limit) {
+            uint32_t sequence = lz4Read32(in + ip);
+            uint32_t h = (sequence * 2654435761u) >> (32 - bits);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip;
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || lz4Read32(in + ref) != sequence) {
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            // Match dài thêm về phía sau (8 byte mỗi lần so) và về phía trước
+            size_t match_len = LZ4_MIN_MATCH;
+            while (ip + match_len + 8 <= extend_limit) {
+                uint64_t a, b;
+                memcpy(&a, in + ip + match_len, 8);
+                memcpy(&b, in + ref + match_len, 8);
+                if (a != b) {
+                    match_len += __builtin_ctzll(a ^ b) / 8;
+                    break;
+                }
+                match_len += 8;
+            }
+            if (ip + match_len + 8 > extend_limit) {
+                while (ip + match_len < extend_limit && in[ip + match_len] == in[ref + match_len]) {
+                    match_len++;
+                }
+            }
+            while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1]) {
+                ip--;
+                ref--;
+                match_len++;
+            }
+
+            if (!lz4WriteSequence(op, end, in + anchor, ip - anchor, ip - ref, match_len)) {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    if (!lz4WriteSequence(op, end, in + anchor, len - anchor, 0, 0)) {
+        return 0;
+    }
+    return op - (uint8_t*)dst;
+}
+
+// Giải nén LZ4 block; false nếu dữ liệu hỏng hoặc không ra đúng raw_len byte
+inline bool lz4Decompress(const char* src, size_t len, char* dst, size_t raw_len) {
+    const uint8_t* ip = (const uint8_t*)src;
+    const uint8_t* in_end = ip + len;
+    uint8_t* out = (uint8_t*)dst;
+    uint8_t* op = out;
+    uint8_t* out_end = out + raw_len;
+
+    while (ip < in_end) {
+        uint8_t token = *ip++;
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !lz4ReadLength(ip, in_end, literal_len)) {
+            return false;
+        }
+        if ((size_t)(in_end - ip) < literal_len || (size_t)(out_end - op) < literal_len) {
+            return false;
+        }
+        memcpy(op, ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+        if (ip == in_end) {
+            break;  // Sequence cuối chỉ có literal
+        }
+
+        if (in_end - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15 && !lz4ReadLength(ip, in_end, match_len)) {
+            return false;
+        }
+        match_len += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - out) || (size_t)(out_end - op) < match_len) {
+            return false;
+        }
+
+        // offset < 8: match chồng lên chính nó (lặp lại mẫu ngắn), chép từng byte
+        const uint8_t* match = op - offset;
+        if (offset >= 8) {
+            for (size_t i = 0; i < match_len; i += 8) {
+                memcpy(op + i, match + i, std::min<size_t>(8, match_len - i));
+            }
+        } else {
+            for (size_t i = 0; i < match_len; i++) {
+                op[i] = match[i];
+            }
+        }
+        op += match_len;
+    }
+    return op == out_end;
+}
+
+#ifdef HAVE_ZSTD
+// Mỗi luồng một context: tạo context cho từng block tốn hơn cả nén block nhỏ
+struct ZstdContexts {
+    ZSTD_CCtx* compress = ZSTD_createCCtx();
+    ZSTD_DCtx* decompress = ZSTD_createDCtx();
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(compress);
+        ZSTD_freeDCtx(decompress);
+    }
+};
+
+inline ZstdContexts& zstdContexts() {
+    static thread_local ZstdContexts contexts;
+    return contexts;
+}
+#endif
+
+inline const char* compressCodecName(uint8_t codec) {
+    switch (codec) {
+    case COMPRESS_LZ4:
+        return "lz4";
+    case COMPRESS_ZSTD:
+        return "zstd";
+    default:
+        return "none";
+    }
+}
+
+// Tên codec trên dòng lệnh, COMPRESS_NONE nếu không biết
+inline uint8_t parseCompressCodec(const std::string& name) {
+    if (name == "lz4") {
+        return COMPRESS_LZ4;
+    }
+    if (name == "zstd") {
+        return COMPRESS_ZSTD;
+    }
+    return COMPRESS_NONE;
+}
+
+// Bản build này nén/giải nén được codec không
+inline bool compressCodecSupported(uint8_t codec) {
+#ifdef HAVE_ZSTD
+    if (codec == COMPRESS_ZSTD) {
+        return true;
+    }
+#endif
+    return codec == COMPRESS_LZ4;
+}
+
+// Nén block vào dst; 0 nếu không nén được xuống capacity byte (gửi nguyên)
+inline size_t compressBlock(uint8_t codec, const char* src, size_t len, char* dst, size_t capacity,
+                            int level = COMPRESS_ZSTD_LEVEL) {
+#ifdef HAVE_ZSTD
+    if (codec == COMPRESS_ZSTD) {
+        size_t n = ZSTD_compressCCtx(zstdContexts().compress, dst, capacity, src, len, level);
+        return ZSTD_isError(n) ? 0 : n;
+    }
+#else
+    (void)level;
+#endif
+    return codec == COMPRESS_LZ4 ? lz4Compress(src, len, dst, capacity) : 0;
+}
+
+// Giải nén đúng raw_len byte vào dst; false nếu dữ liệu hỏng
+inline bool decompressBlock(uint8_t codec, const char* src, size_t len, char* dst, size_t raw_len) {
+#ifdef HAVE_ZSTD
+    if (codec == COMPRESS_ZSTD) {
+        return ZSTD_decompressDCtx(zstdContexts().decompress, dst, raw_len, src, len) == raw_len;
+    }
+#endif
+    return codec == COMPRESS_LZ4 && lz4Decompress(src, len, dst, raw_len);
+}
+
+// Nén thử COMPRESS_SAMPLES mẫu rải đều trong block (zstd ở mức nhanh nhất):
+// false nếu các mẫu gần như không nhỏ đi, nén cả block chỉ tốn CPU
+inline bool blockLooksCompressible(uint8_t codec, const char* src, size_t len) {
+    char out[COMPRESS_SAMPLE_BYTES];
+    size_t sample = std::min<size_t>(COMPRESS_SAMPLE_BYTES, len);
+    size_t raw = 0;
+    size_t packed = 0;
+    for (int i = 0; i < COMPRESS_SAMPLES; i++) {
+        size_t offset = (len - sample) * i / (COMPRESS_SAMPLES - 1);
+        size_t n = compressBlock(codec, src + offset, sample, out, sample, COMPRESS_ZSTD_SAMPLE_LEVEL);
+        raw += sample;
+        packed += n > 0 ? n : sample;
+    }
+    return packed < raw * COMPRESS_SAMPLE_RATIO;
+}
+
+#endif
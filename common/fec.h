@@ -0,0 +1,233 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "gf256.h"
+#include "protocol.h"
+
+// FEC dạng Reed-Solomon hệ thống: chunk dữ liệu gửi nguyên vẹn, repair j là
+// R_j = Σ_i c(j, i) · D_i. Ma trận c là ma trận Cauchy 1 / (x_j + y_i) với
+// x_j = 255 - j, y_i = i, mỗi cột được chia cho phần tử ở hàng 0: mọi ma trận
+// vuông con vẫn khả nghịch (MDS: nhận đủ k packet bất kỳ của block là giải
+// được) và hàng 0 toàn số 1, nên repair đầu tiên chỉ là XOR parity.
+
+// Hệ số c(row, col), row < FEC_MAX_REPAIR, col < FEC_MAX_K
+inline uint8_t fecCoefficient(uint32_t row, uint32_t col) {
+    struct Table {
+        uint8_t c[FEC_MAX_REPAIR][FEC_MAX_K];
+        Table() {
+            const Gf256& gf = Gf256::instance();
+            for (uint32_t i = 0; i < FEC_MAX_K; i++) {
+                uint8_t scale = (uint8_t)(255 ^ i);  // 1 / c_cauchy(0, i)
+                for (uint32_t j = 0; j < FEC_MAX_REPAIR; j++) {
+                    c[j][i] = gf.mul(gf.inv((uint8_t)((255 - j) ^ i)), scale);
+                }
+            }
+        }
+    };
+    static const Table table;
+    return table.c[row][col];
+}
+
+// Dựng repair cho từng block ngay khi chunk được gửi lần đầu (theo thứ tự
+// pkt_num), nên không phải đọc lại dữ liệu của block. Mỗi repair nằm liền sau
+// RepairHeader trong cùng buffer để gửi bằng một phần.
+class FecEncoder {
+public:
+    explicit FecEncoder(size_t chunk_size)
+        : chunk_size_(chunk_size),
+          stride_(sizeof(RepairHeader) + chunk_size),
+          buffers_(FEC_MAX_REPAIR * stride_),
+          first_(0), k_(0), m_(0), len_(0) {}
+
+    // Bắt đầu block mới từ pkt_num first với m repair
+    void begin(uint32_t first, uint32_t m) {
+        first_ = first;
+        k_ = 0;
+        m_ = std::min<uint32_t>(m, FEC_MAX_REPAIR);
+        len_ = 0;
+        for (uint32_t j = 0; j < m_; j++) {
+            memset(payload(j), 0, chunk_size_);
+        }
+    }
+
+    // Chunk tiếp theo của block (dữ liệu gốc, len <= chunk_size; data có thể là
+    // nullptr khi block không có repair nào)
+    void add(const char* data, size_t len) {
+        const Gf256& gf = Gf256::instance();
+        for (uint32_t j = 0; j < m_; j++) {
+            gf.mulAdd(payload(j), (const uint8_t*)data, fecCoefficient(j, k_), len);
+        }
+        k_++;
+        len_ = std::max(len_, len);
+    }
+
+    uint32_t count() const { return k_; }
+    uint32_t repairs() const { return m_; }
+
+    // Repair j của block hiện tại (header + payload, crc để trống), hợp lệ tới begin() kế tiếp
+    char* repair(uint32_t j, size_t& len) {
+        RepairHeader* header = (RepairHeader*)&buffers_[j * stride_];
+        header->marker = CTRL_MARKER;
+        header->type = CTRL_REPAIR;
+        header->index = j;
+        header->k = k_;
+        header->m = m_;
+        header->first = first_;
+        header->crc = 0;
+        len = sizeof(RepairHeader) + len_;
+        return (char*)header;
+    }
+
+private:
+    uint8_t* payload(uint32_t j) { return (uint8_t*)&buffers_[j * stride_ + sizeof(RepairHeader)]; }
+
+    size_t chunk_size_;
+    size_t stride_;
+    std::vector<char> buffers_;
+    uint32_t first_;
+    uint32_t k_;
+    uint32_t m_;
+    size_t len_;
+};
+
+// Giữ repair của các block gần đây (mỗi block một slot, block mới đè slot cũ)
+// và giải các chunk thiếu. Kích thước block K học từ repair đầu tiên: mọi
+// block trừ block cuối đều đủ K chunk.
+class FecDecoder {
+public:
+    struct Block {
+        uint32_t first = 0;
+        uint32_t k = 0;
+        uint32_t m = 0;
+        size_t len = 0;              // Độ dài payload repair
+        uint32_t count = 0;          // Số repair đã nhận
+        uint32_t rows_mask = 0;      // Repair nào đã nhận (bit = index)
+        bool active = false;         // Còn chờ giải
+        uint8_t rows[FEC_MAX_REPAIR];
+        std::vector<uint8_t> data;   // count repair, mỗi cái chunk_size byte
+    };
+
+    FecDecoder(size_t chunk_size, uint32_t slots)
+        : chunk_size_(chunk_size), block_k_(0), slots_(std::max<uint32_t>(slots, 1)) {}
+
+    // Lưu repair (copy payload). nullptr nếu trùng hoặc khác block đang giữ
+    Block* store(const RepairHeader& header, const char* payload, size_t len) {
+        block_k_ = std::max<uint32_t>(block_k_, header.k);
+        Block& block = slots_[slotIndex(header.first)];
+        if (!block.active || block.first != header.first) {
+            if (block.active && block.first > header.first) {
+                return nullptr;  // Repair đến muộn của block cũ hơn block đang giữ
+            }
+            block.first = header.first;
+            block.k = header.k;
+            block.m = header.m;
+            block.len = len;
+            block.count = 0;
+            block.rows_mask = 0;
+            block.active = true;
+            block.data.resize(FEC_MAX_REPAIR * chunk_size_);
+        }
+        if (block.k != header.k || block.len != len || (block.rows_mask >> header.index) & 1) {
+            return nullptr;
+        }
+        memcpy(&block.data[block.count * chunk_size_], payload, len);
+        block.rows[block.count++] = header.index;
+        block.rows_mask |= 1u << header.index;
+        return &block;
+    }
+
+    // Block còn chờ giải có chứa pkt_num, nullptr nếu không có
+    Block* pending(uint32_t pkt_num) {
+        if (block_k_ == 0) {
+            return nullptr;
+        }
+        uint32_t first = (pkt_num - 1) / block_k_ * block_k_ + 1;
+        Block& block = slots_[slotIndex(first)];
+        return block.active && block.first == first ? &block : nullptr;
+    }
+
+    void finish(Block& block) { block.active = false; }
+
+    // Giải r chunk thiếu (missing[b] là vị trí trong block) từ r repair đầu tiên:
+    // S_a = R_a + Σ_{i có} c(row_a, i) · D_i, rồi D_missing[b] = Σ_a A⁻¹[b][a] · S_a
+    // với A[a][b] = c(row_a, missing[b]). data[i]/lens[i]: chunk đã có (nullptr
+    // nếu thiếu); out[b]: chunk_size byte cho chunk thiếu thứ b.
+    bool recover(const Block& block, const uint8_t* const* data, const size_t* lens,
+                 const uint32_t* missing, uint32_t r, uint8_t* const* out) const {
+        if (r == 0 || r > block.count || r > FEC_MAX_REPAIR) {
+            return false;
+        }
+        const Gf256& gf = Gf256::instance();
+
+        // Ma trận A | I, khử Gauss-Jordan thành I | A⁻¹
+        uint8_t a[FEC_MAX_REPAIR][FEC_MAX_REPAIR];
+        uint8_t inv[FEC_MAX_REPAIR][FEC_MAX_REPAIR];
+        for (uint32_t row = 0; row < r; row++) {
+            for (uint32_t col = 0; col < r; col++) {
+                a[row][col] = fecCoefficient(block.rows[row], missing[col]);
+                inv[row][col] = row == col;
+            }
+        }
+        for (uint32_t col = 0; col < r; col++) {
+            uint32_t pivot = col;
+            while (pivot < r && a[pivot][col] == 0) {
+                pivot++;
+            }
+            if (pivot == r) {
+                return false;
+            }
+            std::swap(a[pivot], a[col]);
+            std::swap(inv[pivot], inv[col]);
+            uint8_t scale = gf.inv(a[col][col]);
+            for (uint32_t x = 0; x < r; x++) {
+                a[col][x] = gf.mul(a[col][x], scale);
+                inv[col][x] = gf.mul(inv[col][x], scale);
+            }
+            for (uint32_t row = 0; row < r; row++) {
+                uint8_t factor = a[row][col];
+                if (row == col || factor == 0) {
+                    continue;
+                }
+                for (uint32_t x = 0; x < r; x++) {
+                    a[row][x] ^= gf.mul(factor, a[col][x]);
+                    inv[row][x] ^= gf.mul(factor, inv[col][x]);
+                }
+            }
+        }
+
+        // S_a: bỏ phần đóng góp của các chunk đã có khỏi repair
+        syndromes_.assign(r * block.len, 0);
+        for (uint32_t row = 0; row < r; row++) {
+            uint8_t* s = &syndromes_[row * block.len];
+            memcpy(s, &block.data[row * chunk_size_], block.len);
+            for (uint32_t i = 0; i < block.k; i++) {
+                if (data[i] != nullptr) {
+                    gf.mulAdd(s, data[i], fecCoefficient(block.rows[row], i), std::min(lens[i], block.len));
+                }
+            }
+        }
+
+        for (uint32_t b = 0; b < r; b++) {
+            memset(out[b], 0, block.len);
+            for (uint32_t row = 0; row < r; row++) {
+                gf.mulAdd(out[b], &syndromes_[row * block.len], inv[b][row], block.len);
+            }
+        }
+        return true;
+    }
+
+private:
+    size_t slotIndex(uint32_t first) const { return (first - 1) / std::max<uint32_t>(block_k_, 1) % slots_.size(); }
+
+    size_t chunk_size_;
+    uint32_t block_k_;
+    std::vector<Block> slots_;
+    mutable std::vector<uint8_t> syndromes_;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef GF256_H
+#define GF256_H
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GF256_X86 1
+#endif
+
+// Số học trên GF(2^8) với đa thức 0x11d (như Reed-Solomon của RAID-6) cho FEC.
+// Cộng là XOR; phép nặng nhất là nhân-cộng cả vùng nhớ dst ^= c * src, được
+// vector hóa bằng pshufb: c * x = c * (x & 0x0f) ^ c * (x & 0xf0), mỗi nửa
+// tra trong bảng 16 phần tử nằm gọn trong một thanh ghi (SSSE3: 16 byte mỗi
+// lệnh, AVX2: 32 byte). CPU được dò một lần lúc chạy, không cần cờ biên dịch.
+
+#define GF256_POLYNOMIAL 0x11d
+
+// Bảng nhân với c theo nửa thấp/nửa cao của byte
+struct Gf256Nibbles {
+    alignas(16) uint8_t lo[16];
+    alignas(16) uint8_t hi[16];
+};
+
+inline void gf256MulAddScalar(uint8_t* dst, const uint8_t* src, const Gf256Nibbles& t, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] ^= t.lo[src[i] & 0x0f] ^ t.hi[src[i] >> 4];
+    }
+}
+
+inline void gf256XorScalar(uint8_t* dst, const uint8_t* src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+#ifdef GF256_X86
+__attribute__((target("ssse3")))
+inline void gf256MulAddSsse3(uint8_t* dst, const uint8_t* src, const Gf256Nibbles& t, size_t len) {
+    __m128i lo = _mm_load_si128((const __m128i*)t.lo);
+    __m128i hi = _mm_load_si128((const __m128i*)t.hi);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(v, mask)),
+                                  _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(v, 4), mask)));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(d, p));
+    }
+    gf256MulAddScalar(dst + i, src + i, t, len - i);
+}
+
+__attribute__((target("sse2")))
+inline void gf256XorSse2(uint8_t* dst, const uint8_t* src, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(d, _mm_loadu_si128((const __m128i*)(src + i))));
+    }
+    gf256XorScalar(dst + i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+inline void gf256MulAddAvx2(uint8_t* dst, const uint8_t* src, const Gf256Nibbles& t, size_t len) {
+    __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)t.lo));
+    __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)t.hi));
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(v, mask)),
+                                     _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(v, 4), mask)));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(d, p));
+    }
+    gf256MulAddScalar(dst + i, src + i, t, len - i);
+}
+
+__attribute__((target("avx2")))
+inline void gf256XorAvx2(uint8_t* dst, const uint8_t* src, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(d, _mm256_loadu_si256((const __m256i*)(src + i))));
+    }
+    gf256XorScalar(dst + i, src + i, len - i);
+}
+#endif
+
+class Gf256 {
+public:
+    static const Gf256& instance() {
+        static Gf256 gf;
+        return gf;
+    }
+
+    uint8_t mul(uint8_t a, uint8_t b) const {
+        return (a == 0 || b == 0) ? 0 : exp_[log_[a] + log_[b]];
+    }
+
+    // a != 0
+    uint8_t inv(uint8_t a) const { return exp_[255 - log_[a]]; }
+
+    // dst ^= c * src trên len byte
+    void mulAdd(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len) const {
+        if (c == 0) {
+            return;
+        }
+        if (c == 1) {
+            xor_(dst, src, len);
+            return;
+        }
+        Gf256Nibbles t;
+        for (int x = 0; x < 16; x++) {
+            t.lo[x] = mul(c, x);
+            t.hi[x] = mul(c, x << 4);
+        }
+        mul_add_(dst, src, t, len);
+    }
+
+    // Tên bộ xử lý vùng nhớ đang dùng (cho báo cáo)
+    const char* kernel() const { return kernel_; }
+
+private:
+    Gf256() : mul_add_(gf256MulAddScalar), xor_(gf256XorScalar), kernel_("scalar") {
+        int x = 1;
+        for (int i = 0; i < 255; i++) {
+            exp_[i] = exp_[i + 255] = x;
+            log_[x] = i;
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= GF256_POLYNOMIAL;
+            }
+        }
+        log_[0] = 0;
+#ifdef GF256_X86
+        if (__builtin_cpu_supports("avx2")) {
+            mul_add_ = gf256MulAddAvx2;
+            xor_ = gf256XorAvx2;
+            kernel_ = "avx2";
+        } else if (__builtin_cpu_supports("ssse3")) {
+            mul_add_ = gf256MulAddSsse3;
+            xor_ = gf256XorSse2;
+            kernel_ = "ssse3";
+        }
+#endif
+    }
+
+    uint8_t exp_[510];   // exp_[i] = 2^i, nhân đôi để log a + log b không phải lấy mod 255
+    uint8_t log_[256];
+    void (*mul_add_)(uint8_t*, const uint8_t*, const Gf256Nibbles&, size_t);
+    void (*xor_)(uint8_t*, const uint8_t*, size_t);
+    const char* kernel_;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef MIRROR_RING_H
+#define MIRROR_RING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Ring buffer "gương": cùng một vùng memfd được map hai lần liền nhau, nên
+// bất kỳ đoạn nào dài tối đa size() byte bắt đầu từ at(offset) đều liên tục
+// trong bộ nhớ, kể cả khi vắt qua cuối ring. Nhờ vậy chunk/packet đọc hoặc
+// ghi thẳng vào ring (pread/pwrite/memcpy/iovec) mà không phải cắt đôi.
+class MirrorRing {
+public:
+    MirrorRing() : base_(nullptr), size_(0) {}
+
+    ~MirrorRing() {
+        if (base_ != nullptr) {
+            munmap(base_, size_ * 2);
+        }
+    }
+
+    MirrorRing(const MirrorRing&) = delete;
+    MirrorRing& operator=(const MirrorRing&) = delete;
+
+    // size được làm tròn lên bội của page
+    bool create(size_t size) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size = (size + page - 1) / page * page;
+
+        int fd = memfd_create("mirror_ring", 0);
+        if (fd < 0) {
+            return false;
+        }
+        if (ftruncate(fd, size) < 0) {
+            close(fd);
+            return false;
+        }
+
+        // Giữ chỗ 2 * size địa chỉ liên tục rồi map memfd đè lên hai nửa
+        void* reserve = mmap(nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserve == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        char* base = (char*)reserve;
+        if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+            mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(reserve, size * 2);
+            close(fd);
+            return false;
+        }
+        close(fd);
+
+        base_ = base;
+        size_ = size;
+        return true;
+    }
+
+    size_t size() const { return size_; }
+
+    // Con trỏ tới byte offset (theo vị trí trong file), hợp lệ cho size() byte liên tiếp
+    char* at(uint64_t offset) const { return base_ + offset % size_; }
+
+private:
+    char* base_;
+    size_t size_;
+};
+
+#endif
@@ -0,0 +1,769 @@
+#ifndef PACKET_IO_H
+#define PACKET_IO_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/if_ether.h>
+
+#include "batch_io.h"
+#include "xdp_program.h"
+#include "xsk_socket.h"
+
+#define FRAME_HEADERS_SIZE (sizeof(struct ethhdr) + sizeof(struct iphdr) + sizeof(struct udphdr))  // 42 byte
+#define IP_UDP_HEADERS_SIZE (sizeof(struct iphdr) + sizeof(struct udphdr))  // 28 byte, MTU = payload UDP + 28
+#define UDP_MAX_PAYLOAD (65535 - IP_UDP_HEADERS_SIZE)
+#define ARP_RESOLVE_TIMEOUT_MS 1000   // Chờ kernel hỏi ARP MAC của receiver
+#define XSK_TX_RETRIES 100            // Số lần chờ frame TX trống trước khi bỏ packet
+#define XDP_MIN_PAYLOAD 2             // Gói nhỏ nhất của giao thức (HandshakePacket kiểu cũ)
+
+#define PACKET_IO_USAGE "[--backend udp|xdp] [--iface NAME] [--queue N] [--xdp-mode auto|copy|zerocopy] [--dst-mac MAC] [--gso]"
+
+// Cấu hình đường gửi/nhận packet, dùng chung cho sender_xdp và receiver_xdp
+struct PacketIoConfig {
+    std::string backend = "udp";    // udp: socket AF_INET thường; xdp: AF_XDP socket
+    std::string iface;              // Interface gắn AF_XDP socket và chương trình XDP
+    uint32_t queue = 0;             // RX/TX queue của interface
+    std::string xdp_mode = "auto";  // auto: thử zero-copy rồi copy; copy; zerocopy
+    bool has_peer_mac = false;      // --dst-mac: MAC của bên kia (hoặc gateway) thay cho ARP
+    uint8_t peer_mac[ETH_ALEN];
+    bool xdp_ack = false;           // Chương trình XDP tự trả ACK từng packet (receiver)
+    bool reuse_port = false;        // SO_REUSEPORT: nhiều UDP socket cùng port (nhiều stream)
+    bool udp_gso = false;           // --gso: UDP GSO khi gửi và UDP GRO khi nhận (backend UDP)
+};
+
+// Đọc tham số backend tại argv[i] (i được đẩy qua giá trị đi kèm, nếu có).
+// false nếu không phải tham số backend hoặc giá trị không hợp lệ.
+inline bool parsePacketIoOption(int argc, char* argv[], int& i, PacketIoConfig& config) {
+    std::string arg = argv[i];
+    if (arg == "--gso") {
+        config.udp_gso = true;
+        return true;
+    }
+    if (i + 1 >= argc) {
+        return false;
+    }
+    std::string value = argv[i + 1];
+    if (arg == "--backend" && (value == "udp" || value == "xdp")) {
+        config.backend = value;
+    } else if (arg == "--iface") {
+        config.iface = value;
+    } else if (arg == "--queue") {
+        config.queue = std::stoul(value);
+    } else if (arg == "--xdp-mode" && (value == "auto" || value == "copy" || value == "zerocopy")) {
+        config.xdp_mode = value;
+    } else if (arg == "--dst-mac") {
+        unsigned int b[ETH_ALEN];
+        if (sscanf(value.c_str(), "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != ETH_ALEN) {
+            return false;
+        }
+        for (int k = 0; k < ETH_ALEN; k++) {
+            config.peer_mac[k] = (uint8_t)b[k];
+        }
+        config.has_peer_mac = true;
+    } else {
+        return false;
+    }
+    i++;
+    return true;
+}
+
+// Đường gửi/nhận datagram của giao thức. Giao diện giống BatchSender/BatchReceiver:
+// add() gom datagram rồi flush() gửi cả batch; receive() trả về một batch,
+// dữ liệu hợp lệ tới lần receive() tiếp theo.
+class PacketIo {
+public:
+    virtual ~PacketIo() {}
+
+    virtual std::string name() const = 0;
+    // fd để chờ bằng poll/ppoll (POLLIN khi có datagram)
+    virtual int fd() const = 0;
+    // Thời gian chờ của receive(MSG_WAITFORONE) và receiveFrom()
+    virtual void setReceiveTimeout(int timeout_ms) = 0;
+
+    virtual void add(const struct sockaddr_in& addr, const void* part1, size_t len1,
+                     const void* part2 = nullptr, size_t len2 = 0) = 0;
+    virtual void addCopy(const struct sockaddr_in& addr, const void* data, size_t len) = 0;
+    virtual bool full() const = 0;
+    virtual int flush() = 0;
+
+    // flags: MSG_WAITFORONE (chờ theo setReceiveTimeout) hoặc MSG_DONTWAIT; -1 nếu không có gì
+    virtual int receive(int flags) = 0;
+    virtual char* data(int i) = 0;
+    virtual size_t length(int i) const = 0;
+    virtual const struct sockaddr_in& source(int i) const = 0;
+    // Datagram i đã được trả ACK ngay ở tầng dưới (XDP_TX), không gửi ACK nữa
+    virtual bool acknowledged(int i) const { (void)i; return false; }
+
+    // Một datagram riêng lẻ (handshake)
+    virtual bool sendTo(const struct sockaddr_in& addr, const void* data, size_t len) = 0;
+    virtual ssize_t receiveFrom(char* buffer, size_t size, struct sockaddr_in& addr) = 0;
+    // Payload UDP lớn nhất backend gửi được (chưa tính path MTU tới bên kia)
+    virtual size_t maxPayload() const = 0;
+
+    // Thống kê cho báo cáo: tên thao tác gửi/nhận một batch và bộ đếm tương ứng
+    virtual const char* sendCall() const = 0;
+    virtual const char* receiveCall() const = 0;
+    virtual const BatchStats& sendStats() const = 0;
+    virtual const BatchStats& receiveStats() const = 0;
+    virtual void printStats(std::ostream&) const {}
+
+    // Socket UDP bên dưới (để chỉnh SO_RCVBUF...), -1 nếu không phải backend UDP
+    virtual int udpSocket() const { return -1; }
+};
+
+// Backend UDP: socket AF_INET với sendmmsg/recvmmsg
+class UdpPacketIo : public PacketIo {
+public:
+    UdpPacketIo(int sock, size_t batch_size, size_t buffer_size)
+        : sock_(sock), sender_(sock, batch_size), receiver_(sock, batch_size, buffer_size) {}
+
+    ~UdpPacketIo() override { close(sock_); }
+
+    // Bật GSO/GRO trên socket, in lý do nếu kernel không hỗ trợ
+    void enableOffload() {
+        if (!sender_.enableGso()) {
+            std::cerr << "Không bật được UDP GSO: " << strerror(errno) << std::endl;
+        }
+        if (!receiver_.enableGro()) {
+            std::cerr << "Không bật được UDP GRO: " << strerror(errno) << std::endl;
+        }
+    }
+
+    std::string name() const override {
+        std::string offload;
+        if (sender_.gso()) {
+            offload += "GSO";
+        }
+        if (receiver_.gro()) {
+            offload += offload.empty() ? "GRO" : "/GRO";
+        }
+        return offload.empty() ? "udp" : "udp (" + offload + ")";
+    }
+    int fd() const override { return sock_; }
+
+    void setReceiveTimeout(int timeout_ms) override {
+        struct timeval tv;
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+        setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+    void add(const struct sockaddr_in& addr, const void* part1, size_t len1,
+             const void* part2 = nullptr, size_t len2 = 0) override {
+        sender_.add(addr, part1, len1, part2, len2);
+    }
+    void addCopy(const struct sockaddr_in& addr, const void* data, size_t len) override {
+        sender_.addCopy(addr, data, len);
+    }
+    bool full() const override { return sender_.full(); }
+    int flush() override { return sender_.flush(); }
+
+    int receive(int flags) override { return receiver_.receive(flags); }
+    char* data(int i) override { return receiver_.data(i); }
+    size_t length(int i) const override { return receiver_.length(i); }
+    const struct sockaddr_in& source(int i) const override { return receiver_.source(i); }
+
+    bool sendTo(const struct sockaddr_in& addr, const void* data, size_t len) override {
+        return sendto(sock_, data, len, 0, (const struct sockaddr*)&addr, sizeof(addr)) == (ssize_t)len;
+    }
+
+    ssize_t receiveFrom(char* buffer, size_t size, struct sockaddr_in& addr) override {
+        if (!receiver_.gro()) {
+            socklen_t addr_len = sizeof(addr);
+            return recvfrom(sock_, buffer, size, 0, (struct sockaddr*)&addr, &addr_len);
+        }
+        // Có GRO: datagram giống nhau (handshake gửi lại) có thể bị gộp, chỉ lấy cái đầu
+        char control[CMSG_SPACE(sizeof(int))];
+        struct iovec iov = {buffer, size};
+        struct msghdr hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &addr;
+        hdr.msg_namelen = sizeof(addr);
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control;
+        hdr.msg_controllen = sizeof(control);
+        ssize_t len = recvmsg(sock_, &hdr, 0);
+        size_t segment_size = len > 0 ? groSegmentSize(hdr) : 0;
+        return segment_size > 0 ? std::min<ssize_t>(len, segment_size) : len;
+    }
+
+    // Giới hạn theo MTU do kernel kiểm tra khi gửi (EMSGSIZE với IP_PMTUDISC_DO)
+    size_t maxPayload() const override { return UDP_MAX_PAYLOAD; }
+
+    const char* sendCall() const override { return "sendmmsg"; }
+    const char* receiveCall() const override { return "recvmmsg"; }
+    const BatchStats& sendStats() const override { return sender_.stats(); }
+    const BatchStats& receiveStats() const override { return receiver_.stats(); }
+    int udpSocket() const override { return sock_; }
+
+    void printStats(std::ostream& out) const override {
+        if (sender_.stats().dropped > 0) {
+            out << "sendmmsg lỗi: bỏ " << sender_.stats().dropped << " datagram (lần cuối: "
+                << strerror(sender_.stats().last_error) << ")" << std::endl;
+        }
+        if (sender_.gsoError() != 0) {
+            out << "UDP GSO: tắt giữa chừng (" << strerror(sender_.gsoError())
+                << "), các datagram còn lại gửi riêng" << std::endl;
+        }
+        if (sender_.gso()) {
+            out << "UDP GSO: " << sender_.gsoBuffers() << " super-buffer, "
+                << (sender_.gsoBuffers() > 0 ? (double)sender_.gsoSegments() / sender_.gsoBuffers() : 0)
+                << " datagram/buffer" << std::endl;
+        }
+        if (receiver_.gro()) {
+            out << "UDP GRO: " << receiver_.groBuffers() << " buffer gộp, "
+                << (receiver_.groBuffers() > 0 ? (double)receiver_.groSegments() / receiver_.groBuffers() : 0)
+                << " datagram/buffer" << std::endl;
+        }
+    }
+
+private:
+    int sock_;
+    BatchSender sender_;
+    BatchReceiver receiver_;
+};
+
+// Checksum IPv4 header (RFC 1071)
+inline uint16_t ipChecksum(const void* header, size_t len) {
+    const uint16_t* words = (const uint16_t*)header;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < len / 2; i++) {
+        sum += words[i];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+// Tìm MAC của ip trên interface trong bảng ARP; chưa có thì gửi một datagram
+// rỗng tới port discard (9) để kernel hỏi ARP rồi chờ kết quả
+inline bool resolvePeerMac(const char* ifname, in_addr_t ip, uint8_t mac[ETH_ALEN]) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return false;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ARP_RESOLVE_TIMEOUT_MS);
+    bool probed = false;
+    while (true) {
+        struct arpreq req;
+        memset(&req, 0, sizeof(req));
+        struct sockaddr_in* pa = (struct sockaddr_in*)&req.arp_pa;
+        pa->sin_family = AF_INET;
+        pa->sin_addr.s_addr = ip;
+        strncpy(req.arp_dev, ifname, sizeof(req.arp_dev) - 1);
+        if (ioctl(sock, SIOCGARP, &req) == 0 && (req.arp_flags & ATF_COM)) {
+            memcpy(mac, req.arp_ha.sa_data, ETH_ALEN);
+            close(sock);
+            return true;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            close(sock);
+            return false;
+        }
+        if (!probed) {
+            struct sockaddr_in discard;
+            memset(&discard, 0, sizeof(discard));
+            discard.sin_family = AF_INET;
+            discard.sin_port = htons(9);
+            discard.sin_addr.s_addr = ip;
+            setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, ifname, strlen(ifname));
+            sendto(sock, "", 0, 0, (struct sockaddr*)&discard, sizeof(discard));
+            probed = true;
+        }
+        usleep(10000);
+    }
+}
+
+// Backend AF_XDP: packet đi thẳng giữa UMEM và driver, bỏ qua network stack.
+// Ethernet/IPv4/UDP header được dựng và kiểm tra ở user space, nên hai đầu
+// vẫn nói chuyện được với bên kia dùng backend UDP. MAC của bên kia lấy từ
+// ARP (sender) hoặc học từ frame nhận được (receiver).
+class XdpPacketIo : public PacketIo {
+public:
+    explicit XdpPacketIo(size_t batch_size)
+        : batch_size_(batch_size), timeout_ms_(1000), ifindex_(0), mtu_(ETH_DATA_LEN), local_ip_(0), local_port_(0),
+          reserve_sock_(-1), ip_id_(0), pending_(0), tx_dropped_(0), no_route_(0), rx_invalid_(0),
+          packets_(batch_size) {}
+
+    ~XdpPacketIo() override {
+        xsk_.reset();
+        program_.reset();
+        if (reserve_sock_ >= 0) {
+            close(reserve_sock_);
+        }
+    }
+
+    // local_port = 0: chọn port tạm; peer: địa chỉ bên kia nếu đã biết (sender)
+    bool open(const PacketIoConfig& config, uint16_t local_port, const struct sockaddr_in* peer, std::string& error) {
+        if (config.iface.empty()) {
+            error = "cần --iface cho backend xdp";
+            return false;
+        }
+        iface_ = config.iface;
+        ifindex_ = if_nametoindex(iface_.c_str());
+        if (ifindex_ == 0) {
+            error = "không tìm thấy interface " + iface_;
+            return false;
+        }
+        if (!readInterfaceAddress(error) || !reservePort(local_port, error)) {
+            return false;
+        }
+
+        if (peer != nullptr) {
+            uint8_t mac[ETH_ALEN];
+            if (config.has_peer_mac) {
+                memcpy(mac, config.peer_mac, ETH_ALEN);
+            } else if (!resolvePeerMac(iface_.c_str(), peer->sin_addr.s_addr, mac)) {
+                error = "không tìm được MAC của " + std::string(inet_ntoa(peer->sin_addr)) +
+                        " trên " + iface_ + " (dùng --dst-mac nếu phải qua gateway)";
+                return false;
+            }
+            learnPeer(peer->sin_addr.s_addr, mac);
+        }
+
+        // Chương trình XDP phải gắn vào interface trước khi bind socket vào queue
+        bool want_zero_copy = config.xdp_mode != "copy";
+        program_.reset(new XdpProgram());
+        if (!program_->load(local_port_, XDP_MIN_PAYLOAD, config.xdp_ack, error) ||
+            !program_->attach(ifindex_, config.xdp_mode != "zerocopy", error)) {
+            return false;
+        }
+
+        // Zero-copy cần driver hỗ trợ (và native XDP); auto thì lùi về copy mode
+        std::string zc_error;
+        xsk_.reset(new XskSocket());
+        if (!want_zero_copy || !program_->driverMode() || !xsk_->open(ifindex_, config.queue, true, zc_error)) {
+            if (config.xdp_mode == "zerocopy") {
+                error = zc_error.empty() ? "zero-copy cần native XDP (driver mode)" : zc_error;
+                return false;
+            }
+            xsk_.reset(new XskSocket());
+            if (!xsk_->open(ifindex_, config.queue, false, error)) {
+                return false;
+            }
+        }
+        return program_->addSocket(config.queue, xsk_->fd(), error);
+    }
+
+    std::string name() const override {
+        return "af_xdp " + iface_ + " (" + (xsk_->zeroCopy() ? "zero-copy" : "copy") + ", " +
+               (program_->driverMode() ? "native XDP" : "generic XDP") +
+               (program_->reflectsAcks() ? ", ACK bằng XDP_TX" : "") + ")";
+    }
+
+    int fd() const override { return xsk_->fd(); }
+    void setReceiveTimeout(int timeout_ms) override { timeout_ms_ = timeout_ms; }
+
+    void add(const struct sockaddr_in& addr, const void* part1, size_t len1,
+             const void* part2 = nullptr, size_t len2 = 0) override {
+        size_t payload_len = len1 + (part2 != nullptr ? len2 : 0);
+        const uint8_t* mac = peerMac(addr.sin_addr.s_addr);
+        if (mac == nullptr) {
+            no_route_++;
+            return;
+        }
+        if (FRAME_HEADERS_SIZE + payload_len > XSK_FRAME_SIZE) {
+            tx_dropped_++;
+            return;
+        }
+
+        // Hết frame TX: gửi những gì đang chờ để kernel trả frame về
+        uint64_t frame_addr;
+        char* frame = xsk_->txFrame(frame_addr);
+        for (int retry = 0; frame == nullptr && retry < XSK_TX_RETRIES; retry++) {
+            flush();
+            frame = xsk_->txFrame(frame_addr);
+            if (frame == nullptr) {
+                usleep(10);
+            }
+        }
+        if (frame == nullptr) {
+            tx_dropped_++;  // Giao thức sẽ gửi lại
+            return;
+        }
+
+        struct ethhdr* eth = (struct ethhdr*)frame;
+        memcpy(eth->h_dest, mac, ETH_ALEN);
+        memcpy(eth->h_source, local_mac_, ETH_ALEN);
+        eth->h_proto = htons(ETH_P_IP);
+
+        struct iphdr* ip = (struct iphdr*)(frame + sizeof(struct ethhdr));
+        ip->version = 4;
+        ip->ihl = 5;
+        ip->tos = 0;
+        ip->tot_len = htons(sizeof(struct iphdr) + sizeof(struct udphdr) + payload_len);
+        ip->id = htons(ip_id_++);
+        ip->frag_off = htons(IP_DF);
+        ip->ttl = 64;
+        ip->protocol = IPPROTO_UDP;
+        ip->check = 0;
+        ip->saddr = local_ip_;
+        ip->daddr = addr.sin_addr.s_addr;
+        ip->check = ipChecksum(ip, sizeof(struct iphdr));
+
+        // UDP checksum = 0 (không dùng) là hợp lệ với IPv4
+        struct udphdr* udp = (struct udphdr*)(ip + 1);
+        udp->source = htons(local_port_);
+        udp->dest = addr.sin_port;
+        udp->len = htons(sizeof(struct udphdr) + payload_len);
+        udp->check = 0;
+
+        char* payload = (char*)(udp + 1);
+        memcpy(payload, part1, len1);
+        if (part2 != nullptr && len2 > 0) {
+            memcpy(payload + len1, part2, len2);
+        }
+        xsk_->txSubmit(frame_addr, FRAME_HEADERS_SIZE + payload_len);
+        pending_++;
+    }
+
+    void addCopy(const struct sockaddr_in& addr, const void* data, size_t len) override {
+        add(addr, data, len);  // Payload luôn được copy vào frame
+    }
+
+    bool full() const override { return pending_ >= batch_size_; }
+
+    int flush() override {
+        uint32_t published = xsk_->txFlush();
+        if (published > 0) {
+            send_stats_.record(published);
+        }
+        pending_ = 0;
+        return published;
+    }
+
+    int receive(int flags) override {
+        xsk_->rxRelease();
+        int count = receiveBatch();
+        if (count == 0 && (flags & MSG_WAITFORONE) && waitReadable()) {
+            count = receiveBatch();
+        }
+        if (count == 0) {
+            return -1;
+        }
+        receive_stats_.record(count);
+        return count;
+    }
+
+    char* data(int i) override { return packets_[i].data; }
+    size_t length(int i) const override { return packets_[i].len; }
+    const struct sockaddr_in& source(int i) const override { return packets_[i].source; }
+    bool acknowledged(int i) const override { return packets_[i].acknowledged; }
+
+    bool sendTo(const struct sockaddr_in& addr, const void* data, size_t len) override {
+        add(addr, data, len);
+        return flush() == 1;
+    }
+
+    ssize_t receiveFrom(char* buffer, size_t size, struct sockaddr_in& addr) override {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms_);
+        while (true) {
+            xsk_->rxRelease();
+            if (xsk_->rxPeek(1) == 1) {
+                uint32_t len;
+                char* frame = xsk_->rxData(0, len);
+                Packet packet;
+                if (parseFrame(frame, len, packet)) {
+                    size_t copied = std::min(size, packet.len);
+                    memcpy(buffer, packet.data, copied);
+                    addr = packet.source;
+                    xsk_->rxRelease();
+                    return copied;
+                }
+                rx_invalid_++;
+                continue;
+            }
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0 || !xsk_->waitReadable((int)remaining)) {
+                errno = EAGAIN;
+                return -1;
+            }
+        }
+    }
+
+    // Một frame UMEM (trừ headroom kernel chừa khi nhận), không vượt MTU của interface
+    size_t maxPayload() const override {
+        return std::min<size_t>(XSK_FRAME_SIZE - XDP_PACKET_HEADROOM - FRAME_HEADERS_SIZE, mtu_ - IP_UDP_HEADERS_SIZE);
+    }
+
+    const char* sendCall() const override { return "AF_XDP TX ring"; }
+    const char* receiveCall() const override { return "AF_XDP RX ring"; }
+    const BatchStats& sendStats() const override { return send_stats_; }
+    const BatchStats& receiveStats() const override { return receive_stats_; }
+
+    void printStats(std::ostream& out) const override {
+        struct xdp_statistics stats;
+        out << "AF_XDP: " << xsk_->kicks() << " lần sendto đánh thức TX, "
+            << tx_dropped_ << " packet bỏ do hết frame TX, "
+            << no_route_ << " packet không rõ MAC đích, "
+            << rx_invalid_ << " frame không hợp lệ" << std::endl;
+        if (xsk_->statistics(stats)) {
+            out << "AF_XDP kernel: rx_dropped=" << stats.rx_dropped
+                << " rx_ring_full=" << stats.rx_ring_full
+                << " fill_ring_empty=" << stats.rx_fill_ring_empty_descs
+                << " tx_invalid=" << stats.tx_invalid_descs << std::endl;
+        }
+        for (uint32_t queue = 0; queue < XSKMAP_MAX_ENTRIES; queue++) {
+            XdpQueueCounters counters;
+            if (!program_->counters(queue, counters) ||
+                counters.packets + counters.dropped + counters.passed == 0) {
+                continue;
+            }
+            out << "XDP queue " << queue << ": chuyển vào AF_XDP " << counters.packets << " packets ("
+                << counters.bytes / (1024.0 * 1024.0) << " MB), bỏ " << counters.dropped
+                << " packet sai định dạng, " << counters.passed << " frame đi tiếp lên network stack" << std::endl;
+            if (program_->reflectsAcks()) {
+                out << "XDP queue " << queue << ": " << counters.acked << " ACK trả bằng XDP_TX, "
+                    << counters.ring_full << " packet bỏ do ring buffer payload đầy" << std::endl;
+            }
+        }
+    }
+
+private:
+    struct Packet {
+        char* data;
+        size_t len;
+        struct sockaddr_in source;
+        bool acknowledged;  // Đến qua ring buffer, XDP đã trả ACK
+    };
+
+    // Lấy tối đa batch_size_ datagram: frame trong RX ring, rồi payload mà
+    // chương trình XDP đã trả ACK (ring buffer). Giữ tới lần receive() sau.
+    int receiveBatch() {
+        uint32_t n = xsk_->rxPeek(batch_size_);
+        int count = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t len;
+            char* frame = xsk_->rxData(i, len);
+            if (parseFrame(frame, len, packets_[count])) {
+                count++;
+            } else {
+                rx_invalid_++;
+            }
+        }
+        if (!program_->reflectsAcks()) {
+            return count;
+        }
+
+        BpfRingBuffer& ring = program_->ackRing();
+        ring.release();
+        const XdpAckRecord* record;
+        while ((size_t)count < batch_size_ && (record = (const XdpAckRecord*)ring.next()) != nullptr) {
+            Packet& packet = packets_[count++];
+            packet.data = (char*)record->payload;
+            packet.len = record->len;
+            memset(&packet.source, 0, sizeof(packet.source));
+            packet.source.sin_family = AF_INET;
+            packet.source.sin_addr.s_addr = record->saddr;
+            packet.source.sin_port = record->sport;
+            packet.acknowledged = true;
+        }
+        return count;
+    }
+
+    // Chờ RX ring (và ring buffer payload nếu XDP trả ACK) có dữ liệu
+    bool waitReadable() {
+        if (!program_->reflectsAcks()) {
+            return xsk_->waitReadable(timeout_ms_);
+        }
+        struct pollfd pfds[2];
+        pfds[0].fd = xsk_->fd();
+        pfds[1].fd = program_->ackRing().fd();
+        for (struct pollfd& pfd : pfds) {
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+        }
+        return poll(pfds, 2, timeout_ms_) > 0;
+    }
+
+    struct Peer {
+        in_addr_t ip;
+        uint8_t mac[ETH_ALEN];
+    };
+
+    bool readInterfaceAddress(std::string& error) {
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        struct ifreq ifr;
+        memset(&ifr, 0, sizeof(ifr));
+        strncpy(ifr.ifr_name, iface_.c_str(), IFNAMSIZ - 1);
+        bool ok = sock >= 0 && ioctl(sock, SIOCGIFHWADDR, &ifr) == 0;
+        if (ok) {
+            memcpy(local_mac_, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+            ok = ioctl(sock, SIOCGIFADDR, &ifr) == 0;
+        }
+        if (ok) {
+            local_ip_ = ((struct sockaddr_in*)&ifr.ifr_addr)->sin_addr.s_addr;
+            if (ioctl(sock, SIOCGIFMTU, &ifr) == 0) {
+                mtu_ = ifr.ifr_mtu;
+            }
+        } else {
+            error = "interface " + iface_ + " không có địa chỉ IPv4";
+        }
+        if (sock >= 0) {
+            close(sock);
+        }
+        return ok;
+    }
+
+    // Giữ port bằng một UDP socket thường để kernel không cấp port đó cho ai
+    // khác (packet tới port này không đi tới socket đó mà bị XDP chuyển đi)
+    bool reservePort(uint16_t port, std::string& error) {
+        reserve_sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        socklen_t addr_len = sizeof(addr);
+        if (reserve_sock_ < 0 || bind(reserve_sock_, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            getsockname(reserve_sock_, (struct sockaddr*)&addr, &addr_len) < 0) {
+            error = "không giữ được UDP port " + std::to_string(port);
+            return false;
+        }
+        local_port_ = ntohs(addr.sin_port);
+        return true;
+    }
+
+    void learnPeer(in_addr_t ip, const uint8_t* mac) {
+        for (Peer& peer : peers_) {
+            if (peer.ip == ip) {
+                memcpy(peer.mac, mac, ETH_ALEN);
+                return;
+            }
+        }
+        Peer peer;
+        peer.ip = ip;
+        memcpy(peer.mac, mac, ETH_ALEN);
+        peers_.push_back(peer);
+    }
+
+    const uint8_t* peerMac(in_addr_t ip) const {
+        for (const Peer& peer : peers_) {
+            if (peer.ip == ip) {
+                return peer.mac;
+            }
+        }
+        return nullptr;
+    }
+
+    // Kiểm tra frame Ethernet/IPv4/UDP tới port của mình, lấy payload và địa chỉ nguồn
+    bool parseFrame(char* frame, uint32_t len, Packet& packet) {
+        if (len < FRAME_HEADERS_SIZE) {
+            return false;
+        }
+        const struct ethhdr* eth = (const struct ethhdr*)frame;
+        const struct iphdr* ip = (const struct iphdr*)(frame + sizeof(struct ethhdr));
+        size_t ip_header_len = ip->ihl * 4;
+        size_t ip_len = ntohs(ip->tot_len);
+        if (eth->h_proto != htons(ETH_P_IP) || ip->version != 4 || ip_header_len < sizeof(struct iphdr) ||
+            ip->protocol != IPPROTO_UDP || (ntohs(ip->frag_off) & (IP_MF | IP_OFFMASK)) != 0 ||
+            ip_len < ip_header_len + sizeof(struct udphdr) || sizeof(struct ethhdr) + ip_len > len) {
+            return false;
+        }
+        const struct udphdr* udp = (const struct udphdr*)((const char*)ip + ip_header_len);
+        size_t udp_len = ntohs(udp->len);
+        if (ntohs(udp->dest) != local_port_ || udp_len < sizeof(struct udphdr) ||
+            udp_len > ip_len - ip_header_len) {
+            return false;
+        }
+
+        packet.data = (char*)(udp + 1);
+        packet.len = udp_len - sizeof(struct udphdr);
+        memset(&packet.source, 0, sizeof(packet.source));
+        packet.source.sin_family = AF_INET;
+        packet.source.sin_addr.s_addr = ip->saddr;
+        packet.source.sin_port = udp->source;
+        packet.acknowledged = false;
+
+        // Trả lời theo MAC nguồn của frame (thường chỉ có một bên kia nên dò tuyến tính)
+        const uint8_t* known = peerMac(ip->saddr);
+        if (known == nullptr || memcmp(known, eth->h_source, ETH_ALEN) != 0) {
+            learnPeer(ip->saddr, eth->h_source);
+        }
+        return true;
+    }
+
+    size_t batch_size_;
+    int timeout_ms_;
+    std::string iface_;
+    unsigned int ifindex_;
+    int mtu_;
+    uint8_t local_mac_[ETH_ALEN];
+    in_addr_t local_ip_;
+    uint16_t local_port_;
+    int reserve_sock_;
+    uint16_t ip_id_;
+    size_t pending_;
+    uint64_t tx_dropped_;
+    uint64_t no_route_;
+    uint64_t rx_invalid_;
+    std::vector<Peer> peers_;
+    std::vector<Packet> packets_;
+    std::unique_ptr<XdpProgram> program_;
+    std::unique_ptr<XskSocket> xsk_;
+    BatchStats send_stats_;
+    BatchStats receive_stats_;
+};
+
+// Mở đường gửi/nhận theo cấu hình. Backend xdp không dùng được (thiếu quyền,
+// interface không hỗ trợ...) thì báo lý do và lùi về UDP socket.
+// local_port = 0: port tạm; peer: địa chỉ bên kia nếu đã biết (sender).
+// nullptr nếu không tạo/bind được UDP socket.
+inline std::unique_ptr<PacketIo> openPacketIo(const PacketIoConfig& config, uint16_t local_port,
+                                              const struct sockaddr_in* peer, size_t batch_size, size_t buffer_size) {
+    if (config.backend == "xdp") {
+        std::unique_ptr<XdpPacketIo> io(new XdpPacketIo(batch_size));
+        std::string error;
+        if (io->open(config, local_port, peer, error)) {
+            return std::unique_ptr<PacketIo>(io.release());
+        }
+        std::cerr << "Không dùng được AF_XDP: " << error << std::endl;
+        std::cerr << "Chuyển sang UDP socket" << std::endl;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return nullptr;
+    }
+    if (local_port != 0) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(local_port);
+        int one = 1;
+        if ((config.reuse_port && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) ||
+            bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(sock);
+            return nullptr;
+        }
+    }
+    std::unique_ptr<UdpPacketIo> io(new UdpPacketIo(sock, batch_size, buffer_size));
+    if (config.udp_gso) {
+        io->enableOffload();
+    }
+    return std::unique_ptr<PacketIo>(io.release());
+}
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+// Định nghĩa gói tin dùng chung cho sender_xdp và receiver_xdp
+
+#define CHUNK_SIZE 972    // Chunk mặc định (handshake 2 byte, hoặc khi không dò được path MTU)
+#define MAX_CHUNK_SIZE 8968   // Jumbo frame: MTU 9000 - IP 20 - UDP 8 - header 4
+#define HEADER_SIZE 4
+#define DEFAULT_WINDOW_SIZE 2048   // ~2 MB dữ liệu đang bay
+#define MAX_WINDOW_SIZE 8191  // 2^13 - 1 (13 bits)
+#define MAX_WINDOW_SCALE 7    // Window tối đa 8191 << 7 ~ 1M packets (~1 GB)
+#define MAX_SCALED_WINDOW ((uint32_t)MAX_WINDOW_SIZE << MAX_WINDOW_SCALE)
+
+// Handshake flags (3 bits cuối)
+#define SYN 0x01   // 0000 0001 - Yêu cầu kết nối
+#define ACK 0x02   // 0000 0010 - Xác nhận
+#define FIN 0x04   // 0000 0100 - Kết thúc kết nối
+
+// Handshake packet structure (16 bits = 2 bytes)
+// Format: [13 bits: window_size][3 bits: flags]
+struct HandshakePacket {
+    uint16_t data;  // 13 bits window size + 3 bits flags
+
+    // Set window size (13 bits đầu)
+    void setWindowSize(uint16_t window_size) {
+        if (window_size > MAX_WINDOW_SIZE) {
+            window_size = MAX_WINDOW_SIZE;
+        }
+        data = (window_size << 3) | (data & 0x07);
+    }
+
+    // Get window size
+    uint16_t getWindowSize() const {
+        return (data >> 3) & 0x1FFF;  // Lấy 13 bits đầu
+    }
+
+    // Set flags (3 bits cuối)
+    void setFlags(uint8_t flags) {
+        data = (data & 0xFFF8) | (flags & 0x07);
+    }
+
+    // Get flags
+    uint8_t getFlags() const {
+        return data & 0x07;  // Lấy 3 bits cuối
+    }
+};
+
+struct PacketHeader {
+    uint32_t pkt_num;
+};
+
+// Header của data packet khi có FEATURE_CRC: thêm CRC32C của payload để
+// receiver bỏ chunk hỏng ngay khi nhận (và xin gửi lại bằng NACK)
+struct CrcPacketHeader {
+    uint32_t pkt_num;
+    uint32_t crc;
+};
+
+// Header của data packet khi có FEATURE_COMPRESS: thêm số byte nén của block
+// chứa chunk, để receiver biết block nén hay gửi nguyên và block dùng bao nhiêu chunk
+struct CompressPacketHeader {
+    uint32_t pkt_num;
+    uint32_t crc;           // Như CrcPacketHeader, 0 nếu không có FEATURE_CRC
+    uint32_t block_size;    // Số byte nén của block, 0 nếu block gửi nguyên
+};
+
+// ACK kiểu cũ: một ACK cho mỗi packet
+struct AckPacket {
+    uint32_t ack_num;
+};
+
+// Gói điều khiển: 4 byte đầu luôn bằng CTRL_MARKER. pkt_num/ack_num 0 không
+// bao giờ xuất hiện (đánh số từ 1) nên hai bên phân biệt được với data/ACK.
+#define CTRL_MARKER 0
+#define CTRL_HANDSHAKE 1
+#define CTRL_SACK 2
+#define CTRL_PROBE 3
+#define CTRL_REPAIR 4
+#define CTRL_NACK 5
+#define CTRL_DIGEST 6
+#define CTRL_RESUME 7
+
+struct ControlHeader {
+    uint32_t marker;  // CTRL_MARKER
+    uint8_t type;     // CTRL_*
+};
+
+inline bool isControlPacket(const char* buffer, size_t len) {
+    uint32_t marker;
+    if (len < sizeof(ControlHeader)) {
+        return false;
+    }
+    memcpy(&marker, buffer, sizeof(marker));
+    return marker == CTRL_MARKER;
+}
+
+inline uint8_t controlType(const char* buffer) {
+    return ((const ControlHeader*)buffer)->type;
+}
+
+// Các tính năng thỏa thuận trong handshake mở rộng
+#define FEATURE_SACK 0x01   // Cumulative ACK + SACK bitmap thay cho ACK từng packet
+#define FEATURE_STREAMS 0x02  // Truyền song song: handshake mang đoạn file của stream
+#define FEATURE_FEC 0x04    // Sender gửi thêm repair packet (FEC) cho mỗi block chunk
+#define FEATURE_CRC 0x08    // CRC32C cho từng chunk + digest cả file khi kết thúc
+#define FEATURE_RESUME 0x10 // Receiver đã có một phần dữ liệu (checkpoint), sender chỉ gửi chunk còn thiếu
+#define FEATURE_COMPRESS 0x20 // Dữ liệu nén theo block, codec trong handshake
+
+// Nén (FEATURE_COMPRESS): đoạn file của stream chia thành block
+// COMPRESS_BLOCK_CHUNKS chunk liền nhau, mỗi block nén độc lập. Block nén gửi
+// trong n chunk đầu của chính nó (n = số byte nén / chunk_size, làm tròn lên);
+// các chunk còn lại của block không được gửi, receiver coi như đã nhận ngay khi
+// biết block_size. Block không tiết kiệm được chunk nào thì gửi nguyên.
+#define COMPRESS_NONE 0
+#define COMPRESS_LZ4 1
+#define COMPRESS_ZSTD 2
+#define COMPRESS_BLOCK_CHUNKS 64
+
+#define MAX_STREAMS 64
+
+#define HANDSHAKE_VERSION 2
+
+// Đoạn file [offset, offset + size) do một stream truyền (FEATURE_STREAMS).
+// pkt_num của mỗi stream vẫn bắt đầu từ 1 tại offset của đoạn.
+struct StreamRange {
+    uint64_t offset;
+    uint64_t size;
+    uint16_t index;         // 0..count-1
+    uint16_t count;         // Tổng số stream
+    uint32_t reserved;
+};
+
+// Các tham số thỏa thuận trong handshake
+struct HandshakeParams {
+    uint32_t window;        // Số packet tối đa đang bay
+    uint32_t features;      // FEATURE_*
+    uint16_t chunk_size;    // Payload tối đa của mỗi packet
+    uint64_t file_size;     // Kích thước file (0 nếu không biết)
+    StreamRange range = {0, 0, 0, 1, 0};  // Không có FEATURE_STREAMS: cả file
+    uint8_t codec = COMPRESS_NONE;        // COMPRESS_* khi có FEATURE_COMPRESS
+};
+
+// Handshake mở rộng: giữ nguyên 16 bit window/flags của HandshakePacket và
+// thêm version, feature flags, hệ số scale của window (window thật =
+// window_size << window_scale, như TCP window scaling), chunk size và kích
+// thước file. Bên nào nhận được handshake 2 byte thì trả lời bằng handshake
+// 2 byte (window <= MAX_WINDOW_SIZE, CHUNK_SIZE cố định, không có tính năng mở rộng).
+// Trường range chỉ được gửi khi có FEATURE_STREAMS (xem size()).
+struct HandshakeExtPacket {
+    uint32_t marker;        // CTRL_MARKER
+    uint8_t type;           // CTRL_HANDSHAKE
+    uint8_t version;        // HANDSHAKE_VERSION
+    HandshakePacket base;   // 13 bits window size + 3 bits flags
+    uint32_t features;      // FEATURE_*
+    uint8_t window_scale;   // 0..MAX_WINDOW_SCALE
+    uint8_t codec;          // COMPRESS_* (bản cũ luôn gửi 0)
+    uint16_t chunk_size;
+    uint64_t file_size;
+    StreamRange range;
+
+    void init(const HandshakeParams& params, uint8_t flags) {
+        marker = CTRL_MARKER;
+        type = CTRL_HANDSHAKE;
+        version = HANDSHAKE_VERSION;
+        base.data = 0;
+        base.setFlags(flags);
+        setWindow(params.window);
+        codec = (params.features & FEATURE_COMPRESS) ? params.codec : COMPRESS_NONE;
+        features = params.features;
+        chunk_size = params.chunk_size;
+        file_size = params.file_size;
+        range = params.range;
+    }
+
+    // Số byte trên đường truyền
+    static size_t baseSize() { return offsetof(HandshakeExtPacket, range); }
+    size_t size() const { return (features & FEATURE_STREAMS) ? sizeof(HandshakeExtPacket) : baseSize(); }
+
+    // buffer có phải handshake mở rộng đủ len byte không
+    static bool matches(const char* buffer, size_t len) {
+        return len >= baseSize() && isControlPacket(buffer, len) && controlType(buffer) == CTRL_HANDSHAKE &&
+               len == ((const HandshakeExtPacket*)buffer)->size();
+    }
+
+    // Chọn scale nhỏ nhất để window vừa 13 bit (làm tròn xuống bội của 2^scale)
+    void setWindow(uint32_t window) {
+        window = std::min(window, MAX_SCALED_WINDOW);
+        window_scale = 0;
+        while ((window >> window_scale) > MAX_WINDOW_SIZE) {
+            window_scale++;
+        }
+        base.setWindowSize(window >> window_scale);
+    }
+
+    uint32_t window() const {
+        return (uint32_t)base.getWindowSize() << std::min<uint8_t>(window_scale, MAX_WINDOW_SCALE);
+    }
+
+    HandshakeParams params() const {
+        HandshakeParams params{window(), features, chunk_size, file_size};
+        params.range = (features & FEATURE_STREAMS) ? range : StreamRange{0, file_size, 0, 1, 0};
+        params.codec = (features & FEATURE_COMPRESS) ? codec : COMPRESS_NONE;
+        return params;
+    }
+};
+
+// Probe dò path MTU trước handshake (kiểu PLPMTUD, RFC 8899): sender gửi
+// datagram đúng size byte payload với cờ DF (phần sau header là padding),
+// receiver trả lại riêng phần header. Probe tới nơi nghĩa là datagram cỡ đó đi
+// được cả đường, không bị router nào ở giữa bỏ hay phân mảnh.
+struct ProbePacket {
+    uint32_t marker;        // CTRL_MARKER
+    uint8_t type;           // CTRL_PROBE
+    uint8_t reserved[3];
+    uint32_t size;          // Số byte payload UDP của probe
+    uint32_t seq;           // Phân biệt các lần thử
+
+    static bool matches(const char* buffer, size_t len) {
+        return len >= sizeof(ProbePacket) && isControlPacket(buffer, len) && controlType(buffer) == CTRL_PROBE;
+    }
+};
+
+// Repair packet của FEC: block gồm k chunk liền nhau bắt đầu từ pkt_num first,
+// sender gửi m repair ngay sau chunk cuối của block. Payload repair thứ index
+// là tổ hợp tuyến tính trên GF(256) của k chunk (chunk ngắn được coi như có
+// thêm byte 0), dài bằng chunk dài nhất của block. Nhận đủ k trong k + m
+// packet bất kỳ của block là dựng lại được các chunk thiếu (xem fec.h).
+#define FEC_MAX_K 64          // Chunk tối đa mỗi block
+#define FEC_MAX_REPAIR 16     // Repair tối đa mỗi block
+
+struct RepairHeader {
+    uint32_t marker;        // CTRL_MARKER
+    uint8_t type;           // CTRL_REPAIR
+    uint8_t index;          // Hàng của ma trận mã, 0..m-1 (hàng 0 là XOR parity)
+    uint8_t k;              // Số chunk của block (block cuối có thể ít hơn)
+    uint8_t m;              // Số repair của block
+    uint32_t first;         // pkt_num của chunk đầu tiên trong block
+    uint32_t crc;           // CRC32C của payload repair (FEATURE_CRC), 0 nếu không dùng
+};
+
+// Header của data packet với các tính năng đã chọn
+inline size_t dataHeaderSize(uint32_t features) {
+    if (features & FEATURE_COMPRESS) {
+        return sizeof(CompressPacketHeader);
+    }
+    return (features & FEATURE_CRC) ? sizeof(CrcPacketHeader) : HEADER_SIZE;
+}
+
+// Header dài nhất trong các packet mang dữ liệu với các tính năng đã chọn:
+// chunk size phải chừa chỗ để mọi packet vẫn vừa path MTU
+inline size_t packetHeaderSize(uint32_t features) {
+    size_t size = dataHeaderSize(features);
+    if (features & FEATURE_FEC) {
+        size = std::max(size, sizeof(RepairHeader));
+    }
+    return size;
+}
+
+// Receiver báo chunk pkt_num tới nơi nhưng sai CRC: sender gửi lại ngay
+// chunk đó, không chờ SACK/RTO
+struct NackPacket {
+    uint32_t marker;        // CTRL_MARKER
+    uint8_t type;           // CTRL_NACK
+    uint8_t reserved[3];
+    uint32_t pkt_num;
+};
+
+// Kết thúc truyền (FEATURE_CRC): khi mọi chunk đã được ACK, sender gửi XXH64
+// của cả đoạn dữ liệu; receiver so với digest tự tính trên dữ liệu đã nhận
+// và trả lại status cùng digest của mình. Receiver kết thúc ngay sau đó thay
+// vì chờ hết thời gian không có packet.
+#define DIGEST_REQUEST 0
+#define DIGEST_MATCH 1
+#define DIGEST_MISMATCH 2
+#define DIGEST_INCOMPLETE 3   // Receiver chưa có đủ dữ liệu
+
+struct DigestPacket {
+    uint32_t marker;        // CTRL_MARKER
+    uint8_t type;           // CTRL_DIGEST
+    uint8_t status;         // DIGEST_*
+    uint8_t reserved[2];
+    uint64_t size;          // Số byte đã băm
+    uint64_t digest;        // XXH64
+
+    static bool matches(const char* buffer, size_t len) {
+        return len >= sizeof(DigestPacket) && isControlPacket(buffer, len) && controlType(buffer) == CTRL_DIGEST;
+    }
+};
+
+// Truyền tiếp (FEATURE_RESUME): ngay sau handshake sender xin bitmap các chunk
+// receiver đã có (bit pkt_num, như ChunkBitmap của receiver) theo từng trang
+// RESUME_PAGE_WORDS word. Yêu cầu chỉ có phần header (pages = 0), trả lời có
+// đủ bitmap của trang và tổng số trang.
+#define RESUME_PAGE_WORDS 112   // 7168 chunk mỗi trang, packet 912 byte vừa mọi MTU
+#define RESUME_PIPELINE 32      // Số trang sender xin cùng lúc
+
+struct ResumePacket {
+    uint32_t marker;        // CTRL_MARKER
+    uint8_t type;           // CTRL_RESUME
+    uint8_t reserved[3];
+    uint32_t page;
+    uint32_t pages;         // Tổng số trang (0 trong yêu cầu)
+    uint64_t bits[RESUME_PAGE_WORDS];
+
+    static size_t headerSize() { return offsetof(ResumePacket, bits); }
+
+    static bool matches(const char* buffer, size_t len) {
+        return len >= headerSize() && isControlPacket(buffer, len) && controlType(buffer) == CTRL_RESUME;
+    }
+};
+
+// Cumulative ACK + SACK bitmap.
+// cum_ack = expected_seq_num của receiver: mọi packet < cum_ack đã nhận.
+// Bit i của sack cho biết packet sack_base + i đã nhận. Bình thường
+// sack_base = cum_ack + 1; packet nằm xa hơn SACK_BITS được báo bằng SACK
+// riêng với sack_base khác.
+#define SACK_BITS 256
+
+struct SackPacket {
+    uint32_t marker;        // CTRL_MARKER
+    uint8_t type;           // CTRL_SACK
+    uint8_t reserved[3];
+    uint32_t cum_ack;
+    uint32_t sack_base;
+    uint64_t sack[SACK_BITS / 64];
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+// Nhóm luồng cố định chạy các việc độc lập (nén/giải nén từng block) theo thứ
+// tự được gửi vào. Dùng chung cho mọi stream; hủy pool thì làm nốt các việc
+// còn trong hàng đợi rồi mới dừng luồng.
+class WorkerPool {
+public:
+    explicit WorkerPool(unsigned threads) : stop_(false) {
+        threads = std::max(1u, threads);
+        for (unsigned i = 0; i < threads; i++) {
+            workers_.emplace_back(&WorkerPool::run, this);
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        cv_.notify_one();
+    }
+
+    size_t size() const { return workers_.size(); }
+
+private:
+    void run() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+                if (jobs_.empty()) {
+                    return;  // stop_ và đã hết việc
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::deque<std::function<void()>> jobs_;
+    bool stop_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::thread> workers_;
+};
+
+#endif
@@ -0,0 +1,598 @@
+#ifndef XDP_PROGRAM_H
+#define XDP_PROGRAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_ether.h>
+
+#define XSKMAP_MAX_ENTRIES 64        // Số RX queue tối đa (AF_XDP socket và bộ đếm)
+#define BPF_LOG_SIZE (64 * 1024)     // Log của verifier khi nạp chương trình lỗi
+#define XDP_ACK_HEADER_SIZE 4        // PacketHeader (pkt_num), cũng chính là nội dung AckPacket
+#define XDP_ACK_MAX_PAYLOAD 1472     // Payload lớn nhất chuyển qua ring (MTU 1500 - IP - UDP)
+#define XDP_ACK_RING_SIZE (8 * 1024 * 1024)  // Ring buffer payload khi XDP tự trả ACK (~5600 packet)
+
+// Gọi thẳng syscall bpf() (không cần libbpf)
+inline long bpfSyscall(int cmd, union bpf_attr* attr) {
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+inline struct bpf_insn bpfInsn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+    struct bpf_insn insn;
+    memset(&insn, 0, sizeof(insn));
+    insn.code = code;
+    insn.dst_reg = dst;
+    insn.src_reg = src;
+    insn.off = off;
+    insn.imm = imm;
+    return insn;
+}
+
+// Bộ dựng chương trình eBPF đơn giản: nhảy tới nhãn theo tên, offset được
+// điền khi gọi finish()
+class BpfAssembler {
+public:
+    void emit(const struct bpf_insn& insn) { insns_.push_back(insn); }
+
+    // Lệnh nhảy có điều kiện (code gồm BPF_JMP | BPF_Jxx | BPF_K/BPF_X) hoặc BPF_JA
+    void jump(uint8_t code, uint8_t dst, uint8_t src, int32_t imm, const std::string& label) {
+        fixups_.push_back(std::make_pair(insns_.size(), label));
+        insns_.push_back(bpfInsn(code, dst, src, 0, imm));
+    }
+
+    void label(const std::string& name) { labels_.push_back(std::make_pair(name, insns_.size())); }
+
+    std::vector<struct bpf_insn> finish() {
+        for (const auto& fixup : fixups_) {
+            for (const auto& label : labels_) {
+                if (label.first == fixup.second) {
+                    insns_[fixup.first].off = (int16_t)(label.second - fixup.first - 1);
+                }
+            }
+        }
+        return insns_;
+    }
+
+private:
+    std::vector<struct bpf_insn> insns_;
+    std::vector<std::pair<size_t, std::string>> fixups_;
+    std::vector<std::pair<std::string, size_t>> labels_;
+};
+
+// Bộ đếm của một RX queue trong map per-CPU của chương trình XDP
+struct XdpQueueCounters {
+    uint64_t packets;   // Frame của phiên truyền đã chuyển vào AF_XDP socket
+    uint64_t bytes;     // Số byte của các frame đó (tính cả Ethernet header)
+    uint64_t dropped;   // Frame tới đúng port nhưng sai định dạng, bỏ ngay trong XDP
+    uint64_t passed;    // Frame khác (ARP, SSH, ...) đi tiếp lên network stack
+    uint64_t acked;     // Data packet được XDP trả ACK bằng XDP_TX (payload qua ring buffer)
+    uint64_t ring_full; // Data packet bỏ vì ring buffer payload đầy (không ACK, sender gửi lại)
+};
+
+// Bản ghi chương trình XDP đưa vào ring buffer khi tự trả ACK: địa chỉ nguồn
+// và UDP payload của data packet
+struct XdpAckRecord {
+    uint32_t saddr;   // Network byte order
+    uint16_t sport;   // Network byte order
+    uint16_t len;     // Độ dài payload
+    char payload[XDP_ACK_MAX_PAYLOAD];
+};
+
+// Đọc BPF_MAP_TYPE_RINGBUF từ user space: trang consumer_pos (ghi được), trang
+// producer_pos và vùng dữ liệu được map hai lần liền nhau nên bản ghi vắt qua
+// cuối ring vẫn đọc liền mạch. Bản ghi lấy bằng next() hợp lệ tới release().
+class BpfRingBuffer {
+public:
+    BpfRingBuffer() : fd_(-1), size_(0), page_(0), consumer_(nullptr), producer_(nullptr), read_pos_(0) {}
+
+    ~BpfRingBuffer() {
+        if (consumer_ != nullptr) {
+            munmap(consumer_, page_);
+        }
+        if (producer_ != nullptr) {
+            munmap(producer_, page_ + 2 * size_);
+        }
+    }
+
+    BpfRingBuffer(const BpfRingBuffer&) = delete;
+    BpfRingBuffer& operator=(const BpfRingBuffer&) = delete;
+
+    bool map(int fd, size_t size) {
+        fd_ = fd;
+        size_ = size;
+        page_ = sysconf(_SC_PAGESIZE);
+        void* consumer = mmap(nullptr, page_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (consumer == MAP_FAILED) {
+            return false;
+        }
+        consumer_ = (char*)consumer;
+        void* producer = mmap(nullptr, page_ + 2 * size_, PROT_READ, MAP_SHARED, fd, page_);
+        if (producer == MAP_FAILED) {
+            return false;
+        }
+        producer_ = (char*)producer;
+        read_pos_ = consumerPos()->load(std::memory_order_acquire);
+        return true;
+    }
+
+    int fd() const { return fd_; }
+
+    // Bản ghi đã submit kế tiếp (bỏ qua bản ghi bị discard), nullptr nếu chưa có
+    const void* next() {
+        uint64_t producer = producerPos()->load(std::memory_order_acquire);
+        while (read_pos_ < producer) {
+            const std::atomic<uint32_t>* header = (const std::atomic<uint32_t>*)(producer_ + page_ + (read_pos_ & (size_ - 1)));
+            uint32_t len = header->load(std::memory_order_acquire);
+            if (len & BPF_RINGBUF_BUSY_BIT) {
+                return nullptr;  // Chương trình XDP chưa submit xong
+            }
+            const char* data = (const char*)header + BPF_RINGBUF_HDR_SZ;
+            read_pos_ += (BPF_RINGBUF_HDR_SZ + (len & ~BPF_RINGBUF_DISCARD_BIT) + 7) & ~7ULL;
+            if (!(len & BPF_RINGBUF_DISCARD_BIT)) {
+                return data;
+            }
+        }
+        return nullptr;
+    }
+
+    // Trả chỗ của mọi bản ghi đã lấy cho kernel
+    void release() { consumerPos()->store(read_pos_, std::memory_order_release); }
+
+private:
+    std::atomic<uint64_t>* consumerPos() const { return (std::atomic<uint64_t>*)consumer_; }
+    const std::atomic<uint64_t>* producerPos() const { return (const std::atomic<uint64_t>*)producer_; }
+
+    int fd_;
+    size_t size_;
+    size_t page_;
+    char* consumer_;
+    char* producer_;
+    uint64_t read_pos_;
+};
+
+// Số CPU "possible" (kích thước giá trị của map per-CPU), đọc từ dạng "0-N"
+inline int possibleCpus() {
+    FILE* file = fopen("/sys/devices/system/cpu/possible", "r");
+    int cpus = 1;
+    if (file != nullptr) {
+        int first, last;
+        while (fscanf(file, "%d", &first) == 1) {
+            last = first;
+            if (fscanf(file, "-%d", &last) != 1) {
+                last = first;
+            }
+            cpus = std::max(cpus, last + 1);
+            if (fgetc(file) != ',') {
+                break;
+            }
+        }
+        fclose(file);
+    }
+    return cpus;
+}
+
+// Chương trình XDP dựng tay bằng lệnh eBPF, phân loại ngay ở driver:
+//  - frame IPv4/UDP (IHL = 5) tới đúng port của phiên truyền và có header
+//    hợp lệ được chuyển vào AF_XDP socket của RX queue qua XSKMAP
+//  - tới đúng port nhưng sai định dạng (fragment, độ dài IP/UDP không khớp
+//    frame, payload ngắn hơn gói nhỏ nhất của giao thức) bị bỏ (XDP_DROP)
+//  - mọi thứ khác (ARP, SSH, ...) đi tiếp lên network stack; queue chưa có
+//    socket thì bpf_redirect_map cũng trả về XDP_PASS
+// Chế độ tự trả ACK (reflect_acks): data packet (payload > PacketHeader, không
+// phải gói điều khiển) được chép vào ring buffer cho user space, rồi chính
+// frame đó được sửa thành AckPacket (đảo MAC/IP/port, cắt payload còn pkt_num)
+// và gửi ngược ra interface bằng XDP_TX, không qua user space.
+// Mỗi RX queue có bộ đếm packet/byte/drop/pass trong map per-CPU.
+// Chương trình gắn vào interface bằng BPF link, tự gỡ khi tiến trình thoát.
+class XdpProgram {
+public:
+    XdpProgram() : map_fd_(-1), counters_fd_(-1), ack_ring_fd_(-1), prog_fd_(-1), link_fd_(-1), drv_mode_(false) {}
+
+    ~XdpProgram() {
+        // Đóng link trước: gỡ chương trình khỏi interface
+        if (link_fd_ >= 0) {
+            close(link_fd_);
+        }
+        if (prog_fd_ >= 0) {
+            close(prog_fd_);
+        }
+        if (counters_fd_ >= 0) {
+            close(counters_fd_);
+        }
+        if (ack_ring_fd_ >= 0) {
+            close(ack_ring_fd_);
+        }
+        if (map_fd_ >= 0) {
+            close(map_fd_);
+        }
+    }
+
+    XdpProgram(const XdpProgram&) = delete;
+    XdpProgram& operator=(const XdpProgram&) = delete;
+
+    // Tạo XSKMAP, map bộ đếm và nạp chương trình lọc theo UDP port (host byte
+    // order); min_payload: UDP payload ngắn hơn thì coi là sai định dạng;
+    // reflect_acks: XDP tự trả ACK từng packet, payload đi qua ackRing()
+    bool load(uint16_t port, uint16_t min_payload, bool reflect_acks, std::string& error) {
+        map_fd_ = createMap(BPF_MAP_TYPE_XSKMAP, sizeof(uint32_t), sizeof(uint32_t));
+        if (map_fd_ < 0) {
+            error = std::string("không tạo được XSKMAP: ") + strerror(errno);
+            return false;
+        }
+        counters_fd_ = createMap(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(uint32_t), sizeof(XdpQueueCounters));
+        if (counters_fd_ < 0) {
+            error = std::string("không tạo được map bộ đếm: ") + strerror(errno);
+            return false;
+        }
+
+        if (reflect_acks) {
+            union bpf_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.map_type = BPF_MAP_TYPE_RINGBUF;
+            attr.max_entries = XDP_ACK_RING_SIZE;
+            ack_ring_fd_ = bpfSyscall(BPF_MAP_CREATE, &attr);
+            if (ack_ring_fd_ < 0 || !ack_ring_.map(ack_ring_fd_, XDP_ACK_RING_SIZE)) {
+                error = std::string("không tạo được ring buffer cho XDP ACK: ") + strerror(errno);
+                return false;
+            }
+        }
+
+        std::vector<struct bpf_insn> insns = buildProgram(port, min_payload);
+        std::vector<char> log(BPF_LOG_SIZE, 0);
+        const char* license = "GPL";
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.prog_type = BPF_PROG_TYPE_XDP;
+        attr.insns = (uint64_t)(uintptr_t)insns.data();
+        attr.insn_cnt = insns.size();
+        attr.license = (uint64_t)(uintptr_t)license;
+        attr.log_buf = (uint64_t)(uintptr_t)log.data();
+        attr.log_size = log.size();
+        attr.log_level = 1;
+        prog_fd_ = bpfSyscall(BPF_PROG_LOAD, &attr);
+        if (prog_fd_ < 0) {
+            error = std::string("verifier từ chối chương trình XDP: ") + strerror(errno) + "\n" + log.data();
+            return false;
+        }
+        return true;
+    }
+
+    // Gắn vào interface: driver mode (native XDP) nếu được, không thì generic (SKB) mode
+    bool attach(int ifindex, bool allow_skb_mode, std::string& error) {
+        uint32_t modes[] = {XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE};
+        for (uint32_t mode : modes) {
+            if (mode == XDP_FLAGS_SKB_MODE && !allow_skb_mode) {
+                break;
+            }
+            union bpf_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.link_create.prog_fd = prog_fd_;
+            attr.link_create.target_ifindex = ifindex;
+            attr.link_create.attach_type = BPF_XDP;
+            attr.link_create.flags = mode;
+            link_fd_ = bpfSyscall(BPF_LINK_CREATE, &attr);
+            if (link_fd_ >= 0) {
+                drv_mode_ = mode == XDP_FLAGS_DRV_MODE;
+                return true;
+            }
+            error = std::string("không gắn được chương trình XDP: ") + strerror(errno);
+            if (errno == EBUSY || errno == EEXIST) {
+                error += " (interface đã có chương trình XDP khác)";
+                return false;
+            }
+        }
+        return false;
+    }
+
+    // Đưa AF_XDP socket vào XSKMAP tại slot của RX queue
+    bool addSocket(uint32_t queue, int xsk_fd, std::string& error) {
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = map_fd_;
+        attr.key = (uint64_t)(uintptr_t)&queue;
+        attr.value = (uint64_t)(uintptr_t)&xsk_fd;
+        attr.flags = BPF_ANY;
+        if (bpfSyscall(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+            error = std::string("không cập nhật được XSKMAP: ") + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    bool driverMode() const { return drv_mode_; }
+    bool reflectsAcks() const { return ack_ring_fd_ >= 0; }
+    BpfRingBuffer& ackRing() { return ack_ring_; }
+
+    // Cộng bộ đếm của queue trên mọi CPU
+    bool counters(uint32_t queue, XdpQueueCounters& total) const {
+        std::vector<XdpQueueCounters> per_cpu(possibleCpus());
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = counters_fd_;
+        attr.key = (uint64_t)(uintptr_t)&queue;
+        attr.value = (uint64_t)(uintptr_t)per_cpu.data();
+        memset(&total, 0, sizeof(total));
+        if (bpfSyscall(BPF_MAP_LOOKUP_ELEM, &attr) < 0) {
+            return false;
+        }
+        for (const XdpQueueCounters& c : per_cpu) {
+            total.packets += c.packets;
+            total.bytes += c.bytes;
+            total.dropped += c.dropped;
+            total.passed += c.passed;
+            total.acked += c.acked;
+            total.ring_full += c.ring_full;
+        }
+        return true;
+    }
+
+private:
+    static int createMap(uint32_t type, uint32_t key_size, uint32_t value_size) {
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.map_type = type;
+        attr.key_size = key_size;
+        attr.value_size = value_size;
+        attr.max_entries = XSKMAP_MAX_ENTRIES;
+        return bpfSyscall(BPF_MAP_CREATE, &attr);
+    }
+
+    // Tương đương C:
+    //   c = bpf_map_lookup_elem(&counters, &ctx->rx_queue_index);
+    //   if (data + 42 > data_end || eth->h_proto != htons(ETH_P_IP) || ip->protocol != IPPROTO_UDP ||
+    //       ip->ihl_version != 0x45 || udp->dest != htons(port)) goto pass;
+    //   if (ip->frag_off & htons(IP_MF | IP_OFFMASK)) goto drop;
+    //   if (ip_len < 28 + min_payload || data + 14 + ip_len > data_end) goto drop;
+    //   if (udp_len < 8 + min_payload || udp_len > ip_len - 20) goto drop;
+    //   if (reflect_acks && <data packet>) { ... return XDP_TX; }  (xem buildAckReflector)
+    //   if (bpf_redirect_map(&xsks_map, ctx->rx_queue_index, XDP_PASS) != XDP_REDIRECT) goto pass;
+    //   c->packets++; c->bytes += 14 + ip_len; return XDP_REDIRECT;
+    // drop: c->dropped++; return XDP_DROP;
+    // pass: c->passed++; return XDP_PASS;
+    std::vector<struct bpf_insn> buildProgram(uint16_t port, uint16_t min_payload) const {
+        const int16_t eth_len = sizeof(struct ethhdr);
+        const int16_t ip_len = 20;
+        const int16_t udp_len = 8;
+        BpfAssembler a;
+
+        // r6 = ctx; r9 = bộ đếm của queue (có thể NULL); r7 = data; r8 = data_end
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0));
+        a.emit(bpfInsn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_1, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0));
+        a.emit(bpfInsn(BPF_STX | BPF_W | BPF_MEM, BPF_REG_10, BPF_REG_1, -4, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -4));
+        a.emit(bpfInsn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, counters_fd_));
+        a.emit(bpfInsn(0, 0, 0, 0, 0));  // Nửa sau của lệnh ld_imm64
+        a.emit(bpfInsn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_9, BPF_REG_0, 0, 0));
+        a.emit(bpfInsn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_7, BPF_REG_6, offsetof(struct xdp_md, data), 0));
+        a.emit(bpfInsn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_8, BPF_REG_6, offsetof(struct xdp_md, data_end), 0));
+
+        // Đủ dài cho Ethernet + IPv4 + UDP header
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_7, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, eth_len + ip_len + udp_len));
+        a.jump(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_8, 0, "pass");
+
+        // Có phải gói của phiên truyền (load 16 bit theo thứ tự byte của máy, như *(u16 *)p == htons(x))
+        struct Match { uint8_t size; int16_t offset; int32_t value; };
+        const Match matches[] = {
+            {BPF_H, offsetof(struct ethhdr, h_proto), htons(ETH_P_IP)},
+            {BPF_B, eth_len + 9, IPPROTO_UDP},                   // protocol
+            {BPF_B, eth_len, 0x45},                              // version 4, IHL 5
+            {BPF_H, eth_len + ip_len + 2, htons(port)},          // UDP dest port
+        };
+        for (const Match& m : matches) {
+            a.emit(bpfInsn(BPF_LDX | m.size | BPF_MEM, BPF_REG_5, BPF_REG_7, m.offset, 0));
+            a.jump(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, m.value, "pass");
+        }
+
+        // Fragment: chỉ fragment đầu có UDP header, không ráp lại được ở đây
+        a.emit(bpfInsn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_7, eth_len + 6, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(0x3FFF)));
+        a.jump(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, "drop");
+
+        // r5 = IP total length: đủ chứa gói nhỏ nhất và không vượt quá frame
+        a.emit(bpfInsn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_7, eth_len + 2, 0));
+        a.emit(bpfInsn(BPF_ALU | BPF_END | BPF_TO_BE, BPF_REG_5, 0, 0, 16));
+        a.jump(BPF_JMP | BPF_JLT | BPF_K, BPF_REG_5, 0, ip_len + udp_len + min_payload, "drop");
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_7, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_X, BPF_REG_4, BPF_REG_5, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, eth_len));
+        a.jump(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_8, 0, "drop");
+
+        // r3 = UDP length: đủ chứa gói nhỏ nhất và nằm gọn trong gói IP
+        a.emit(bpfInsn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_3, BPF_REG_7, eth_len + ip_len + 4, 0));
+        a.emit(bpfInsn(BPF_ALU | BPF_END | BPF_TO_BE, BPF_REG_3, 0, 0, 16));
+        a.jump(BPF_JMP | BPF_JLT | BPF_K, BPF_REG_3, 0, udp_len + min_payload, "drop");
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_5, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -ip_len));
+        a.jump(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_3, BPF_REG_2, 0, "drop");
+
+        if (ack_ring_fd_ >= 0) {
+            buildAckReflector(a);
+        }
+
+        // r7 = số byte của frame; return bpf_redirect_map(map, ctx->rx_queue_index, XDP_PASS)
+        a.label("redirect");
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_7, BPF_REG_5, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_7, 0, 0, eth_len));
+        a.emit(bpfInsn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0));
+        a.emit(bpfInsn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd_));
+        a.emit(bpfInsn(0, 0, 0, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS));
+        a.emit(bpfInsn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map));
+        a.jump(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_0, 0, XDP_REDIRECT, "pass");
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_9, 0, 0, "exit");
+        addCounter(a, offsetof(XdpQueueCounters, packets), -1);
+        addCounter(a, offsetof(XdpQueueCounters, bytes), BPF_REG_7);
+        a.label("exit");
+        a.emit(bpfInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+        a.label("drop");
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_9, 0, 0, "drop_exit");
+        addCounter(a, offsetof(XdpQueueCounters, dropped), -1);
+        a.label("drop_exit");
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_DROP));
+        a.emit(bpfInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+        a.label("pass");
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_9, 0, 0, "pass_exit");
+        addCounter(a, offsetof(XdpQueueCounters, passed), -1);
+        a.label("pass_exit");
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS));
+        a.emit(bpfInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+        return a.finish();
+    }
+
+    // Vào với r5 = IP total length, r3 = UDP length (đã kiểm tra). Tương đương C:
+    //   len = udp_len - 8;
+    //   if (len <= XDP_ACK_HEADER_SIZE || len > XDP_ACK_MAX_PAYLOAD || *(u32 *)payload == CTRL_MARKER) goto redirect;
+    //   rec = bpf_ringbuf_reserve(&ack_ring, sizeof(*rec), 0);
+    //   if (!rec) goto ring_full;
+    //   rec->saddr = ip->saddr; rec->sport = udp->source; rec->len = len;
+    //   if (bpf_xdp_load_bytes(ctx, 42, rec->payload, len)) { bpf_ringbuf_discard(rec, 0); goto drop; }
+    //   bpf_ringbuf_submit(rec, 0);
+    //   swap(eth->h_source, eth->h_dest); swap(ip->saddr, ip->daddr); swap(udp->source, udp->dest);
+    //   ip->check = ~(~ip->check + ~ip->tot_len + htons(32)); ip->tot_len = htons(32);  (RFC 1624)
+    //   udp->len = htons(12); udp->check = 0;   // 4 byte đầu payload (pkt_num) chính là ack_num
+    //   c->packets++; c->bytes += 14 + ip_len; c->acked++;
+    //   if (bpf_xdp_adjust_tail(ctx, 32 - ip_len)) goto drop;
+    //   return XDP_TX;
+    // Stack: r10-16 = ip_len, r10-24 = len, r10-32 = rec
+    void buildAckReflector(BpfAssembler& a) const {
+        const int16_t eth_len = sizeof(struct ethhdr);
+        const int16_t ip_offset = eth_len;
+        const int16_t udp_offset = eth_len + 20;
+        const int16_t payload_offset = udp_offset + 8;
+        const int32_t ack_ip_len = 20 + 8 + XDP_ACK_HEADER_SIZE;
+
+        a.emit(bpfInsn(BPF_STX | BPF_DW | BPF_MEM, BPF_REG_10, BPF_REG_5, -16, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_3, 0, 0, -8));
+        a.jump(BPF_JMP | BPF_JLE | BPF_K, BPF_REG_3, 0, XDP_ACK_HEADER_SIZE, "redirect");
+        a.jump(BPF_JMP | BPF_JGT | BPF_K, BPF_REG_3, 0, XDP_ACK_MAX_PAYLOAD, "redirect");
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_7, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, payload_offset + XDP_ACK_HEADER_SIZE));
+        a.jump(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_8, 0, "redirect");
+        a.emit(bpfInsn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_4, BPF_REG_7, payload_offset, 0));
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_4, 0, 0, "redirect");  // Gói điều khiển (CTRL_MARKER)
+        a.emit(bpfInsn(BPF_STX | BPF_DW | BPF_MEM, BPF_REG_10, BPF_REG_3, -24, 0));
+
+        // Chép payload vào ring buffer cho user space
+        a.emit(bpfInsn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, ack_ring_fd_));
+        a.emit(bpfInsn(0, 0, 0, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_2, 0, 0, sizeof(XdpAckRecord)));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, 0));
+        a.emit(bpfInsn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_ringbuf_reserve));
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 0, "ring_full");
+        a.emit(bpfInsn(BPF_STX | BPF_DW | BPF_MEM, BPF_REG_10, BPF_REG_0, -32, 0));
+        a.emit(bpfInsn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_1, BPF_REG_7, ip_offset + 12, 0));
+        a.emit(bpfInsn(BPF_STX | BPF_W | BPF_MEM, BPF_REG_0, BPF_REG_1, offsetof(XdpAckRecord, saddr), 0));
+        a.emit(bpfInsn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_1, BPF_REG_7, udp_offset, 0));
+        a.emit(bpfInsn(BPF_STX | BPF_H | BPF_MEM, BPF_REG_0, BPF_REG_1, offsetof(XdpAckRecord, sport), 0));
+        a.emit(bpfInsn(BPF_LDX | BPF_DW | BPF_MEM, BPF_REG_4, BPF_REG_10, -24, 0));
+        a.emit(bpfInsn(BPF_STX | BPF_H | BPF_MEM, BPF_REG_0, BPF_REG_4, offsetof(XdpAckRecord, len), 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_3, BPF_REG_0, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_3, 0, 0, offsetof(XdpAckRecord, payload)));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_6, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_2, 0, 0, payload_offset));
+        a.emit(bpfInsn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_xdp_load_bytes));
+        a.emit(bpfInsn(BPF_LDX | BPF_DW | BPF_MEM, BPF_REG_1, BPF_REG_10, -32, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_2, 0, 0, 0));
+        a.jump(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_0, 0, 0, "discard");
+        a.emit(bpfInsn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_ringbuf_submit));
+
+        // Sửa frame thành ACK: đảo MAC, IP, port
+        const int16_t swaps[][3] = {
+            {BPF_W, 0, ETH_ALEN}, {BPF_H, 4, ETH_ALEN + 4},
+            {BPF_W, ip_offset + 12, ip_offset + 16}, {BPF_H, udp_offset, udp_offset + 2},
+        };
+        for (const auto& swap : swaps) {
+            a.emit(bpfInsn(BPF_LDX | swap[0] | BPF_MEM, BPF_REG_1, BPF_REG_7, swap[1], 0));
+            a.emit(bpfInsn(BPF_LDX | swap[0] | BPF_MEM, BPF_REG_2, BPF_REG_7, swap[2], 0));
+            a.emit(bpfInsn(BPF_STX | swap[0] | BPF_MEM, BPF_REG_7, BPF_REG_2, swap[1], 0));
+            a.emit(bpfInsn(BPF_STX | swap[0] | BPF_MEM, BPF_REG_7, BPF_REG_1, swap[2], 0));
+        }
+
+        // IP checksum cập nhật theo tot_len mới (đảo địa chỉ không đổi tổng)
+        a.emit(bpfInsn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_1, BPF_REG_7, ip_offset + 10, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_XOR | BPF_K, BPF_REG_1, 0, 0, 0xFFFF));
+        a.emit(bpfInsn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_2, BPF_REG_7, ip_offset + 2, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_XOR | BPF_K, BPF_REG_2, 0, 0, 0xFFFF));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_X, BPF_REG_1, BPF_REG_2, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_1, 0, 0, htons(ack_ip_len)));
+        for (int fold = 0; fold < 2; fold++) {
+            a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_1, 0, 0));
+            a.emit(bpfInsn(BPF_ALU64 | BPF_RSH | BPF_K, BPF_REG_2, 0, 0, 16));
+            a.emit(bpfInsn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_1, 0, 0, 0xFFFF));
+            a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_X, BPF_REG_1, BPF_REG_2, 0, 0));
+        }
+        a.emit(bpfInsn(BPF_ALU64 | BPF_XOR | BPF_K, BPF_REG_1, 0, 0, 0xFFFF));
+        a.emit(bpfInsn(BPF_STX | BPF_H | BPF_MEM, BPF_REG_7, BPF_REG_1, ip_offset + 10, 0));
+        a.emit(bpfInsn(BPF_ST | BPF_H | BPF_MEM, BPF_REG_7, 0, ip_offset + 2, htons(ack_ip_len)));
+        a.emit(bpfInsn(BPF_ST | BPF_H | BPF_MEM, BPF_REG_7, 0, udp_offset + 4, htons(ack_ip_len - 20)));
+        a.emit(bpfInsn(BPF_ST | BPF_H | BPF_MEM, BPF_REG_7, 0, udp_offset + 6, 0));
+
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_9, 0, 0, "reflect");
+        a.emit(bpfInsn(BPF_LDX | BPF_DW | BPF_MEM, BPF_REG_2, BPF_REG_10, -16, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, eth_len));
+        addCounter(a, offsetof(XdpQueueCounters, packets), -1);
+        addCounter(a, offsetof(XdpQueueCounters, bytes), BPF_REG_2);
+        addCounter(a, offsetof(XdpQueueCounters, acked), -1);
+
+        // Cắt frame còn header + pkt_num rồi gửi ngược ra interface
+        a.label("reflect");
+        a.emit(bpfInsn(BPF_LDX | BPF_DW | BPF_MEM, BPF_REG_2, BPF_REG_10, -16, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_NEG, BPF_REG_2, 0, 0, 0));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, ack_ip_len));
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_6, 0, 0));
+        a.emit(bpfInsn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_xdp_adjust_tail));
+        a.jump(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_0, 0, 0, "drop");
+        a.emit(bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_TX));
+        a.emit(bpfInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+        a.label("discard");
+        a.emit(bpfInsn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_ringbuf_discard));
+        a.jump(BPF_JMP | BPF_JA, 0, 0, 0, "drop");
+
+        a.label("ring_full");
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_9, 0, 0, "drop_exit");
+        addCounter(a, offsetof(XdpQueueCounters, ring_full), -1);
+        a.jump(BPF_JMP | BPF_JA, 0, 0, 0, "drop_exit");
+    }
+
+    // *(u64 *)(r9 + offset) += (reg < 0 ? 1 : reg). Map per-CPU nên không cần lệnh atomic
+    static void addCounter(BpfAssembler& a, int16_t offset, int reg) {
+        a.emit(bpfInsn(BPF_LDX | BPF_DW | BPF_MEM, BPF_REG_1, BPF_REG_9, offset, 0));
+        if (reg < 0) {
+            a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_1, 0, 0, 1));
+        } else {
+            a.emit(bpfInsn(BPF_ALU64 | BPF_ADD | BPF_X, BPF_REG_1, (uint8_t)reg, 0, 0));
+        }
+        a.emit(bpfInsn(BPF_STX | BPF_DW | BPF_MEM, BPF_REG_9, BPF_REG_1, offset, 0));
+    }
+
+    int map_fd_;
+    int counters_fd_;
+    int ack_ring_fd_;
+    BpfRingBuffer ack_ring_;
+    int prog_fd_;
+    int link_fd_;
+    bool drv_mode_;
+};
+
+#endif
@@ -0,0 +1,308 @@
+#ifndef XSK_SOCKET_H
+#define XSK_SOCKET_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <linux/if_xdp.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define XSK_FRAME_SIZE 4096     // Mỗi frame của UMEM chứa một packet
+#define XSK_RX_FRAMES 2048      // Nửa đầu UMEM: frame cho RX (nằm trong fill ring)
+#define XSK_TX_FRAMES 2048      // Nửa sau: frame cho TX
+#define XSK_RING_SIZE 2048      // Số entry của RX/TX/fill/completion ring (lũy thừa của 2)
+
+// Một ring dùng chung với kernel (mmap từ AF_XDP socket). Entry là
+// xdp_desc (RX/TX) hoặc địa chỉ frame u64 (fill/completion).
+struct XskRing {
+    uint32_t* producer = nullptr;
+    uint32_t* consumer = nullptr;
+    uint32_t* flags = nullptr;
+    void* entries = nullptr;
+    uint32_t mask = 0;
+    void* map = nullptr;
+    size_t map_len = 0;
+
+    bool mapRing(int fd, const struct xdp_ring_offset& off, uint32_t size, size_t entry_size, off_t pgoff) {
+        map_len = off.desc + size * entry_size;
+        map = mmap(nullptr, map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+        if (map == MAP_FAILED) {
+            map = nullptr;
+            return false;
+        }
+        producer = (uint32_t*)((char*)map + off.producer);
+        consumer = (uint32_t*)((char*)map + off.consumer);
+        flags = (uint32_t*)((char*)map + off.flags);
+        entries = (char*)map + off.desc;
+        mask = size - 1;
+        return true;
+    }
+
+    void unmap() {
+        if (map != nullptr) {
+            munmap(map, map_len);
+            map = nullptr;
+        }
+    }
+
+    // Bên kia ghi entry rồi mới tăng chỉ số: đọc chỉ số bằng acquire, ghi bằng release
+    uint32_t loadProducer() const { return __atomic_load_n(producer, __ATOMIC_ACQUIRE); }
+    uint32_t loadConsumer() const { return __atomic_load_n(consumer, __ATOMIC_ACQUIRE); }
+    void storeProducer(uint32_t value) { __atomic_store_n(producer, value, __ATOMIC_RELEASE); }
+    void storeConsumer(uint32_t value) { __atomic_store_n(consumer, value, __ATOMIC_RELEASE); }
+    bool needWakeup() const { return __atomic_load_n(flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP; }
+
+    uint64_t& addr(uint32_t index) { return ((uint64_t*)entries)[index & mask]; }
+    struct xdp_desc& desc(uint32_t index) { return ((struct xdp_desc*)entries)[index & mask]; }
+};
+
+// AF_XDP socket gắn vào một RX/TX queue của interface. UMEM là vùng nhớ
+// chia thành frame XSK_FRAME_SIZE byte dùng chung với kernel (copy mode)
+// hoặc NIC (zero-copy mode): packet nhận được nằm sẵn trong frame, packet
+// gửi đi được ghi thẳng vào frame rồi đưa descriptor vào TX ring.
+class XskSocket {
+public:
+    XskSocket()
+        : fd_(-1), umem_(nullptr), zero_copy_(false),
+          fill_prod_(0), rx_cons_(0), rx_peeked_(0), tx_prod_(0), tx_pending_(0), comp_cons_(0), kicks_(0) {}
+
+    ~XskSocket() {
+        rx_.unmap();
+        tx_.unmap();
+        fill_.unmap();
+        comp_.unmap();
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+        if (umem_ != nullptr) {
+            munmap(umem_, umemSize());
+        }
+    }
+
+    XskSocket(const XskSocket&) = delete;
+    XskSocket& operator=(const XskSocket&) = delete;
+
+    bool open(int ifindex, uint32_t queue, bool zero_copy, std::string& error) {
+        fd_ = socket(AF_XDP, SOCK_RAW, 0);
+        if (fd_ < 0) {
+            error = std::string("không tạo được AF_XDP socket: ") + strerror(errno);
+            return false;
+        }
+
+        void* umem = mmap(nullptr, umemSize(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (umem == MAP_FAILED) {
+            error = std::string("không cấp phát được UMEM: ") + strerror(errno);
+            return false;
+        }
+        umem_ = (char*)umem;
+
+        struct xdp_umem_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.addr = (uint64_t)(uintptr_t)umem_;
+        reg.len = umemSize();
+        reg.chunk_size = XSK_FRAME_SIZE;
+        reg.headroom = 0;
+        if (setsockopt(fd_, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+            error = std::string("XDP_UMEM_REG: ") + strerror(errno);
+            return false;
+        }
+
+        int ring_size = XSK_RING_SIZE;
+        if (setsockopt(fd_, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) < 0 ||
+            setsockopt(fd_, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) < 0 ||
+            setsockopt(fd_, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+            setsockopt(fd_, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) < 0) {
+            error = std::string("không tạo được ring: ") + strerror(errno);
+            return false;
+        }
+
+        struct xdp_mmap_offsets off;
+        socklen_t optlen = sizeof(off);
+        if (getsockopt(fd_, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0 ||
+            !rx_.mapRing(fd_, off.rx, XSK_RING_SIZE, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) ||
+            !tx_.mapRing(fd_, off.tx, XSK_RING_SIZE, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) ||
+            !fill_.mapRing(fd_, off.fr, XSK_RING_SIZE, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) ||
+            !comp_.mapRing(fd_, off.cr, XSK_RING_SIZE, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING)) {
+            error = std::string("không mmap được ring: ") + strerror(errno);
+            return false;
+        }
+
+        // Toàn bộ frame RX nằm sẵn trong fill ring; frame TX vào danh sách trống
+        for (uint32_t i = 0; i < XSK_RX_FRAMES; i++) {
+            fill_.addr(fill_prod_++) = (uint64_t)i * XSK_FRAME_SIZE;
+        }
+        fill_.storeProducer(fill_prod_);
+        for (uint32_t i = 0; i < XSK_TX_FRAMES; i++) {
+            tx_free_.push_back((uint64_t)(XSK_RX_FRAMES + i) * XSK_FRAME_SIZE);
+        }
+
+        struct sockaddr_xdp sxdp;
+        memset(&sxdp, 0, sizeof(sxdp));
+        sxdp.sxdp_family = AF_XDP;
+        sxdp.sxdp_ifindex = ifindex;
+        sxdp.sxdp_queue_id = queue;
+        sxdp.sxdp_flags = (zero_copy ? XDP_ZEROCOPY : XDP_COPY) | XDP_USE_NEED_WAKEUP;
+        if (bind(fd_, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0) {
+            error = std::string("không bind được AF_XDP socket vào queue ") + std::to_string(queue) +
+                    (zero_copy ? " (zero-copy)" : " (copy)") + ": " + strerror(errno);
+            return false;
+        }
+        zero_copy_ = zero_copy;
+        return true;
+    }
+
+    int fd() const { return fd_; }
+    bool zeroCopy() const { return zero_copy_; }
+    uint64_t kicks() const { return kicks_; }
+
+    // Thống kê của kernel: packet bỏ vì RX ring đầy, fill ring rỗng, descriptor TX lỗi...
+    bool statistics(struct xdp_statistics& stats) const {
+        socklen_t optlen = sizeof(stats);
+        memset(&stats, 0, sizeof(stats));
+        return getsockopt(fd_, SOL_XDP, XDP_STATISTICS, &stats, &optlen) == 0;
+    }
+
+    // ---- TX ----
+
+    // Lấy một frame trống để ghi packet vào, nullptr nếu mọi frame đang chờ kernel gửi
+    char* txFrame(uint64_t& addr) {
+        if (tx_free_.empty()) {
+            reapCompletions();
+            if (tx_free_.empty()) {
+                return nullptr;
+            }
+        }
+        addr = tx_free_.back();
+        tx_free_.pop_back();
+        return umem_ + addr;
+    }
+
+    // Đưa frame đã ghi vào TX ring (chưa công bố cho kernel tới txFlush).
+    // Số frame TX bằng kích thước ring nên ring luôn còn chỗ.
+    void txSubmit(uint64_t addr, uint32_t len) {
+        struct xdp_desc& desc = tx_.desc(tx_prod_++);
+        desc.addr = addr;
+        desc.len = len;
+        desc.options = 0;
+        tx_pending_++;
+    }
+
+    // Công bố descriptor mới và đánh thức kernel gửi; trả về số descriptor vừa công bố
+    uint32_t txFlush() {
+        uint32_t published = tx_pending_;
+        if (published > 0) {
+            tx_.storeProducer(tx_prod_);
+            tx_pending_ = 0;
+        }
+        if (tx_.loadConsumer() != tx_prod_) {
+            kick();
+        }
+        reapCompletions();
+        return published;
+    }
+
+    // ---- RX ----
+
+    // Xem tối đa max packet đã nhận (không chờ); đọc bằng rxData rồi trả bằng rxRelease
+    uint32_t rxPeek(uint32_t max) {
+        uint32_t available = rx_.loadProducer() - rx_cons_;
+        rx_peeked_ = std::min(available, max);
+        return rx_peeked_;
+    }
+
+    char* rxData(uint32_t i, uint32_t& len) {
+        const struct xdp_desc& desc = rx_.desc(rx_cons_ + i);
+        len = desc.len;
+        return umem_ + desc.addr;
+    }
+
+    // Trả các frame vừa xem về fill ring để kernel nhận tiếp vào đó
+    void rxRelease() {
+        if (rx_peeked_ == 0) {
+            return;
+        }
+        for (uint32_t i = 0; i < rx_peeked_; i++) {
+            fill_.addr(fill_prod_++) = rx_.desc(rx_cons_ + i).addr & ~(uint64_t)(XSK_FRAME_SIZE - 1);
+        }
+        fill_.storeProducer(fill_prod_);
+        rx_cons_ += rx_peeked_;
+        rx_.storeConsumer(rx_cons_);
+        rx_peeked_ = 0;
+        if (fill_.needWakeup()) {
+            recvfrom(fd_, nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+        }
+    }
+
+    // Chờ tối đa timeout_ms cho tới khi RX ring có packet
+    bool waitReadable(int timeout_ms) {
+        struct pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return poll(&pfd, 1, timeout_ms) > 0;
+    }
+
+private:
+    static size_t umemSize() { return (size_t)(XSK_RX_FRAMES + XSK_TX_FRAMES) * XSK_FRAME_SIZE; }
+
+    // Zero-copy: driver tự gửi, chỉ đánh thức khi cờ need_wakeup bật. Copy mode:
+    // mỗi sendto chỉ gửi tối đa một TX budget của kernel, gọi lại tới khi kernel
+    // lấy hết ring hoặc không tiến thêm được (queue của thiết bị đang đầy)
+    void kick() {
+        uint32_t consumer = tx_.loadConsumer();
+        while (consumer != tx_prod_) {
+            if (zero_copy_ && !tx_.needWakeup()) {
+                return;
+            }
+            if (sendto(fd_, nullptr, 0, MSG_DONTWAIT, nullptr, 0) < 0 &&
+                errno != EAGAIN && errno != EBUSY && errno != ENOBUFS) {
+                return;
+            }
+            kicks_++;
+            uint32_t after = tx_.loadConsumer();
+            if (after == consumer) {
+                return;
+            }
+            consumer = after;
+        }
+    }
+
+    void reapCompletions() {
+        uint32_t producer = comp_.loadProducer();
+        while (comp_cons_ != producer) {
+            tx_free_.push_back(comp_.addr(comp_cons_++));
+        }
+        comp_.storeConsumer(comp_cons_);
+    }
+
+    int fd_;
+    char* umem_;
+    bool zero_copy_;
+    XskRing rx_;
+    XskRing tx_;
+    XskRing fill_;
+    XskRing comp_;
+    uint32_t fill_prod_;
+    uint32_t rx_cons_;
+    uint32_t rx_peeked_;
+    uint32_t tx_prod_;
+    uint32_t tx_pending_;
+    uint32_t comp_cons_;
+    std::vector<uint64_t> tx_free_;   // Frame TX không nằm trong ring nào
+    uint64_t kicks_;                  // Số lần sendto đánh thức TX
+};
+
+#endif
@@ -1,89 +1,402 @@
 #include <iostream>
-#include <fstream>
 #include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
 #include <iomanip>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common/protocol.h"
+#include "common/checksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMPARE_X86 1
+#endif
+
+// So sánh file gốc với file nhận được: mmap cả hai file, chia theo chunk cho
+// các luồng, mỗi luồng so từng khối 32 byte bằng SIMD (AVX2, hoặc SSE2 hai
+// lần 16 byte; CPU được dò lúc chạy). Kết quả là các đoạn byte khác nhau và
+// số byte sai của từng chunk, quy ra pkt_num như sender đánh số (chunk i là
+// packet i + 1). Chế độ --digest chỉ tính XXH64 của một file để so với digest
+// sender/receiver in ra khi truyền với --crc.
+
+#define DEFAULT_MAX_REPORT 20   // Số đoạn khác / chunk sai in ra tối đa
+
+// Đoạn byte khác nhau [begin, end)
+struct DiffRange {
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Chunk có byte sai
+struct ChunkDiff {
+    uint64_t chunk;
+    uint32_t bytes;
+};
+
+// Kết quả của một luồng trên đoạn [begin, end) của file. Chỉ giữ max_report
+// đoạn/chunk đầu tiên (đủ để in), nhưng đếm đủ và giữ đoạn cuối để nối với
+// đoạn đầu của luồng sau nếu khác nhau liền qua ranh giới.
+struct DiffState {
+    uint64_t bytes_different = 0;
+    uint64_t range_count = 0;
+    uint64_t chunk_count = 0;
+    bool open = false;            // Đang ở trong một đoạn khác
+    uint64_t first_begin = 0;     // Đầu đoạn khác đầu tiên
+    DiffRange last = {0, 0};
+    std::vector<DiffRange> ranges;
+    std::vector<ChunkDiff> chunks;
+    size_t max_report = DEFAULT_MAX_REPORT;
+
+    void openRange(uint64_t pos) {
+        open = true;
+        last.begin = pos;
+    }
+
+    void closeRange(uint64_t pos) {
+        open = false;
+        last.end = pos;
+        if (range_count == 0) {
+            first_begin = last.begin;
+        }
+        if (ranges.size() < max_report) {
+            ranges.push_back(last);
+        }
+        range_count++;
+    }
+};
+
+// Duyệt mask của một khối (bit i = 1 nếu byte pos + i khác): đếm và mở/đóng đoạn
+inline void scanMask(DiffState& st, uint64_t pos, uint32_t mask, int bits) {
+    uint32_t full = bits == 32 ? 0xffffffffu : (1u << bits) - 1;
+    if ((mask == 0 && !st.open) || (mask == full && st.open)) {
+        st.bytes_different += mask == 0 ? 0 : bits;
+        return;  // Cả khối giống (hoặc cả khối khác) như trạng thái hiện tại
+    }
+    st.bytes_different += __builtin_popcount(mask);
+    for (int i = 0; i < bits; i++) {
+        bool diff = (mask >> i) & 1;
+        if (diff != st.open) {
+            if (diff) {
+                st.openRange(pos + i);
+            } else {
+                st.closeRange(pos + i);
+            }
+        }
+    }
+}
+
+inline void diffScalar(const uint8_t* a, const uint8_t* b, size_t len, uint64_t pos, DiffState& st) {
+    for (size_t i = 0; i < len; i += 32) {
+        int bits = (int)std::min<size_t>(32, len - i);
+        uint32_t mask = 0;
+        for (int j = 0; j < bits; j++) {
+            mask |= (uint32_t)(a[i + j] != b[i + j]) << j;
+        }
+        scanMask(st, pos + i, mask, bits);
+    }
+}
+
+#ifdef COMPARE_X86
+__attribute__((target("sse2")))
+inline void diffSse2(const uint8_t* a, const uint8_t* b, size_t len, uint64_t pos, DiffState& st) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i + 16)),
+                                     _mm_loadu_si128((const __m128i*)(b + i + 16)));
+        uint32_t equal = (uint32_t)_mm_movemask_epi8(eq0) | ((uint32_t)_mm_movemask_epi8(eq1) << 16);
+        scanMask(st, pos + i, ~equal, 32);
+    }
+    diffScalar(a + i, b + i, len - i, pos + i, st);
+}
+
+__attribute__((target("avx2")))
+inline void diffAvx2(const uint8_t* a, const uint8_t* b, size_t len, uint64_t pos, DiffState& st) {
+    size_t i = 0;
+    // Vùng giống nhau đi nhanh 64 byte mỗi vòng
+    for (; i + 64 <= len && !st.open; i += 64) {
+        __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i + 32)),
+                                      _mm256_loadu_si256((const __m256i*)(b + i + 32)));
+        if (!_mm256_testz_si256(_mm256_or_si256(x0, x1), _mm256_or_si256(x0, x1))) {
+            break;
+        }
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        scanMask(st, pos + i, ~(uint32_t)_mm256_movemask_epi8(eq), 32);
+    }
+    diffScalar(a + i, b + i, len - i, pos + i, st);
+}
+#endif
+
+typedef void (*DiffKernel)(const uint8_t*, const uint8_t*, size_t, uint64_t, DiffState&);
+
+DiffKernel selectKernel(const char*& name) {
+#ifdef COMPARE_X86
+    if (__builtin_cpu_supports("avx2")) {
+        name = "avx2";
+        return diffAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        name = "sse2";
+        return diffSse2;
+    }
+#endif
+    name = "scalar";
+    return diffScalar;
+}
+
+// File mmap chỉ đọc (file rỗng: data = nullptr)
+struct MappedFile {
+    int fd = -1;
+    uint64_t size = 0;
+    const uint8_t* data = nullptr;
+
+    ~MappedFile() {
+        if (data != nullptr) {
+            munmap((void*)data, size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool open(const char* path) {
+        fd = ::open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            return false;
+        }
+        size = st.st_size;
+        if (size == 0) {
+            return true;
+        }
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        data = (const uint8_t*)map;
+        madvise(map, size, MADV_SEQUENTIAL);
+        madvise(map, size, MADV_WILLNEED);
+        return true;
+    }
+};
+
+// Digest dạng hex (1-16 chữ số, có thể có 0x); false nếu không hợp lệ
+bool parseDigest(const char* text, uint64_t& value) {
+    if (strncmp(text, "0x", 2) == 0 || strncmp(text, "0X", 2) == 0) {
+        text += 2;
+    }
+    size_t len = strlen(text);
+    if (len == 0 || len > 16 || strspn(text, "0123456789abcdefABCDEF") != len) {
+        return false;
+    }
+    value = std::stoull(text, nullptr, 16);
+    return true;
+}
+
+// XXH64 của file, in ra và so với digest mong đợi (expected là dạng đã nhập,
+// nullptr nếu không có). Trả về 1 nếu không mở được file hoặc digest không khớp
+int digestFile(const char* path, const char* expected, uint64_t expected_digest) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Không thể mở file: " << path << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    Xxh64 digest;
+    digest.update(file.data, file.size);
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "XXH64: " << std::hex << std::setw(16) << std::setfill('0') << digest.digest() << std::dec
+              << std::setfill(' ') << " (" << file.size << " bytes, " << std::fixed << std::setprecision(3)
+              << seconds << " giây)" << std::endl;
+    if (expected != nullptr) {
+        if (expected_digest == digest.digest()) {
+            std::cout << "✅ Digest khớp" << std::endl;
+        } else {
+            std::cout << "❌ Digest KHÔNG khớp (mong đợi " << expected << ")" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
+    if (argc >= 3 && strcmp(argv[1], "--digest") == 0) {
+        uint64_t expected_digest = 0;
+        if (argc > 3 && !parseDigest(argv[3], expected_digest)) {
+            std::cerr << "Digest mong đợi không hợp lệ: " << argv[3] << " (tối đa 16 chữ số hex)" << std::endl
+                      << "Usage: " << argv[0] << " --digest <file> [expected_xxh64]" << std::endl;
+            return 1;
+        }
+        return digestFile(argv[2], argc > 3 ? argv[3] : nullptr, expected_digest);
+    }
+    if (argc < 3) {
         std::cerr << "Usage: " << argv[0]
-                  << " <original_file> <received_file>" << std::endl;
+                  << " <original_file> <received_file> [--threads N] [--chunk N] [--max-report N]" << std::endl
+                  << "       " << argv[0] << " --digest <file> [expected_xxh64]" << std::endl;
         return 1;
     }
 
     const char* original_file = argv[1];
     const char* received_file = argv[2];
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t chunk_size = CHUNK_SIZE;  // Chunk thỏa thuận khi truyền ("Payload mỗi packet" trong báo cáo)
+    size_t max_report = DEFAULT_MAX_REPORT;
 
-    std::ifstream orig(original_file, std::ios::binary);
-    std::ifstream recv(received_file, std::ios::binary);
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max(1ul, std::stoul(argv[++i]));
+        } else if (arg == "--chunk" && i + 1 < argc) {
+            chunk_size = std::max(1ul, std::stoul(argv[++i]));
+        } else if (arg == "--max-report" && i + 1 < argc) {
+            max_report = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Tham số không hợp lệ: " << arg << std::endl;
+            return 1;
+        }
+    }
 
-    if (!orig.is_open()) {
+    MappedFile orig;
+    MappedFile recv;
+    if (!orig.open(original_file)) {
         std::cerr << "Không thể mở file gốc: " << original_file << std::endl;
         return 1;
     }
-    if (!recv.is_open()) {
+    if (!recv.open(received_file)) {
         std::cerr << "Không thể mở file nhận được: " << received_file << std::endl;
         return 1;
     }
 
-    std::cout << "Đang so sánh byte-by-byte..." << std::endl;
-
-    uint64_t bytes_compared = 0;
-    uint64_t bytes_different = 0;
+    const char* kernel;
+    DiffKernel diff = selectKernel(kernel);
+    uint64_t bytes_compared = std::min(orig.size, recv.size);
+    uint64_t total_chunks = (bytes_compared + chunk_size - 1) / chunk_size;
+    threads = std::max<uint64_t>(1, std::min<uint64_t>(threads, total_chunks));
 
-    char orig_byte = 0;
-    char recv_byte = 0;
+    std::cout << "Đang so sánh (" << threads << " luồng, " << kernel << ")..." << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
 
-    while (true) {
-        bool orig_ok = orig.read(&orig_byte, 1).good();
-        bool recv_ok = recv.read(&recv_byte, 1).good();
+    // Mỗi luồng một dải chunk liền nhau
+    std::vector<DiffState> states(threads);
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            DiffState& st = states[t];
+            st.max_report = max_report;
+            uint64_t first = total_chunks * t / threads;
+            uint64_t last = total_chunks * (t + 1) / threads;
+            for (uint64_t c = first; c < last; c++) {
+                uint64_t offset = c * chunk_size;
+                size_t len = std::min<uint64_t>(chunk_size, bytes_compared - offset);
+                uint64_t before = st.bytes_different;
+                diff(orig.data + offset, recv.data + offset, len, offset, st);
+                if (st.bytes_different > before) {
+                    if (st.chunks.size() < max_report) {
+                        st.chunks.push_back(ChunkDiff{c, (uint32_t)(st.bytes_different - before)});
+                    }
+                    st.chunk_count++;
+                }
+            }
+            if (st.open) {
+                st.closeRange(std::min(last * chunk_size, bytes_compared));
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
 
-        if (!orig_ok || !recv_ok) {
-            break; // một trong hai file đã hết
+    // Gộp kết quả theo thứ tự luồng; đoạn khác kéo dài qua ranh giới được nối lại
+    uint64_t bytes_different = 0;
+    uint64_t range_count = 0;
+    uint64_t chunk_count = 0;
+    std::vector<DiffRange> ranges;
+    std::vector<ChunkDiff> chunks;
+    bool ranges_complete = true;   // ranges chứa mọi đoạn tới hết luồng trước
+    for (const DiffState& st : states) {
+        bytes_different += st.bytes_different;
+        range_count += st.range_count;
+        chunk_count += st.chunk_count;
+        for (size_t i = 0; i < st.ranges.size() && ranges_complete; i++) {
+            if (i == 0 && !ranges.empty() && ranges.back().end == st.ranges[0].begin) {
+                ranges.back().end = st.ranges[0].end;
+                continue;
+            }
+            ranges.push_back(st.ranges[i]);
         }
-
-        if (orig_byte != recv_byte) {
-            bytes_different++;
+        ranges_complete = ranges_complete && st.ranges.size() == st.range_count;
+        for (const ChunkDiff& chunk : st.chunks) {
+            if (chunks.size() < max_report) {
+                chunks.push_back(chunk);
+            }
         }
-
-        bytes_compared++;
-
-        if (bytes_compared % 10000000 == 0) { // mỗi ~10MB
-            std::cout << "\rĐã so sánh: "
-                      << std::fixed << std::setprecision(2)
-                      << bytes_compared / 1024.0 / 1024.0
-                      << " MB" << std::flush;
+    }
+    // Đoạn cuối của một luồng và đoạn đầu của luồng sau chạm nhau ở ranh giới là một đoạn
+    for (uint32_t t = 0; t + 1 < threads; t++) {
+        if (states[t].range_count > 0 && states[t + 1].range_count > 0 &&
+            states[t].last.end == states[t + 1].first_begin) {
+            range_count--;
         }
     }
 
-    // Kiểm tra file dài/ngắn hơn
-    orig.seekg(0, std::ios::end);
-    recv.seekg(0, std::ios::end);
-
-    uint64_t orig_size = orig.tellg();
-    uint64_t recv_size = recv.tellg();
-
-    orig.close();
-    recv.close();
-
-    std::cout << "\n\n=== KẾT QUẢ SO SÁNH ===" << std::endl;
-    std::cout << "File gốc     : " << orig_size << " bytes" << std::endl;
-    std::cout << "File nhận    : " << recv_size << " bytes" << std::endl;
-    std::cout << "Bytes so sánh: " << bytes_compared << std::endl;
+    std::cout << "\n=== KẾT QUẢ SO SÁNH ===" << std::endl;
+    std::cout << "File gốc     : " << orig.size << " bytes" << std::endl;
+    std::cout << "File nhận    : " << recv.size << " bytes" << std::endl;
+    std::cout << "Bytes so sánh: " << bytes_compared << " (" << std::fixed << std::setprecision(3) << seconds
+              << " giây, " << std::setprecision(2)
+              << (seconds > 0 ? bytes_compared / 1024.0 / 1024.0 / 1024.0 / seconds : 0) << " GB/s)" << std::endl;
     std::cout << "Bytes khác   : " << bytes_different << std::endl;
 
-    if (orig_size != recv_size) {
+    if (orig.size != recv.size) {
         std::cout << "⚠️  Cảnh báo: Kích thước file KHÔNG giống nhau!" << std::endl;
+        uint64_t first_missing = bytes_compared / chunk_size + 1;
+        uint64_t last_missing = (std::max(orig.size, recv.size) + chunk_size - 1) / chunk_size;
+        std::cout << "Phần chỉ có ở file " << (orig.size > recv.size ? "gốc" : "nhận") << ": byte " << bytes_compared
+                  << " - " << std::max(orig.size, recv.size) << " (packet " << first_missing << " - " << last_missing
+                  << ")" << std::endl;
     }
 
-    if (bytes_different == 0 && orig_size == recv_size) {
+    if (bytes_different == 0 && orig.size == recv.size) {
         std::cout << "✅ Hai file giống hệt nhau (byte-by-byte)" << std::endl;
-    } else {
-        double error_rate = (bytes_compared > 0)
-            ? (bytes_different * 100.0 / bytes_compared)
-            : 0.0;
-        std::cout << "Tỷ lệ lỗi: " << std::fixed << std::setprecision(6)
-                  << error_rate << " %" << std::endl;
+        return 0;
+    }
+
+    double error_rate = (bytes_compared > 0) ? (bytes_different * 100.0 / bytes_compared) : 0.0;
+    std::cout << "Tỷ lệ lỗi: " << std::fixed << std::setprecision(6) << error_rate << " %" << std::endl;
+    if (bytes_different == 0) {
+        return 0;
+    }
+
+    std::cout << "\nĐoạn khác nhau: " << range_count << std::endl;
+    for (const DiffRange& range : ranges) {
+        std::cout << "  byte " << range.begin << " - " << range.end << " (" << range.end - range.begin << " bytes)"
+                  << std::endl;
+    }
+    if (range_count > ranges.size()) {
+        std::cout << "  ..." << std::endl;
+    }
+
+    std::cout << "\nChunk sai (chunk " << chunk_size << " bytes): " << chunk_count << "/" << total_chunks << std::endl;
+    for (const ChunkDiff& chunk : chunks) {
+        std::cout << "  packet " << chunk.chunk + 1 << " (byte " << chunk.chunk * chunk_size << "): " << chunk.bytes
+                  << " bytes khác" << std::endl;
+    }
+    if (chunk_count > chunks.size()) {
+        std::cout << "  ..." << std::endl;
     }
 
     return 0;
-}
\ No newline at end of file
+}
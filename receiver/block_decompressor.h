@@ -0,0 +1,239 @@
+#ifndef BLOCK_DECOMPRESSOR_H
+#define BLOCK_DECOMPRESSOR_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
+
+#include "../common/compress.h"
+#include "../common/worker_pool.h"
+#include "file_sink.h"
+
+// Giải nén block (FEATURE_COMPRESS) song song trên WorkerPool. Chunk của block
+// nén được gom vào bộ đệm riêng của block; đủ chunk thì một luồng của pool giải
+// nén thẳng vào vị trí cuối cùng trong sink (memory, mmap). Sink không trỏ
+// thẳng được (ring của luồng ghi) thì giải vào bộ đệm, luồng nhận ghi xuống
+// sink theo thứ tự khi phần liền mạch đi tới block đó: luồng giải nén không
+// bao giờ phải chờ ring ghi có chỗ.
+// Mọi hàm trừ phần chạy trên pool chỉ được gọi từ luồng nhận.
+class BlockDecompressor {
+public:
+    struct Stats {
+        uint64_t compressed_blocks = 0;   // Block nén đã giải
+        uint64_t raw_blocks = 0;          // Block sender gửi nguyên
+        uint64_t failed_blocks = 0;       // Giải nén lỗi (truyền dừng trước block đầu tiên lỗi)
+        uint64_t raw_bytes = 0;           // Dữ liệu gốc của các block nén
+        uint64_t packed_bytes = 0;        // Số byte nén của chúng
+        double cpu_seconds = 0;           // Tổng thời gian của các luồng giải nén
+    };
+
+    BlockDecompressor(FileSink& sink, uint8_t codec, size_t chunk_size, uint64_t size, WorkerPool& pool)
+        : sink_(sink), codec_(codec), chunk_size_(chunk_size), size_(size),
+          block_bytes_((uint64_t)chunk_size * COMPRESS_BLOCK_CHUNKS),
+          sizes_((size + block_bytes_ - 1) / block_bytes_, SIZE_UNKNOWN),
+          states_(new std::atomic<uint8_t>[sizes_.size()]),
+          pool_(pool), pending_(0), failed_(false) {
+        for (size_t i = 0; i < sizes_.size(); i++) {
+            states_[i].store(STATE_PENDING, std::memory_order_relaxed);
+        }
+    }
+
+    ~BlockDecompressor() { drain(); }
+
+    // Chunk pkt_num mang block_size và len byte payload có khớp cách chia block
+    // không: block_size giống các chunk trước của block, chunk nằm trong phần
+    // nén và dài đúng phần của nó. Không khớp là packet hỏng
+    bool valid(uint32_t pkt_num, uint32_t block_size, size_t len) const {
+        uint64_t block = (uint64_t)(pkt_num - 1) / COMPRESS_BLOCK_CHUNKS;
+        if (block >= sizes_.size() || (sizes_[block] != SIZE_UNKNOWN && sizes_[block] != block_size)) {
+            return false;
+        }
+        size_t raw_len = blockLength(block);
+        uint64_t position = (uint64_t)((pkt_num - 1) % COMPRESS_BLOCK_CHUNKS) * chunk_size_;
+        if (position >= raw_len) {
+            return false;
+        }
+        if (block_size == 0) {
+            return len == std::min<uint64_t>(chunk_size_, raw_len - position);
+        }
+        size_t chunks = (raw_len + chunk_size_ - 1) / chunk_size_;
+        return block_size <= (chunks - 1) * chunk_size_ && position < block_size &&
+               len == std::min<uint64_t>(chunk_size_, block_size - position);
+    }
+
+    // Chunk mới (đã qua valid()). Block gửi nguyên: false, caller ghi payload
+    // vào sink như khi không nén. Block nén: payload được giữ lại, đủ chunk thì
+    // gửi block vào pool. Lần đầu gặp một block nén, [padding_from, padding_to)
+    // là các chunk không được gửi của block để caller đánh dấu đã nhận
+    // (rỗng nếu không có).
+    bool add(uint32_t pkt_num, uint32_t block_size, const char* payload, size_t len,
+             uint32_t& padding_from, uint32_t& padding_to) {
+        uint64_t block = (uint64_t)(pkt_num - 1) / COMPRESS_BLOCK_CHUNKS;
+        uint32_t first = (uint32_t)(block * COMPRESS_BLOCK_CHUNKS + 1);
+        size_t raw_len = blockLength(block);
+        padding_from = padding_to = 0;
+
+        if (sizes_[block] == SIZE_UNKNOWN) {
+            sizes_[block] = block_size;
+            if (block_size == 0) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stats_.raw_blocks++;
+            } else {
+                Staging& staging = acquire(block);
+                staging.size = block_size;
+                staging.chunks = (uint32_t)((block_size + chunk_size_ - 1) / chunk_size_);
+                staging.stored = 0;
+                padding_from = first + staging.chunks;
+                padding_to = first + (uint32_t)((raw_len + chunk_size_ - 1) / chunk_size_);
+            }
+        }
+        if (block_size == 0) {
+            return false;
+        }
+
+        Staging& staging = staging_.find(block)->second;
+        memcpy(staging.packed.data() + (uint64_t)(pkt_num - first) * chunk_size_, payload, len);
+        if (++staging.stored == staging.chunks) {
+            Staging* job = &staging;  // Node của unordered_map không di chuyển khi map thay đổi
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_++;
+            }
+            pool_.submit([this, block, job] { decode(block, *job); });
+        }
+        return true;
+    }
+
+    // Phần đã nằm trong sink: đi từ written tới expected (mọi chunk trước
+    // expected đã nhận), dừng ở block nén chưa giải xong hoặc giải lỗi (không
+    // bao giờ đi qua block lỗi: xem failed()). Block giải vào bộ đệm
+    // được ghi xuống sink tại đây, nhưng chỉ khi nó đứng đầu: ring ghi có thể
+    // phải chờ phần trước đó được commit mới có chỗ, nên caller commit rồi gọi
+    // lại. Trả về pkt_num đầu tiên chưa nằm trong sink.
+    uint32_t writtenUntil(uint32_t written, uint32_t expected) {
+        uint32_t start = written;
+        while (written < expected) {
+            uint64_t block = (uint64_t)(written - 1) / COMPRESS_BLOCK_CHUNKS;
+            if (sizes_[block] != 0) {
+                uint8_t state = states_[block].load(std::memory_order_acquire);
+                if (state != STATE_DONE) {
+                    break;
+                }
+                auto it = staging_.find(block);
+                if (it != staging_.end()) {
+                    Staging& staging = it->second;
+                    if (!staging.raw.empty()) {
+                        if (written != start) {
+                            break;
+                        }
+                        uint64_t offset = block * block_bytes_;
+                        sink_.waitForSpace(offset, staging.raw.size());
+                        sink_.write(offset, staging.raw.data(), staging.raw.size());
+                    }
+                    staging.raw.clear();
+                    free_.push_back(std::move(staging));
+                    staging_.erase(it);
+                }
+            }
+            written = std::min<uint64_t>((block + 1) * COMPRESS_BLOCK_CHUNKS + 1, expected);
+        }
+        return written;
+    }
+
+    // Chờ mọi block đã gửi vào pool giải xong
+    void drain() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return pending_ == 0; });
+    }
+
+    // Có block giải nén lỗi: dữ liệu của nó không bao giờ vào sink, sender đã
+    // được ACK và bỏ các chunk đó nên truyền phải dừng và báo thất bại
+    bool failed() const { return failed_.load(std::memory_order_acquire); }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    static const uint32_t SIZE_UNKNOWN = UINT32_MAX;
+    static const uint8_t STATE_PENDING = 0;
+    static const uint8_t STATE_DONE = 1;
+    static const uint8_t STATE_FAILED = 2;
+
+    // Bộ đệm của một block nén đang nhận/giải (dùng lại giữa các block)
+    struct Staging {
+        std::vector<char> packed;   // Các chunk nén, đặt theo vị trí trong block
+        std::vector<char> raw;      // Dữ liệu gốc khi sink không trỏ thẳng được
+        uint32_t size = 0;
+        uint32_t chunks = 0;        // Số chunk mang dữ liệu nén
+        uint32_t stored = 0;        // Số chunk đã nhận
+    };
+
+    size_t blockLength(uint64_t block) const { return std::min<uint64_t>(block_bytes_, size_ - block * block_bytes_); }
+
+    Staging& acquire(uint64_t block) {
+        Staging staging;
+        if (!free_.empty()) {
+            staging = std::move(free_.back());
+            free_.pop_back();
+        }
+        staging.packed.resize(block_bytes_ - chunk_size_);
+        return staging_.emplace(block, std::move(staging)).first->second;
+    }
+
+    // Chạy trên luồng của pool
+    void decode(uint64_t block, Staging& staging) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t offset = block * block_bytes_;
+        size_t raw_len = blockLength(block);
+        char* out = sink_.writable(offset, raw_len);
+        if (out == nullptr) {
+            staging.raw.resize(raw_len);
+            out = staging.raw.data();
+        }
+        bool ok = decompressBlock(codec_, staging.packed.data(), staging.size, out, raw_len);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ok) {
+                stats_.compressed_blocks++;
+                stats_.raw_bytes += raw_len;
+                stats_.packed_bytes += staging.size;
+            } else {
+                stats_.failed_blocks++;
+                failed_.store(true, std::memory_order_release);
+            }
+            stats_.cpu_seconds += seconds;
+            states_[block].store(ok ? STATE_DONE : STATE_FAILED, std::memory_order_release);
+            pending_--;
+        }
+        cv_.notify_all();
+    }
+
+    FileSink& sink_;
+    uint8_t codec_;
+    size_t chunk_size_;
+    uint64_t size_;
+    uint64_t block_bytes_;
+    std::vector<uint32_t> sizes_;                       // Theo block: số byte nén, 0 gửi nguyên
+    std::unique_ptr<std::atomic<uint8_t>[]> states_;   // Theo block: STATE_*
+    std::unordered_map<uint64_t, Staging> staging_;
+    std::vector<Staging> free_;
+    WorkerPool& pool_;
+    uint64_t pending_;
+    std::atomic<bool> failed_;
+    Stats stats_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+#endif
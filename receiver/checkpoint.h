@@ -0,0 +1,298 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../common/protocol.h"
+#include "file_sink.h"
+
+#define CHECKPOINT_MAGIC "XDPRSUM1"
+#define CHECKPOINT_INTERVAL_MS 1000   // Lưu checkpoint định kỳ trong lúc nhận
+
+// Checkpoint để truyền tiếp (--resume): bitmap các chunk của một stream đã
+// nằm trong file output, lưu ở <output>.resume (nhiều stream:
+// <output>.resume.<index>). Dữ liệu được ghi thẳng vào file output đã mmap
+// (MAP_SHARED); trước mỗi lần lưu, CheckpointWriter msync phần file output
+// của các chunk mới nên chunk có bit trong bitmap đã nằm trên đĩa, kể cả khi
+// máy mất điện chứ không chỉ khi receiver bị kill. Mỗi lần lưu ghi file tạm,
+// fsync, rename rồi fsync thư mục: file checkpoint không bao giờ bị ghi dở
+// hay mất sau khi lưu xong.
+struct CheckpointHeader {
+    char magic[8];
+    uint64_t file_size;     // Kích thước cả file
+    uint64_t range_offset;  // Đoạn file của stream
+    uint64_t range_size;
+    uint32_t chunk_size;    // pkt_num của bitmap đánh theo chunk này
+    uint32_t words;         // Số word 64 bit của bitmap theo sau header
+};
+
+class ResumeCheckpoint {
+public:
+    ResumeCheckpoint() : loaded_(false) { memset(&header_, 0, sizeof(header_)); }
+
+    static std::string pathFor(const char* output, uint32_t index, uint32_t count) {
+        std::string path = std::string(output) + ".resume";
+        return count > 1 ? path + "." + std::to_string(index) : path;
+    }
+
+    // Đọc checkpoint có sẵn; false nếu không có hoặc file hỏng
+    bool load(const std::string& path) {
+        path_ = path;
+        loaded_ = false;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = read(fd, &header_, sizeof(header_)) == sizeof(header_) &&
+                  memcmp(header_.magic, CHECKPOINT_MAGIC, sizeof(header_.magic)) == 0 && header_.chunk_size > 0 &&
+                  header_.words == wordsFor(header_.range_size, header_.chunk_size);
+        if (ok) {
+            words_.resize(header_.words);
+            size_t bytes = words_.size() * sizeof(uint64_t);
+            ok = read(fd, words_.data(), bytes) == (ssize_t)bytes;
+        }
+        close(fd);
+        loaded_ = ok;
+        return ok;
+    }
+
+    bool loaded() const { return loaded_; }
+    uint32_t chunkSize() const { return header_.chunk_size; }
+    uint64_t fileSize() const { return header_.file_size; }
+    uint64_t rangeOffset() const { return header_.range_offset; }
+    uint64_t rangeSize() const { return header_.range_size; }
+    const std::string& path() const { return path_; }
+
+    // Checkpoint dùng được cho đoạn này của file không (chunk size do handshake quyết định)
+    bool matches(uint64_t file_size, const StreamRange& range) const {
+        return loaded_ && header_.file_size == file_size && header_.range_offset == range.offset &&
+               header_.range_size == range.size;
+    }
+
+    // Bitmap đã lưu nếu dùng được với chunk_size, nullptr nếu phải nhận lại từ đầu
+    const std::vector<uint64_t>* bitmap(uint64_t file_size, const StreamRange& range, uint32_t chunk_size) const {
+        return matches(file_size, range) && header_.chunk_size == chunk_size ? &words_ : nullptr;
+    }
+
+    // Bắt đầu lưu cho đoạn đã thỏa thuận (thay checkpoint cũ không dùng được)
+    void reset(uint64_t file_size, const StreamRange& range, uint32_t chunk_size) {
+        memcpy(header_.magic, CHECKPOINT_MAGIC, sizeof(header_.magic));
+        header_.file_size = file_size;
+        header_.range_offset = range.offset;
+        header_.range_size = range.size;
+        header_.chunk_size = chunk_size;
+        header_.words = wordsFor(range.size, chunk_size);
+        words_.clear();
+    }
+
+    bool save(const std::vector<uint64_t>& words) {
+        if (words.size() != header_.words) {
+            return false;
+        }
+        std::string temp = path_ + ".tmp";
+        int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        size_t bytes = words.size() * sizeof(uint64_t);
+        bool ok = write(fd, &header_, sizeof(header_)) == sizeof(header_) &&
+                  write(fd, words.data(), bytes) == (ssize_t)bytes && fsync(fd) == 0;
+        close(fd);
+        return ok && rename(temp.c_str(), path_.c_str()) == 0 && syncDirectory();
+    }
+
+    // Nhận đủ: checkpoint không còn cần nữa
+    void remove() {
+        unlink(path_.c_str());
+        loaded_ = false;
+    }
+
+    // Số word của bitmap đánh số theo pkt_num (bit 0 không dùng), như ChunkBitmap
+    static uint32_t wordsFor(uint64_t range_size, uint32_t chunk_size) {
+        uint64_t total_packets = (range_size + chunk_size - 1) / chunk_size;
+        return (total_packets + 1 + 63) / 64;
+    }
+
+private:
+    // rename chỉ bền khi thư mục chứa file đã xuống đĩa
+    bool syncDirectory() const {
+        size_t slash = path_.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path_.substr(0, slash);
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = fsync(fd) == 0;
+        close(fd);
+        return ok;
+    }
+
+    std::string path_;
+    CheckpointHeader header_;
+    std::vector<uint64_t> words_;
+    bool loaded_;
+};
+
+// Lưu checkpoint của mọi stream ghi vào cùng một sink trên một luồng nền, để
+// msync (chờ ghi đĩa) không chặn vòng nhận trong lúc socket/RX ring đầy dần.
+// Luồng nhận chỉ chép bitmap hiện tại vào submit(). Mỗi CHECKPOINT_INTERVAL_MS
+// (hoặc ngay khi có save() đang chờ), luồng nền gom bitmap của mọi stream,
+// msync một lần đoạn file bao các chunk có bit mới từ lần lưu trước, rồi lưu
+// từng checkpoint.
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(FileSink& sink)
+        : sink_(sink), stop_(false), waiting_(0), thread_(&CheckpointWriter::run, this) {}
+
+    ~CheckpointWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    // Bitmap hiện tại của checkpoint (đã reset() hoặc load() cho đoạn này);
+    // chunk có bit phải đã write() xong vào sink. Không chờ lưu: bitmap nộp
+    // sau thay bitmap chưa kịp lưu.
+    void submit(ResumeCheckpoint& checkpoint, const std::vector<uint64_t>& words) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Slot& slot = slots_[&checkpoint];
+            slot.pending = words;
+            slot.has_pending = true;
+            slot.submitted++;
+        }
+        cv_.notify_all();
+    }
+
+    // Như submit() nhưng chờ tới khi bitmap này được lưu; true nếu lưu được
+    bool save(ResumeCheckpoint& checkpoint, const std::vector<uint64_t>& words) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiting_++;
+        Slot& slot = slots_[&checkpoint];
+        slot.pending = words;
+        slot.has_pending = true;
+        uint64_t wanted = ++slot.submitted;
+        cv_.notify_all();
+        cv_.wait(lock, [&] { return slot.done >= wanted; });
+        waiting_--;
+        return slot.ok;
+    }
+
+private:
+    struct Slot {
+        std::vector<uint64_t> pending;   // Bitmap chờ lưu
+        std::vector<uint64_t> saved;     // Bitmap đã lưu lần gần nhất (rỗng: chưa lưu)
+        bool has_pending = false;
+        uint64_t submitted = 0;          // Số lần submit()
+        uint64_t done = 0;               // submitted của bitmap lưu gần nhất
+        bool ok = false;
+    };
+
+    struct Job {
+        ResumeCheckpoint* checkpoint;
+        Slot* slot;
+        std::vector<uint64_t> words;
+        uint64_t submitted;
+    };
+
+    // Đoạn byte trong file của các chunk có bit trong words mà không có trong saved
+    static bool dirtyRange(const ResumeCheckpoint& checkpoint, const std::vector<uint64_t>& words,
+                           const std::vector<uint64_t>& saved, uint64_t& begin, uint64_t& end) {
+        size_t first = words.size();
+        size_t last = 0;
+        for (size_t i = 0; i < words.size(); i++) {
+            uint64_t fresh = words[i] & ~(i < saved.size() ? saved[i] : 0);
+            if (fresh != 0) {
+                first = std::min(first, i);
+                last = i;
+            }
+        }
+        if (first == words.size()) {
+            return false;
+        }
+        uint64_t chunk = checkpoint.chunkSize();
+        uint64_t first_pkt = std::max<uint64_t>(1, first * 64);   // pkt_num bắt đầu từ 1
+        uint64_t last_pkt = last * 64 + 63;
+        begin = checkpoint.rangeOffset() + (first_pkt - 1) * chunk;
+        end = checkpoint.rangeOffset() + std::min(checkpoint.rangeSize(), last_pkt * chunk);
+        return true;
+    }
+
+    void run() {
+        std::vector<Job> jobs;
+        auto next_round = std::chrono::steady_clock::now();
+        while (true) {
+            jobs.clear();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&] {
+                    return stop_ || std::any_of(slots_.begin(), slots_.end(),
+                                                [](const std::pair<ResumeCheckpoint* const, Slot>& entry) {
+                                                    return entry.second.has_pending;
+                                                });
+                });
+                // Chờ tới lượt để bitmap của các stream khác kịp nộp cùng lượt
+                cv_.wait_until(lock, next_round, [&] { return stop_ || waiting_ > 0; });
+                next_round = std::chrono::steady_clock::now() + std::chrono::milliseconds(CHECKPOINT_INTERVAL_MS);
+                for (auto& entry : slots_) {
+                    Slot& slot = entry.second;
+                    if (slot.has_pending) {
+                        jobs.push_back(Job{entry.first, &slot, std::move(slot.pending), slot.submitted});
+                        slot.has_pending = false;
+                    }
+                }
+                if (jobs.empty()) {
+                    return;  // stop_ và không còn gì chờ lưu
+                }
+            }
+
+            // Một msync cho cả lượt: đoạn bao mọi chunk mới của các stream
+            uint64_t begin = UINT64_MAX;
+            uint64_t end = 0;
+            for (const Job& job : jobs) {
+                uint64_t job_begin, job_end;
+                if (dirtyRange(*job.checkpoint, job.words, job.slot->saved, job_begin, job_end)) {
+                    begin = std::min(begin, job_begin);
+                    end = std::max(end, job_end);
+                }
+            }
+            bool synced = begin >= end || sink_.sync(begin, end - begin);
+
+            for (Job& job : jobs) {
+                bool ok = synced && job.checkpoint->save(job.words);
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (ok) {
+                    job.slot->saved.swap(job.words);
+                }
+                job.slot->ok = ok;
+                job.slot->done = job.submitted;
+            }
+            cv_.notify_all();
+        }
+    }
+
+    FileSink& sink_;
+    bool stop_;
+    uint32_t waiting_;                          // Số save() đang chờ: lưu ngay không chờ tới lượt
+    std::map<ResumeCheckpoint*, Slot> slots_;   // Node của map không đổi chỗ: Slot* dùng được ngoài lock
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+};
+
+#endif
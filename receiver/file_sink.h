@@ -0,0 +1,346 @@
+#ifndef FILE_SINK_H
+#define FILE_SINK_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../common/mirror_ring.h"
+
+#define STREAM_WRITE_BLOCK (1024 * 1024)   // Mỗi lần pwrite của luồng ghi
+
+// Đích ghi dữ liệu nhận được. Receiver ghi từng đoạn theo offset trong file
+// (có thể không theo thứ tự) và báo commit(end) khi mọi byte trước end đã đủ.
+class FileSink {
+public:
+    virtual ~FileSink() {}
+    virtual const char* name() const = 0;
+    // Ghi len byte tại offset; false nếu đoạn này chưa có chỗ trong bộ đệm
+    virtual bool write(uint64_t offset, const char* data, size_t len) = 0;
+    // Dữ liệu liền mạch tới end, có thể đưa xuống đĩa
+    virtual void commit(uint64_t end) = 0;
+    // Chờ tới khi write(offset, ..., len) chắc chắn có chỗ (dùng khi nhận tuần tự)
+    virtual void waitForSpace(uint64_t offset, size_t len) { (void)offset; (void)len; }
+    // Số byte đệm tối đa phía sau phần đã commit (window phải nằm gọn trong đó)
+    virtual uint64_t capacity() const { return UINT64_MAX; }
+    // Đọc lại len byte đã ghi tại offset (FEC cần chunk đã nhận để dựng chunk
+    // thiếu): con trỏ tới dữ liệu, có thể là scratch; nullptr nếu không đọc được
+    virtual const char* read(uint64_t offset, size_t len, char* scratch) {
+        (void)offset; (void)len; (void)scratch;
+        return nullptr;
+    }
+    // Vùng nhớ ghi thẳng được len byte tại offset (giải nén block vào đúng chỗ,
+    // có thể từ luồng khác với luồng nhận); nullptr nếu sink không trỏ thẳng được
+    virtual char* writable(uint64_t offset, size_t len) {
+        (void)offset; (void)len;
+        return nullptr;
+    }
+    // Đưa dữ liệu đã write() trong [offset, offset + len) xuống đĩa (trước khi
+    // lưu checkpoint ghi nhận chúng); false nếu lỗi hoặc sink không giữ dữ liệu
+    // trên đĩa trước finish()
+    virtual bool sync(uint64_t offset, uint64_t len) {
+        (void)offset; (void)len;
+        return false;
+    }
+    // Ghi nốt dữ liệu và chốt file ở đúng size byte; false nếu lỗi I/O
+    virtual bool finish(uint64_t size) = 0;
+};
+
+// Giữ cả file trong memory, chỉ ghi ra đĩa ở finish() như trước đây
+class MemoryFileSink : public FileSink {
+public:
+    MemoryFileSink(const char* path, uint64_t expected_size) : path_(path), data_(expected_size) {}
+
+    const char* name() const override { return "memory"; }
+
+    bool write(uint64_t offset, const char* data, size_t len) override {
+        if (offset + len > data_.size()) {
+            data_.resize(offset + len);
+        }
+        memcpy(data_.data() + offset, data, len);
+        return true;
+    }
+
+    const char* read(uint64_t offset, size_t len, char*) override {
+        return offset + len <= data_.size() ? data_.data() + offset : nullptr;
+    }
+
+    char* writable(uint64_t offset, size_t len) override {
+        return offset + len <= data_.size() ? data_.data() + offset : nullptr;
+    }
+
+    void commit(uint64_t) override {}
+
+    bool finish(uint64_t size) override {
+        std::ofstream file(path_, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(data_.data(), std::min<uint64_t>(size, data_.size()));
+        return file.good();
+    }
+
+private:
+    const char* path_;
+    std::vector<char> data_;
+};
+
+// Ghi theo luồng cho file lớn hơn RAM: dữ liệu nằm trong ring memory_bytes
+// (theo offset trong file), luồng ghi nền pwrite các đoạn đã commit rồi trả
+// chỗ. File được fallocate trước theo kích thước dự kiến để tránh phân mảnh.
+class StreamingFileSink : public FileSink {
+public:
+    StreamingFileSink() : fd_(-1), committed_(0), written_(0), done_(false), error_(false) {}
+
+    ~StreamingFileSink() override {
+        stopWriter();
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool open(const char* path, uint64_t expected_size, size_t memory_bytes) {
+        fd_ = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) {
+            return false;
+        }
+        if (expected_size > 0) {
+            fallocate(fd_, 0, 0, expected_size);  // Không hỗ trợ thì pwrite vẫn chạy bình thường
+        }
+        if (!ring_.create(std::max<size_t>(memory_bytes, STREAM_WRITE_BLOCK))) {
+            return false;
+        }
+        writer_ = std::thread(&StreamingFileSink::writeLoop, this);
+        return true;
+    }
+
+    const char* name() const override { return "stream"; }
+    uint64_t capacity() const override { return ring_.size(); }
+
+    bool write(uint64_t offset, const char* data, size_t len) override {
+        if (offset < committed_.load(std::memory_order_relaxed)) {
+            return true;  // Đã có (và có thể đang được ghi xuống đĩa)
+        }
+        if (offset + len > written_.load(std::memory_order_acquire) + ring_.size()) {
+            return false;
+        }
+        memcpy(ring_.at(offset), data, len);
+        return true;
+    }
+
+    // Phần trước written_ đã nằm trên đĩa (slot ring có thể đã bị dùng lại),
+    // phần sau vẫn còn trong ring cho tới khi chính receiver ghi đè
+    const char* read(uint64_t offset, size_t len, char* scratch) override {
+        uint64_t written = written_.load(std::memory_order_acquire);
+        if (offset >= written) {
+            return ring_.at(offset);
+        }
+        size_t on_disk = std::min<uint64_t>(len, written - offset);
+        if (pread(fd_, scratch, on_disk, offset) != (ssize_t)on_disk) {
+            return nullptr;
+        }
+        memcpy(scratch + on_disk, ring_.at(offset + on_disk), len - on_disk);
+        return scratch;
+    }
+
+    void waitForSpace(uint64_t offset, size_t len) override {
+        uint64_t end = offset + len;
+        if (end > written_.load(std::memory_order_acquire) + ring_.size()) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return error_ || end <= written_.load(std::memory_order_acquire) + ring_.size(); });
+        }
+    }
+
+    void commit(uint64_t end) override {
+        if (end <= committed_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            committed_.store(end, std::memory_order_release);
+        }
+        cv_.notify_all();
+    }
+
+    bool finish(uint64_t size) override {
+        commit(size);
+        stopWriter();
+        return !error_ && ftruncate(fd_, std::min<uint64_t>(size, written_.load())) == 0;
+    }
+
+private:
+    void stopWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        cv_.notify_all();
+        if (writer_.joinable()) {
+            writer_.join();
+        }
+    }
+
+    void writeLoop() {
+        while (true) {
+            uint64_t written = written_.load(std::memory_order_relaxed);
+            uint64_t committed;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&] { return done_ || committed_.load(std::memory_order_acquire) > written; });
+                committed = committed_.load(std::memory_order_acquire);
+                if (committed == written) {
+                    return;  // done_ và đã ghi hết
+                }
+            }
+
+            size_t n = std::min<uint64_t>(STREAM_WRITE_BLOCK, committed - written);
+            ssize_t r = pwrite(fd_, ring_.at(written), n, written);
+            if (r <= 0) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                error_ = true;
+                cv_.notify_all();
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                written_.store(written + r, std::memory_order_release);
+            }
+            cv_.notify_all();
+        }
+    }
+
+    int fd_;
+    MirrorRing ring_;
+    std::atomic<uint64_t> committed_;  // Mọi byte trước offset này đã có trong ring
+    std::atomic<uint64_t> written_;    // Đã pwrite xuống file tới offset này
+    bool done_;
+    bool error_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread writer_;
+};
+
+// Ghi thẳng vào file đã mmap (MAP_SHARED) với kích thước dự kiến. Nhiều
+// stream ghi song song vào các đoạn khác nhau của cùng một mapping; page
+// cache tự đưa xuống đĩa, finish() chỉ munmap và cắt file về đúng size.
+// keep: giữ dữ liệu đã có trong file (truyền tiếp từ checkpoint).
+class MmapFileSink : public FileSink {
+public:
+    MmapFileSink() : fd_(-1), size_(0), map_(nullptr) {}
+
+    ~MmapFileSink() override {
+        if (map_ != nullptr) {
+            munmap(map_, size_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool open(const char* path, uint64_t size, bool keep = false) {
+        fd_ = ::open(path, O_RDWR | O_CREAT | (keep ? 0 : O_TRUNC), 0644);
+        if (fd_ < 0 || ftruncate(fd_, size) < 0) {
+            return false;
+        }
+        size_ = size;
+        if (size_ == 0) {
+            return true;  // mmap không nhận độ dài 0
+        }
+        fallocate(fd_, 0, 0, size_);  // Không hỗ trợ thì page được cấp khi ghi tới
+        void* map = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        map_ = (char*)map;
+        return true;
+    }
+
+    const char* name() const override { return "mmap"; }
+
+    bool write(uint64_t offset, const char* data, size_t len) override {
+        if (offset + len > size_) {
+            return true;  // Nằm ngoài file, bỏ như chunk ngoài file
+        }
+        memcpy(map_ + offset, data, len);
+        return true;
+    }
+
+    const char* read(uint64_t offset, size_t len, char*) override {
+        return offset + len <= size_ ? map_ + offset : nullptr;
+    }
+
+    char* writable(uint64_t offset, size_t len) override {
+        return offset + len <= size_ ? map_ + offset : nullptr;
+    }
+
+    void commit(uint64_t) override {}
+
+    // msync chỉ các page của đoạn (checkpoint chỉ cần phần vừa ghi từ lần trước)
+    bool sync(uint64_t offset, uint64_t len) override {
+        uint64_t end = std::min(size_, offset + len);
+        if (map_ == nullptr || offset >= end) {
+            return map_ != nullptr || fdatasync(fd_) == 0;
+        }
+        uint64_t page = sysconf(_SC_PAGESIZE);
+        uint64_t start = offset / page * page;
+        return msync(map_ + start, end - start, MS_SYNC) == 0;
+    }
+
+    bool finish(uint64_t size) override {
+        if (map_ != nullptr) {
+            munmap(map_, size_);
+            map_ = nullptr;
+        }
+        return ftruncate(fd_, std::min(size, size_)) == 0;
+    }
+
+private:
+    int fd_;
+    uint64_t size_;
+    char* map_;
+};
+
+// Đoạn bắt đầu tại offset của một đích ghi dùng chung (mỗi stream một đoạn).
+// finish() của từng stream không làm gì: file được chốt một lần khi mọi stream xong.
+class RangeFileSink : public FileSink {
+public:
+    RangeFileSink(FileSink& base, uint64_t offset) : base_(base), offset_(offset) {}
+
+    const char* name() const override { return base_.name(); }
+    bool write(uint64_t offset, const char* data, size_t len) override { return base_.write(offset_ + offset, data, len); }
+    const char* read(uint64_t offset, size_t len, char* scratch) override { return base_.read(offset_ + offset, len, scratch); }
+    char* writable(uint64_t offset, size_t len) override { return base_.writable(offset_ + offset, len); }
+    void commit(uint64_t) override {}
+    bool sync(uint64_t offset, uint64_t len) override { return base_.sync(offset_ + offset, len); }
+    bool finish(uint64_t) override { return true; }
+
+private:
+    FileSink& base_;
+    uint64_t offset_;
+};
+
+// Mở đích ghi, nullptr nếu không tạo được file. memory_bytes = 0: giữ cả file
+// trong memory; > 0: ghi theo luồng với ring giới hạn memory_bytes.
+inline std::unique_ptr<FileSink> openFileSink(const char* path, uint64_t expected_size, size_t memory_bytes = 0) {
+    if (memory_bytes > 0) {
+        std::unique_ptr<StreamingFileSink> sink(new StreamingFileSink());
+        if (!sink->open(path, expected_size, memory_bytes)) {
+            return nullptr;
+        }
+        return std::unique_ptr<FileSink>(sink.release());
+    }
+    return std::unique_ptr<FileSink>(new MemoryFileSink(path, expected_size));
+}
+
+#endif
@@ -9,18 +9,33 @@
 #include <unistd.h>
 #include <chrono>
 #include <iomanip>
+#include <memory>
+#include <string>
+
+#include "file_sink.h"
 
 #define CHUNK_SIZE 1024
 
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <port> <output_file> <original_file>" << std::endl;
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <port> <output_file> <original_file> [--mem-mb N]" << std::endl;
         return 1;
     }
 
     int port = std::stoi(argv[1]);
     const char* output_file = argv[2];
     const char* original_file = argv[3];
+    size_t memory_mb = 0;  // 0 = giữ cả file trong memory, ghi ra ở cuối
+
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--mem-mb" && i + 1 < argc) {
+            memory_mb = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Tham số không hợp lệ: " << arg << std::endl;
+            return 1;
+        }
+    }
 
     // Kiểm tra file gốc
     std::ifstream orig_file(original_file, std::ios::binary | std::ios::ate);
@@ -35,12 +50,17 @@ int main(int argc, char* argv[]) {
     std::cout << "Kích thước file gốc: " << std::fixed << std::setprecision(2) 
                 << original_size / 1024.0 / 1024.0 << " MB" << std::endl;
 
-    // CẤP PHÁT MEMORY ĐỂ LƯU DỮ LIỆU
-    std::cout << "Cấp phát memory để nhận dữ liệu..." << std::endl;
-    std::vector<char> received_data;
-    received_data.reserve(original_size);
-    std::cout << "Đã cấp phát " << std::setprecision(2) 
-              << original_size / 1024.0 / 1024.0 << " MB memory!" << std::endl;
+    // ĐÍCH GHI: cả file trong memory, hoặc ring giới hạn --mem-mb với luồng ghi nền
+    std::unique_ptr<FileSink> sink = openFileSink(output_file, original_size, memory_mb * 1024 * 1024);
+    if (!sink) {
+        std::cerr << "Không thể tạo file output: " << output_file << std::endl;
+        return 1;
+    }
+    std::cout << "Đích ghi: " << sink->name();
+    if (memory_mb > 0) {
+        std::cout << " (ring " << sink->capacity() / 1024 / 1024 << " MB)";
+    }
+    std::cout << std::endl;
 
     // Tạo TCP socket
     int server_sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -111,9 +131,14 @@ int main(int argc, char* argv[]) {
             break;
         }
 
-        // Lưu vào memory thay vì ghi file ngay
-        received_data.insert(received_data.end(), buffer, buffer + received);
+        // Lưu vào đích ghi (memory hoặc ring của luồng ghi nền)
+        sink->waitForSpace(total_received, received);
+        if (!sink->write(total_received, buffer, received)) {
+            std::cerr << "\nLỗi ghi file output" << std::endl;
+            break;
+        }
         total_received += received;
+        sink->commit(total_received);
         chunks_received++;
 
         // Hiển thị tiến trình
@@ -136,19 +161,15 @@ int main(int argc, char* argv[]) {
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
 
-    std::cout << "\n\nĐang ghi dữ liệu từ memory ra file..." << std::endl;
+    std::cout << "\n\nĐang ghi nốt dữ liệu ra file..." << std::endl;
     
-    // GHI DỮ LIỆU TỪ MEMORY RA FILE (không tính vào thời gian đo)
-    std::ofstream file(output_file, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Không thể tạo file output: " << output_file << std::endl;
+    // GHI NỐT DỮ LIỆU RA FILE (không tính vào thời gian đo)
+    if (!sink->finish(total_received)) {
+        std::cerr << "Không thể ghi file output: " << output_file << std::endl;
         close(client_sock);
         close(server_sock);
         return 1;
     }
-    
-    file.write(received_data.data(), received_data.size());
-    file.close();
     std::cout << "Đã ghi xong file!" << std::endl;
 
     // Lấy kích thước file thực tế đã nhận
@@ -8,19 +8,38 @@
 #include <unistd.h>
 #include <chrono>
 #include <iomanip>
+#include <memory>
+#include <string>
+
+#include "../common/batch_io.h"
+#include "file_sink.h"
 
 #define CHUNK_SIZE 1024
 #define TIMEOUT_SEC 3
 
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <port> <output_file> <original_file>" << std::endl;
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <port> <output_file> <original_file> [--mem-mb N] [--gso]" << std::endl;
         return 1;
     }
 
     int port = std::stoi(argv[1]);
     const char* output_file = argv[2];
     const char* original_file = argv[3];
+    size_t memory_mb = 0;  // 0 = giữ cả file trong memory, ghi ra ở cuối
+    bool gro = false;      // --gso: bật UDP GRO, mỗi lần nhận có thể là nhiều datagram gộp lại
+
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--mem-mb" && i + 1 < argc) {
+            memory_mb = std::stoul(argv[++i]);
+        } else if (arg == "--gso") {
+            gro = true;
+        } else {
+            std::cerr << "Tham số không hợp lệ: " << arg << std::endl;
+            return 1;
+        }
+    }
 
     // Kiểm tra file gốc
     std::ifstream orig_file(original_file, std::ios::binary | std::ios::ate);
@@ -35,12 +54,17 @@ int main(int argc, char* argv[]) {
     std::cout << "Kích thước file gốc: " << std::fixed << std::setprecision(2) 
                 << original_size / 1024.0 / 1024.0 << " MB" << std::endl;
 
-    // CẤP PHÁT MEMORY ĐỂ LƯU DỮ LIỆU
-    std::cout << "Cấp phát memory để nhận dữ liệu..." << std::endl;
-    std::vector<char> received_data;
-    received_data.reserve(original_size);
-    std::cout << "Đã cấp phát " << std::setprecision(2) 
-              << original_size / 1024.0 / 1024.0 << " MB memory!" << std::endl;
+    // ĐÍCH GHI: cả file trong memory, hoặc ring giới hạn --mem-mb với luồng ghi nền
+    std::unique_ptr<FileSink> sink = openFileSink(output_file, original_size, memory_mb * 1024 * 1024);
+    if (!sink) {
+        std::cerr << "Không thể tạo file output: " << output_file << std::endl;
+        return 1;
+    }
+    std::cout << "Đích ghi: " << sink->name();
+    if (memory_mb > 0) {
+        std::cout << " (ring " << sink->capacity() / 1024 / 1024 << " MB)";
+    }
+    std::cout << std::endl;
 
     // Tạo UDP socket
     int sock = socket(AF_INET, SOCK_DGRAM, 0);
@@ -68,13 +92,28 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    if (gro) {
+        int one = 1;
+        if (setsockopt(sock, SOL_UDP, UDP_GRO, &one, sizeof(one)) == 0) {
+            std::cout << "UDP GRO: bật" << std::endl;
+        } else {
+            std::cerr << "Không bật được UDP GRO: " << strerror(errno) << std::endl;
+            gro = false;
+        }
+    }
+
     std::cout << "Đang lắng nghe trên port " << port << "..." << std::endl;
 
-    char buffer[CHUNK_SIZE];
+    // Với GRO một lần nhận là cả buffer gộp (tới ~64 KB); dữ liệu vẫn nối tiếp như từng datagram
+    std::vector<char> buffer(gro ? UDP_GRO_BUFFER_SIZE : CHUNK_SIZE);
+    char control[CMSG_SPACE(sizeof(int))];
     struct sockaddr_in sender_addr;
-    socklen_t addr_len = sizeof(sender_addr);
+    struct iovec iov = {buffer.data(), buffer.size()};
+    struct msghdr hdr;
 
     uint64_t packets_received = 0;
+    uint64_t receives = 0;
+    uint64_t next_progress = 100;
     uint64_t total_bytes_received = 0;
     bool started = false;
 
@@ -84,8 +123,14 @@ int main(int argc, char* argv[]) {
     std::cout << "Đang nhận dữ liệu vào memory (UDP)..." << std::endl;
 
     while (true) {
-        ssize_t recv_len = recvfrom(sock, buffer, sizeof(buffer), 0,
-                                    (struct sockaddr*)&sender_addr, &addr_len);
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &sender_addr;
+        hdr.msg_namelen = sizeof(sender_addr);
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control;
+        hdr.msg_controllen = sizeof(control);
+        ssize_t recv_len = recvmsg(sock, &hdr, 0);
 
         if (recv_len < 0) {
             // Timeout - kiểm tra đã nhận gì chưa
@@ -111,14 +156,22 @@ int main(int argc, char* argv[]) {
 
         last_packet_time = std::chrono::high_resolution_clock::now();
 
-        // Lưu dữ liệu vào memory thay vì ghi file ngay
-        received_data.insert(received_data.end(), buffer, buffer + recv_len);
+        // Lưu vào đích ghi (memory hoặc ring của luồng ghi nền)
+        sink->waitForSpace(total_bytes_received, recv_len);
+        if (!sink->write(total_bytes_received, buffer.data(), recv_len)) {
+            std::cerr << "\nLỗi ghi file output" << std::endl;
+            break;
+        }
+        sink->commit(total_bytes_received + recv_len);
         
-        packets_received++;
+        size_t segment_size = gro ? groSegmentSize(hdr) : 0;
+        packets_received += segment_size > 0 ? (recv_len + segment_size - 1) / segment_size : 1;
+        receives++;
         total_bytes_received += recv_len;
 
         // Hiển thị tiến trình
-        if (packets_received % 100 == 0) {
+        if (packets_received >= next_progress) {
+            next_progress = packets_received + 100;
             auto current_time = std::chrono::high_resolution_clock::now();
             auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
                 current_time - start_time);
@@ -135,18 +188,14 @@ int main(int argc, char* argv[]) {
     auto end_time = last_packet_time;
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
 
-    std::cout << "\n\nĐang ghi dữ liệu từ memory ra file..." << std::endl;
+    std::cout << "\n\nĐang ghi nốt dữ liệu ra file..." << std::endl;
 
-    // GHI DỮ LIỆU TỪ MEMORY RA FILE (không tính vào thời gian đo)
-    std::ofstream file(output_file, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Không thể tạo file output: " << output_file << std::endl;
+    // GHI NỐT DỮ LIỆU RA FILE (không tính vào thời gian đo)
+    if (!sink->finish(total_bytes_received)) {
+        std::cerr << "Không thể ghi file output: " << output_file << std::endl;
         close(sock);
         return 1;
     }
-    
-    file.write(received_data.data(), received_data.size());
-    file.close();
     std::cout << "Đã ghi xong file!" << std::endl;
 
     // Lấy kích thước file thực tế đã nhận
@@ -162,6 +211,9 @@ int main(int argc, char* argv[]) {
     std::cout << "Tổng thời gian: " << std::fixed << std::setprecision(3) 
               << duration.count() / 1000.0 << " giây" << std::endl;
     std::cout << "Packets đã nhận: " << packets_received << std::endl;
+    if (gro) {
+        std::cout << "Số lần nhận (GRO): " << receives << std::endl;
+    }
     std::cout << "Tổng dữ liệu đã nhận: " << std::setprecision(2) 
               << total_bytes_received / 1024.0 / 1024.0 << " MB" << std::endl;
     std::cout << "File gốc: " << std::setprecision(2) 
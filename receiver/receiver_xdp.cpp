@@ -7,116 +7,236 @@
 #include <unistd.h>
 #include <chrono>
 #include <iomanip>
-#include <map>
 #include <vector>
+#include <algorithm>
+#include <string>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <csignal>
+
+#include "../common/packet_io.h"
+#include "../common/protocol.h"
+#include "../common/fec.h"
+#include "../common/checksum.h"
+#include "file_sink.h"
+#include "checkpoint.h"
+#include "block_decompressor.h"
 
-#define CHUNK_SIZE 972
 #define TIMEOUT_SEC 5
-#define HEADER_SIZE 4
-#define DEFAULT_WINDOW_SIZE 5
-#define MAX_WINDOW_SIZE 8191  // 2^13 - 1 (13 bits)
-
-// Handshake flags (3 bits cuối)
-#define SYN 0x01   // 0000 0001 - Yêu cầu kết nối
-#define ACK 0x02   // 0000 0010 - Xác nhận
-#define FIN 0x04   // 0000 0100 - Kết thúc kết nối
-
-// Handshake packet structure (16 bits = 2 bytes)
-// Format: [13 bits: window_size][3 bits: flags]
-struct HandshakePacket {
-    uint16_t data;  // 13 bits window size + 3 bits flags
-    
-    // Set window size (13 bits đầu)
-    void setWindowSize(uint16_t window_size) {
-        if (window_size > MAX_WINDOW_SIZE) {
-            window_size = MAX_WINDOW_SIZE;
-        }
-        data = (window_size << 3) | (data & 0x07);
+#define FEC_BLOCK_SLOTS 64   // Số block FEC giữ repair cùng lúc (block mới đè block cũ cùng slot)
+#define DIGEST_LINGER_MS 500 // Sau khi trả lời digest: chờ thêm chừng này phòng trả lời bị mất
+#define STOP_NOTIFY_COPIES 3  // Số bản trả lời digest báo sender dừng khi receiver bỏ dở
+#define MAX_SOCKET_BUFFER (64 * 1024 * 1024)
+
+// Bitmap đánh dấu các chunk đã nhận, đánh số theo pkt_num (bắt đầu từ 1)
+class ChunkBitmap {
+public:
+    explicit ChunkBitmap(uint64_t total_packets) : bits_((total_packets + 1 + 63) / 64, 0) {}
+
+    bool test(uint32_t pkt_num) const {
+        return (bits_[pkt_num / 64] >> (pkt_num % 64)) & 1;
     }
-    
-    // Get window size
-    uint16_t getWindowSize() const {
-        return (data >> 3) & 0x1FFF;  // Lấy 13 bits đầu
+
+    void set(uint32_t pkt_num) {
+        bits_[pkt_num / 64] |= (1ULL << (pkt_num % 64));
     }
-    
-    // Set flags (3 bits cuối)
-    void setFlags(uint8_t flags) {
-        data = (data & 0xFFF8) | (flags & 0x07);
+
+    // 64 bit liên tiếp bắt đầu từ pkt_num (dùng để dựng SACK bitmap)
+    uint64_t word(uint32_t pkt_num) const {
+        size_t idx = pkt_num / 64;
+        unsigned shift = pkt_num % 64;
+        uint64_t value = idx < bits_.size() ? bits_[idx] >> shift : 0;
+        if (shift != 0 && idx + 1 < bits_.size()) {
+            value |= bits_[idx + 1] << (64 - shift);
+        }
+        return value;
     }
-    
-    // Get flags
-    uint8_t getFlags() const {
-        return data & 0x07;  // Lấy 3 bits cuối
+
+    // Số chunk đã nhận
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (uint64_t word : bits_) {
+            total += __builtin_popcountll(word);
+        }
+        return total;
     }
-};
 
-struct PacketHeader {
-    uint32_t pkt_num;
-};
+    // Các word của bitmap (checkpoint, trả bitmap cho sender khi truyền tiếp)
+    const std::vector<uint64_t>& words() const { return bits_; }
+    void assign(const std::vector<uint64_t>& words) { bits_ = words; }
 
-struct AckPacket {
-    uint32_t ack_num;
-};
+    // Tìm chunk chưa nhận đầu tiên kể từ pkt_num (quét theo từng word 64 bit)
+    uint32_t firstMissingFrom(uint32_t pkt_num, uint32_t limit) const {
+        while (pkt_num < limit) {
+            uint64_t missing = ~bits_[pkt_num / 64] >> (pkt_num % 64);
+            if (missing != 0) {
+                return std::min<uint32_t>(pkt_num + __builtin_ctzll(missing), limit);
+            }
+            pkt_num = (pkt_num / 64 + 1) * 64;
+        }
+        return limit;
+    }
 
-struct BufferedPacket {
-    std::vector<char> data;
-    bool received;
+private:
+    std::vector<uint64_t> bits_;
 };
 
-bool waitForHandshake(int sock, struct sockaddr_in& sender_addr, socklen_t& addr_len, 
-                     uint16_t preferred_window, uint16_t& negotiated_window) {
+// Ctrl+C khi chạy với --resume: dừng nhận và lưu checkpoint thay vì mất dữ liệu
+std::atomic<bool> receive_interrupted(false);
+
+void onInterrupt(int) {
+    receive_interrupted = true;
+}
+
+// Đọc handshake 2 byte (bản cũ) hoặc handshake mở rộng, trả về false nếu không phải handshake.
+// Handshake 2 byte không có scale/chunk size/kích thước file: dùng giá trị mặc định.
+bool parseHandshake(const char* buffer, ssize_t len, HandshakePacket& packet, bool& ext, HandshakeParams& params) {
+    if (len == sizeof(HandshakePacket)) {
+        memcpy(&packet, buffer, sizeof(packet));
+        ext = false;
+        params = HandshakeParams{packet.getWindowSize(), 0, CHUNK_SIZE, 0};
+        return true;
+    }
+    if (len > 0 && HandshakeExtPacket::matches(buffer, len)) {
+        const HandshakeExtPacket* ext_packet = (const HandshakeExtPacket*)buffer;
+        packet = ext_packet->base;
+        ext = true;
+        params = ext_packet->params();
+        return true;
+    }
+    return false;
+}
+
+// connect_socket: gắn UDP socket với sender ngay khi nhận SYN (truyền song song:
+// SYN của stream sau sẽ được kernel đưa tới socket khác trong nhóm SO_REUSEPORT).
+// stop: bỏ chờ khi không nhận được gì trong thời gian chờ và cờ đã bật.
+// checkpoints: checkpoint theo chỉ số stream (--resume), nullptr nếu không truyền tiếp.
+bool waitForHandshake(PacketIo& io, struct sockaddr_in& sender_addr, const HandshakeParams& preferred,
+                      HandshakeParams& negotiated, const std::vector<ResumeCheckpoint>* checkpoints = nullptr,
+                      bool connect_socket = false, const std::atomic<bool>* stop = nullptr) {
     std::cout << "\n=== CHỜ HANDSHAKE ===" << std::endl;
     std::cout << "Đang đợi yêu cầu kết nối từ sender..." << std::endl;
-    std::cout << "Window size ưa thích của receiver: " << preferred_window << std::endl;
+    std::cout << "Window size ưa thích của receiver: " << preferred.window << std::endl;
     
+    char buffer[sizeof(HandshakeExtPacket)];
     HandshakePacket packet;
+    bool ext;
+    HandshakeParams sender_params;
     
     while (true) {
-        ssize_t recv_len = recvfrom(sock, &packet, sizeof(packet), 0,
-                                    (struct sockaddr*)&sender_addr, &addr_len);
+        ssize_t recv_len = io.receiveFrom(buffer, sizeof(buffer), sender_addr);
         
         if (recv_len < 0) {
+            if ((stop != nullptr && *stop) || receive_interrupted) {
+                return false;
+            }
+            continue;
+        }
+
+        // Probe dò path MTU của sender: trả lại header (bản thân probe đã tới nơi)
+        if (ProbePacket::matches(buffer, recv_len)) {
+            io.sendTo(sender_addr, buffer, sizeof(ProbePacket));
             continue;
         }
         
-        // Kiểm tra nếu là gói tin handshake (kích thước đúng)
-        if (recv_len == sizeof(HandshakePacket)) {
+        // Kiểm tra nếu là gói tin handshake (16-bit hoặc mở rộng)
+        if (parseHandshake(buffer, recv_len, packet, ext, sender_params)) {
             // Bước 1: Nhận SYN
             if (packet.getFlags() & SYN) {
-                uint16_t sender_window = packet.getWindowSize();
+                uint32_t sender_window = sender_params.window;
                 
                 char sender_ip[INET_ADDRSTRLEN];
                 inet_ntop(AF_INET, &sender_addr.sin_addr, sender_ip, INET_ADDRSTRLEN);
-                std::cout << "Bước 1: Nhận được SYN từ " << sender_ip << ":" << ntohs(sender_addr.sin_port) << std::endl;
+                std::cout << "Bước 1: Nhận được SYN" << (ext ? "" : " (16-bit)") << " từ " << sender_ip << ":" << ntohs(sender_addr.sin_port) << std::endl;
                 std::cout << "        Sender đề xuất window_size=" << sender_window << std::endl;
                 
-                // Thỏa thuận window size (chọn giá trị nhỏ hơn)
-                negotiated_window = std::min(sender_window, preferred_window);
-                std::cout << "        Receiver chọn window_size=" << negotiated_window << std::endl;
+                // Thỏa thuận window size, chunk size (chọn giá trị nhỏ hơn) và các tính
+                // năng cả hai cùng hỗ trợ; kích thước file lấy theo sender
+                negotiated.window = std::min(sender_window, preferred.window);
+                negotiated.features = sender_params.features & preferred.features;
+                // Nén: codec sender chọn phải có trong bản build này; FEC mã hóa
+                // theo chunk gốc nên không dùng cùng nén
+                if ((negotiated.features & FEATURE_COMPRESS) && !compressCodecSupported(sender_params.codec)) {
+                    std::cout << "        Không giải nén được codec " << compressCodecName(sender_params.codec)
+                              << ", nhận dữ liệu nguyên" << std::endl;
+                    negotiated.features &= ~FEATURE_COMPRESS;
+                }
+                if ((negotiated.features & FEATURE_COMPRESS) && !(negotiated.features & FEATURE_CRC)) {
+                    std::cout << "        Nén cần CRC32C từng chunk, nhận dữ liệu nguyên" << std::endl;
+                    negotiated.features &= ~FEATURE_COMPRESS;
+                }
+                if (negotiated.features & FEATURE_COMPRESS) {
+                    negotiated.features &= ~FEATURE_FEC;
+                }
+                negotiated.codec = (negotiated.features & FEATURE_COMPRESS) ? sender_params.codec : COMPRESS_NONE;
+                negotiated.chunk_size = std::min(sender_params.chunk_size, preferred.chunk_size);
+                // Header CRC và repair packet dài hơn header thường cũng phải nhận được
+                negotiated.chunk_size = std::min<size_t>(negotiated.chunk_size,
+                    preferred.chunk_size + HEADER_SIZE - packetHeaderSize(negotiated.features));
+                negotiated.file_size = sender_params.file_size;
+                negotiated.range = sender_params.range;
+
+                // Truyền tiếp khi có checkpoint của đúng đoạn này; chunk size phải
+                // giữ như lần trước để bitmap còn đúng pkt_num
+                if (negotiated.features & FEATURE_RESUME) {
+                    const ResumeCheckpoint* checkpoint =
+                        checkpoints != nullptr && negotiated.range.index < checkpoints->size()
+                            ? &(*checkpoints)[negotiated.range.index] : nullptr;
+                    if (checkpoint != nullptr && checkpoint->matches(negotiated.file_size, negotiated.range) &&
+                        checkpoint->chunkSize() <= negotiated.chunk_size) {
+                        negotiated.chunk_size = checkpoint->chunkSize();
+                    } else {
+                        negotiated.features &= ~FEATURE_RESUME;
+                    }
+                }
+
+                if (connect_socket && io.udpSocket() >= 0 &&
+                    connect(io.udpSocket(), (const struct sockaddr*)&sender_addr, sizeof(sender_addr)) < 0) {
+                    std::cerr << "Không gắn được socket với sender: " << strerror(errno) << std::endl;
+                }
                 
-                // Bước 2: Gửi SYN-ACK với window size đã chọn
-                HandshakePacket syn_ack;
-                syn_ack.setWindowSize(negotiated_window);
-                syn_ack.setFlags(SYN | ACK);
+                // Bước 2: Gửi SYN-ACK với các tham số đã chọn (cùng định dạng với SYN)
+                HandshakeExtPacket syn_ack;
+                syn_ack.init(negotiated, SYN | ACK);
+                HandshakePacket legacy_syn_ack;
+                legacy_syn_ack.data = 0;
+                legacy_syn_ack.setWindowSize(std::min<uint32_t>(negotiated.window, MAX_WINDOW_SIZE));
+                legacy_syn_ack.setFlags(SYN | ACK);
+                // Window sau khi mã hóa (có thể bị làm tròn theo scale) là giá trị hai bên cùng dùng
+                negotiated.window = ext ? syn_ack.window() : legacy_syn_ack.getWindowSize();
+                std::cout << "        Receiver chọn window_size=" << negotiated.window << std::endl;
+                const void* syn_ack_data = ext ? (const void*)&syn_ack : (const void*)&legacy_syn_ack;
+                size_t syn_ack_len = ext ? syn_ack.size() : sizeof(HandshakePacket);
                 
-                std::cout << "Bước 2: Gửi SYN-ACK với window_size=" << negotiated_window << std::endl;
-                sendto(sock, &syn_ack, sizeof(syn_ack), 0,
-                      (struct sockaddr*)&sender_addr, addr_len);
+                std::cout << "Bước 2: Gửi SYN-ACK với window_size=" << negotiated.window << std::endl;
+                io.sendTo(sender_addr, syn_ack_data, syn_ack_len);
                 
                 // Bước 3: Đợi ACK
                 auto start_time = std::chrono::high_resolution_clock::now();
                 while (true) {
                     HandshakePacket ack_packet;
+                    bool ack_ext;
+                    HandshakeParams ack_params;
                     struct sockaddr_in temp_addr;
-                    socklen_t temp_len = sizeof(temp_addr);
                     
-                    ssize_t ack_len = recvfrom(sock, &ack_packet, sizeof(ack_packet), 0,
-                                              (struct sockaddr*)&temp_addr, &temp_len);
+                    ssize_t ack_len = io.receiveFrom(buffer, sizeof(buffer), temp_addr);
                     
-                    if (ack_len > 0 && ack_len == sizeof(HandshakePacket) && (ack_packet.getFlags() & ACK)) {
+                    if (ack_len > 0 && parseHandshake(buffer, ack_len, ack_packet, ack_ext, ack_params) &&
+                        (ack_packet.getFlags() & ACK)) {
                         std::cout << "Bước 3: Nhận được ACK" << std::endl;
                         std::cout << "✓ Handshake thành công!" << std::endl;
-                        std::cout << "✓ Window size cuối cùng: " << negotiated_window << std::endl;
+                        std::cout << "✓ Window size cuối cùng: " << negotiated.window << std::endl;
+                        std::cout << "✓ Chunk size: " << negotiated.chunk_size << " bytes" << std::endl;
+                        std::cout << "✓ Kiểu ACK: " << ((negotiated.features & FEATURE_SACK) ? "cumulative + SACK" : "từng packet") << std::endl;
+                        if (negotiated.features & FEATURE_RESUME) {
+                            std::cout << "✓ Truyền tiếp từ checkpoint" << std::endl;
+                        }
+                        if (negotiated.features & FEATURE_COMPRESS) {
+                            std::cout << "✓ Nén: " << compressCodecName(negotiated.codec) << std::endl;
+                        }
                         std::cout << "=== KẾT THÚC HANDSHAKE ===\n" << std::endl;
                         return true;
                     }
@@ -126,8 +246,7 @@ bool waitForHandshake(int sock, struct sockaddr_in& sender_addr, socklen_t& addr
                     auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time);
                     if (elapsed.count() >= 1000) {
                         std::cout << "Timeout! Gửi lại SYN-ACK..." << std::endl;
-                        sendto(sock, &syn_ack, sizeof(syn_ack), 0,
-                              (struct sockaddr*)&sender_addr, addr_len);
+                        io.sendTo(sender_addr, syn_ack_data, syn_ack_len);
                         start_time = now;
                     }
                 }
@@ -138,102 +257,302 @@ bool waitForHandshake(int sock, struct sockaddr_in& sender_addr, socklen_t& addr
     return false;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <port> <output_file> <original_file>" << std::endl;
-        return 1;
-    }
-
-    int port = std::stoi(argv[1]);
-    const char* output_file = argv[2];
-    const char* original_file = argv[3];
-    uint16_t preferred_window = DEFAULT_WINDOW_SIZE;
-    
-    std::cout << "Sử dụng giao thức: Selective Repeat với Handshake (16-bit)" << std::endl;
-
-    // Kiểm tra file gốc
-    std::ifstream orig_file(original_file, std::ios::binary | std::ios::ate);
-    if (!orig_file.is_open()) {
-        std::cerr << "Không thể mở file gốc: " << original_file << std::endl;
-        return 1;
+// Dựng SACK: cumulative ACK tại expected_seq_num + bitmap SACK_BITS packet từ sack_base
+void buildSack(SackPacket& sack, uint32_t expected_seq_num, uint32_t sack_base, const ChunkBitmap& received_chunks) {
+    memset(&sack, 0, sizeof(sack));
+    sack.marker = CTRL_MARKER;
+    sack.type = CTRL_SACK;
+    sack.cum_ack = expected_seq_num;
+    sack.sack_base = sack_base;
+    for (int w = 0; w < SACK_BITS / 64; w++) {
+        sack.sack[w] = received_chunks.word(sack_base + w * 64);
     }
-    
-    std::streamsize original_size = orig_file.tellg();
-    orig_file.close();
-    
-    std::cout << "Kích thước file gốc: " << std::fixed << std::setprecision(2) 
-              << original_size / 1024.0 / 1024.0 << " MB" << std::endl;
-
-    // CẤP PHÁT MEMORY ĐỂ LƯU DỮ LIỆU
-    std::cout << "Cấp phát memory để nhận dữ liệu..." << std::endl;
-    std::vector<char> received_data;
-    received_data.reserve(original_size);
-    std::cout << "Đã cấp phát " << std::setprecision(2) 
-              << original_size / 1024.0 / 1024.0 << " MB memory!" << std::endl;
-
-    // Tạo UDP socket
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        std::cerr << "Không thể tạo socket" << std::endl;
-        return 1;
-    }
-
-    // Set timeout
-    struct timeval tv;
-    tv.tv_sec = TIMEOUT_SEC;
-    tv.tv_usec = 0;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
 
-    // Bind socket
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
+// Tham số nhận dùng chung cho mọi stream
+struct ReceiverConfig {
+    size_t batch_size;
+    bool show_progress;   // In tiến trình ra stdout (chỉ khi có một stream)
+    WorkerPool* decompress_pool;  // Luồng giải nén dùng chung cho mọi stream (có FEATURE_COMPRESS)
+    CheckpointWriter* checkpoint_writer;  // Luồng lưu checkpoint của sink dùng chung (--resume)
+};
 
-    if (bind(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        std::cerr << "Không thể bind socket" << std::endl;
-        close(sock);
-        return 1;
-    }
+// Kết quả nhận của một stream
+struct ReceiveResult {
+    uint64_t packets_received;
+    uint64_t bytes_received;
+    uint64_t contiguous_size;   // Dữ liệu liền mạch từ đầu đoạn của stream
+    int digest_status;          // DIGEST_* khi sender gửi digest, -1 nếu không có
+    bool decompress_failed;     // Có block nén không giải được: đoạn dừng trước block đó
+    std::chrono::high_resolution_clock::time_point start_time;
+    std::chrono::high_resolution_clock::time_point end_time;
+};
 
-    std::cout << "Đang lắng nghe trên port " << port << "..." << std::endl;
+// Nhận file (hoặc đoạn file của một stream) bằng Selective Repeat sau khi
+// handshake xong, ghi vào sink theo offset trong đoạn. Kết thúc khi không có
+// packet trong TIMEOUT_SEC. Báo cáo chi tiết ghi vào report.
+// checkpoint (--resume): bitmap chunk đã có được nạp lúc đầu (FEATURE_RESUME)
+// và lưu lại định kỳ cùng lúc kết thúc.
+ReceiveResult receiveFile(PacketIo& io, struct sockaddr_in sender_addr, const HandshakeParams& negotiated,
+                          FileSink& sink, const ReceiverConfig& config, std::ostream& report,
+                          ResumeCheckpoint* checkpoint = nullptr) {
+    uint32_t negotiated_window = negotiated.window;
+    uint32_t features = negotiated.features;
+    size_t chunk_size = negotiated.chunk_size;
+    size_t batch_size = config.batch_size;
+    uint64_t file_size = negotiated.range.size;
+    uint64_t total_packets = (file_size + chunk_size - 1) / chunk_size;
+    ChunkBitmap received_chunks(total_packets);
 
-    // Chờ handshake và thỏa thuận window size
-    struct sockaddr_in sender_addr;
-    socklen_t addr_len = sizeof(sender_addr);
-    uint16_t negotiated_window;
-    
-    if (!waitForHandshake(sock, sender_addr, addr_len, preferred_window, negotiated_window)) {
-        std::cerr << "Handshake thất bại!" << std::endl;
-        close(sock);
-        return 1;
+    // Socket buffer phải chứa được cả window, nếu không window lớn chỉ làm tràn buffer
+    // (AF_XDP nhận thẳng vào UMEM, bộ đệm là XSK_RX_FRAMES frame)
+    int sock = io.udpSocket();
+    if (sock >= 0) {
+        int rcvbuf = (int)std::min<uint64_t>((uint64_t)negotiated_window * (chunk_size + HEADER_SIZE) * 2,
+                                             MAX_SOCKET_BUFFER);
+        // SO_RCVBUFFORCE vượt được net.core.rmem_max khi chạy bằng root (container)
+        if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        }
+        socklen_t optlen = sizeof(rcvbuf);
+        getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen);
+        std::cout << "Socket receive buffer: " << rcvbuf / 1024 << " KB" << std::endl;
     }
 
-    std::cout << "Sử dụng window size: " << negotiated_window << std::endl;
-
-    char buffer[CHUNK_SIZE + HEADER_SIZE];
+    bool sack_mode = (features & FEATURE_SACK) != 0;
+    bool crc_mode = (features & FEATURE_CRC) != 0;
+    size_t header_size = dataHeaderSize(features);
+    std::vector<uint32_t> far_packets;  // Packet nằm ngoài SACK đầu tiên trong batch hiện tại
+    far_packets.reserve(batch_size);
 
     uint32_t expected_seq_num = 1;
-    std::map<uint32_t, BufferedPacket> receive_buffer;
+    uint32_t written_seq_num = 1;   // Chunk trước đây đã nằm trong sink (khác expected_seq_num khi block nén còn đang giải)
+    uint64_t buffered_packets = 0;  // Chunk đến sớm, đã nằm đúng chỗ nhưng chưa liền mạch
     
     uint64_t packets_received = 0;
     uint64_t total_bytes_received = 0;
     uint64_t duplicate_packets = 0;
+    uint64_t sink_full_drops = 0;    // Packet bỏ vì ring của luồng ghi chưa có chỗ
     uint64_t out_of_order_packets = 0;
     uint64_t acks_sent = 0;
 
+    // FEC: repair của các block gần đây và bộ đệm để dựng chunk thiếu
+    bool fec_mode = (features & FEATURE_FEC) != 0;
+    FecDecoder fec(chunk_size, FEC_BLOCK_SLOTS);
+    std::vector<char> fec_known;     // Bản đọc lại của chunk đã nhận (khi sink không trỏ thẳng được)
+    std::vector<char> fec_rebuilt;   // Chunk dựng lại
+    uint64_t repairs_received = 0;
+    uint64_t chunks_recovered = 0;
+    uint64_t blocks_decoded = 0;
+
+    // CRC: packet hỏng bị bỏ và xin gửi lại; XXH64 của phần liền mạch được
+    // cập nhật mỗi khi expected_seq_num tiến lên, so với digest sender gửi lúc kết thúc
+    Xxh64 digest;
+    std::vector<char> digest_scratch(crc_mode ? chunk_size : 0);
+    bool digest_readable = true;    // Sink đọc lại được mọi đoạn đã băm
+    int digest_status = -1;
+    bool finished = false;          // Đã trả lời digest khớp/không khớp
+    uint64_t corrupt_packets = 0;
+    uint64_t nacks_sent = 0;
+    if (fec_mode) {
+        fec_known.resize(FEC_MAX_K * chunk_size);
+        fec_rebuilt.resize(FEC_MAX_REPAIR * chunk_size);
+    }
+
+    // Nén: block nén được giải song song, phần liền mạch chỉ được băm/commit
+    // khi các block trong đó đã giải xong
+    std::unique_ptr<BlockDecompressor> decompressor;
+    if ((features & FEATURE_COMPRESS) && config.decompress_pool != nullptr) {
+        decompressor.reset(new BlockDecompressor(sink, negotiated.codec, chunk_size, file_size, *config.decompress_pool));
+    }
+    uint64_t invalid_packets = 0;    // block_size không khớp cách chia block
+
     auto start_time = std::chrono::high_resolution_clock::now();
     auto last_packet_time = start_time;
     auto last_progress_time = start_time;
+    auto written_time = start_time;  // Lúc mọi dữ liệu đã nằm trong sink
+
+    // Đẩy written_seq_num tới phần đã nằm trong sink: cập nhật digest và commit
+    // (từng đoạn một khi block giải nén phải chờ phần trước được commit)
+    auto advanceWritten = [&]() {
+        while (true) {
+            uint32_t new_written = decompressor ? decompressor->writtenUntil(written_seq_num, expected_seq_num)
+                                                : expected_seq_num;
+            if (new_written == written_seq_num) {
+                return;
+            }
+            uint64_t end_offset = std::min<uint64_t>((uint64_t)(new_written - 1) * chunk_size, file_size);
+
+            if (crc_mode) {
+                for (uint64_t offset = (uint64_t)(written_seq_num - 1) * chunk_size; offset < end_offset;
+                     offset += chunk_size) {
+                    size_t len = std::min<uint64_t>(chunk_size, end_offset - offset);
+                    const char* data = sink.read(offset, len, digest_scratch.data());
+                    if (data == nullptr) {
+                        digest_readable = false;
+                        break;
+                    }
+                    digest.update(data, len);
+                }
+            }
+
+            written_seq_num = new_written;
+            sink.commit(end_offset);
+            if (written_seq_num > total_packets) {
+                written_time = std::chrono::high_resolution_clock::now();
+            }
+        }
+    };
+
+    // Đẩy expected_seq_num qua các chunk đã nhận liền mạch. fresh = 1: chunk tại
+    // expected_seq_num vừa tới, các chunk sau nó lấy từ buffered_packets;
+    // fresh = 0: mọi chunk đều đã được tính trong buffered_packets (checkpoint)
+    auto advanceContiguous = [&](uint64_t fresh) {
+        uint32_t new_expected = received_chunks.firstMissingFrom(expected_seq_num, total_packets + 1);
+        buffered_packets -= new_expected - expected_seq_num - fresh;
+        expected_seq_num = new_expected;
+        advanceWritten();
+    };
+
+    // Đánh dấu chunk mới (payload đã nằm trong sink, hoặc đang chờ giải nén cùng
+    // block) và đẩy expected_seq_num; bytes = 0: chunk không được gửi của block nén
+    auto acceptChunk = [&](uint32_t pkt_num, size_t bytes) {
+        received_chunks.set(pkt_num);
+        if (bytes > 0) {
+            packets_received++;
+            total_bytes_received += bytes;
+        }
+
+        if (pkt_num > expected_seq_num) {
+            buffered_packets++;
+            if (bytes > 0) {
+                out_of_order_packets++;
+                far_packets.push_back(pkt_num);
+            }
+        } else {
+            advanceContiguous(1);
+        }
+    };
+
+    // Dựng các chunk thiếu của block khi số repair đã nhận đủ bù số chunk thiếu.
+    // Chunk dựng lại được ghi thẳng vào sink như chunk nhận qua mạng (và được
+    // ACK để sender không gửi lại); không đọc lại được chunk đã có thì bỏ block
+    // cho cơ chế gửi lại lo.
+    auto tryRecover = [&](FecDecoder::Block& block) {
+        uint32_t missing[FEC_MAX_K];
+        uint32_t missing_count = 0;
+        for (uint32_t i = 0; i < block.k; i++) {
+            if (!received_chunks.test(block.first + i)) {
+                missing[missing_count++] = i;
+            }
+        }
+        if (missing_count == 0) {
+            fec.finish(block);
+            return;
+        }
+        if (missing_count > block.count) {
+            return;  // Chờ thêm data hoặc repair
+        }
+
+        const uint8_t* known[FEC_MAX_K];
+        size_t lens[FEC_MAX_K];
+        uint8_t* rebuilt[FEC_MAX_REPAIR];
+        for (uint32_t i = 0; i < block.k; i++) {
+            uint64_t offset = (uint64_t)(block.first + i - 1) * chunk_size;
+            lens[i] = std::min<uint64_t>(chunk_size, file_size - offset);
+            known[i] = nullptr;
+            if (received_chunks.test(block.first + i)) {
+                known[i] = (const uint8_t*)sink.read(offset, lens[i], &fec_known[i * chunk_size]);
+                if (known[i] == nullptr) {
+                    fec.finish(block);
+                    return;
+                }
+            }
+        }
+        for (uint32_t b = 0; b < missing_count; b++) {
+            rebuilt[b] = (uint8_t*)&fec_rebuilt[b * chunk_size];
+        }
+        if (!fec.recover(block, known, lens, missing, missing_count, rebuilt)) {
+            fec.finish(block);
+            return;
+        }
+
+        for (uint32_t b = 0; b < missing_count; b++) {
+            uint32_t pkt_num = block.first + missing[b];
+            uint64_t offset = (uint64_t)(pkt_num - 1) * chunk_size;
+            if (!sink.write(offset, (const char*)rebuilt[b], lens[missing[b]])) {
+                continue;  // Ring ghi chưa có chỗ: để sender gửi lại
+            }
+            if (!sack_mode) {
+                if (io.full()) {
+                    io.flush();
+                }
+                AckPacket ack;
+                ack.ack_num = pkt_num;
+                io.addCopy(sender_addr, &ack, sizeof(ack));
+                acks_sent++;
+            }
+            acceptChunk(pkt_num, lens[missing[b]]);
+            chunks_recovered++;
+        }
+        blocks_decoded++;
+        fec.finish(block);
+    };
+
+    // Truyền tiếp: chunk có trong checkpoint đã nằm sẵn trong file output, coi
+    // như đã nhận (không tính vào số liệu của lần nhận này)
+    uint64_t resumed_packets = 0;
+    auto last_checkpoint_time = start_time;
+    if (checkpoint != nullptr) {
+        const std::vector<uint64_t>* saved =
+            (features & FEATURE_RESUME) ? checkpoint->bitmap(negotiated.file_size, negotiated.range, chunk_size)
+                                        : nullptr;
+        if (saved != nullptr) {
+            received_chunks.assign(*saved);
+            resumed_packets = received_chunks.count();
+            buffered_packets = resumed_packets;
+            advanceContiguous(0);
+        } else {
+            checkpoint->reset(negotiated.file_size, negotiated.range, chunk_size);
+        }
+    }
 
     std::cout << "Đang nhận dữ liệu vào memory với Selective Repeat..." << std::endl;
 
     while (true) {
-        ssize_t recv_len = recvfrom(sock, buffer, sizeof(buffer), 0,
-                                    (struct sockaddr*)&sender_addr, &addr_len);
+        int count = io.receive(MSG_WAITFORONE);
 
-        if (recv_len < 0) {
+        if (receive_interrupted) {
+            std::cout << "\nBị ngắt - dừng nhận dữ liệu" << std::endl;
+            break;
+        }
+
+        if (decompressor) {
+            advanceWritten();  // Block giải xong trong lúc chờ packet
+            if (decompressor->failed()) {
+                std::cout << "\n✗ Giải nén block lỗi - dừng nhận" << std::endl;
+                // Nén luôn đi kèm CRC nên sender hiểu trả lời digest: báo chưa
+                // đủ dữ liệu để sender dừng thay vì gửi lại mãi
+                DigestPacket stop;
+                memset(&stop, 0, sizeof(stop));
+                stop.marker = CTRL_MARKER;
+                stop.type = CTRL_DIGEST;
+                stop.status = DIGEST_INCOMPLETE;
+                stop.size = digest.size();
+                stop.digest = digest.digest();
+                io.flush();
+                for (int i = 0; i < STOP_NOTIFY_COPIES; i++) {
+                    io.sendTo(sender_addr, &stop, sizeof(stop));
+                }
+                digest_status = DIGEST_INCOMPLETE;
+                break;
+            }
+        }
+
+        if (count < 0) {
+            if (finished) {
+                break;  // Đã trả lời digest và sender không hỏi lại
+            }
             auto now = std::chrono::high_resolution_clock::now();
             auto idle_time = std::chrono::duration_cast<std::chrono::seconds>(now - last_packet_time);
             
@@ -244,124 +563,744 @@ int main(int argc, char* argv[]) {
             continue;
         }
 
-        // Bỏ qua gói tin handshake nếu nhận được
-        if (recv_len == sizeof(HandshakePacket)) {
-            continue;
-        }
+        bool got_data = false;
+        far_packets.clear();
+
+        for (int i = 0; i < count; i++) {
+            char* buffer = io.data(i);
+            ssize_t recv_len = io.length(i);
+            sender_addr = io.source(i);
+
+            // Repair packet của FEC: giữ lại nếu block còn thiếu chunk, thử dựng ngay
+            if (fec_mode && recv_len > (ssize_t)sizeof(RepairHeader) && isControlPacket(buffer, recv_len) &&
+                controlType(buffer) == CTRL_REPAIR) {
+                const RepairHeader* repair = (const RepairHeader*)buffer;
+                size_t repair_len = recv_len - sizeof(RepairHeader);
+                got_data = true;
+                repairs_received++;
+                if (crc_mode && packetCrc(repair, offsetof(RepairHeader, crc), buffer + sizeof(RepairHeader),
+                                          repair_len) != repair->crc) {
+                    corrupt_packets++;
+                    continue;
+                }
+                if (repair->k == 0 || repair->k > FEC_MAX_K || repair->index >= FEC_MAX_REPAIR ||
+                    repair->first == 0 || (uint64_t)repair->first + repair->k - 1 > total_packets ||
+                    repair_len > chunk_size) {
+                    continue;
+                }
+                uint32_t block_end = repair->first + repair->k;
+                if (received_chunks.firstMissingFrom(std::max(repair->first, expected_seq_num), block_end) == block_end) {
+                    continue;  // Block đã đủ
+                }
+                FecDecoder::Block* block = fec.store(*repair, buffer + sizeof(RepairHeader), repair_len);
+                if (block != nullptr) {
+                    tryRecover(*block);
+                }
+                continue;
+            }
 
-        last_packet_time = std::chrono::high_resolution_clock::now();
+            // Sender xin bitmap chunk đã có (truyền tiếp): trả trang được xin
+            if ((features & FEATURE_RESUME) && ResumePacket::matches(buffer, recv_len)) {
+                ResumePacket reply;
+                memset(&reply, 0, sizeof(reply));
+                memcpy(&reply, buffer, ResumePacket::headerSize());
+                const std::vector<uint64_t>& words = received_chunks.words();
+                reply.pages = (words.size() + RESUME_PAGE_WORDS - 1) / RESUME_PAGE_WORDS;
+                if (reply.page < reply.pages) {
+                    size_t first = (size_t)reply.page * RESUME_PAGE_WORDS;
+                    size_t n = std::min<size_t>(RESUME_PAGE_WORDS, words.size() - first);
+                    memcpy(reply.bits, &words[first], n * sizeof(uint64_t));
+                    io.sendTo(sender_addr, &reply, sizeof(reply));
+                }
+                continue;
+            }
 
-        // Parse header
-        PacketHeader* header = (PacketHeader*)buffer;
-        uint32_t pkt_num = header->pkt_num;
+            // Sender đã được ACK hết và gửi digest: so với digest của dữ liệu đã nhận
+            if (crc_mode && DigestPacket::matches(buffer, recv_len) &&
+                ((const DigestPacket*)buffer)->status == DIGEST_REQUEST) {
+                DigestPacket reply;
+                memcpy(&reply, buffer, sizeof(reply));
+                if (decompressor) {
+                    decompressor->drain();
+                    advanceWritten();
+                }
+                bool complete = written_seq_num > total_packets && digest_readable;
+                bool match = reply.size == digest.size() && reply.digest == digest.digest();
+                reply.status = !complete ? DIGEST_INCOMPLETE : (match ? DIGEST_MATCH : DIGEST_MISMATCH);
+                reply.size = digest.size();
+                reply.digest = digest.digest();
+                if (io.full()) {
+                    io.flush();
+                }
+                io.addCopy(sender_addr, &reply, sizeof(reply));
+                digest_status = reply.status;
+                if (complete && !finished) {
+                    finished = true;
+                    io.setReceiveTimeout(DIGEST_LINGER_MS);
+                }
+                continue;
+            }
 
-        // Selective Repeat logic với negotiated window size
-        if (pkt_num >= expected_seq_num && pkt_num < expected_seq_num + negotiated_window) {
-            // Gửi ACK
-            AckPacket ack;
-            ack.ack_num = pkt_num;
-            sendto(sock, &ack, sizeof(ack), 0,
-                  (struct sockaddr*)&sender_addr, addr_len);
-            acks_sent++;
+            // Bỏ qua gói tin handshake/điều khiển nếu nhận được
+            if (recv_len == sizeof(HandshakePacket) || recv_len <= (ssize_t)header_size ||
+                isControlPacket(buffer, recv_len)) {
+                continue;
+            }
+
+            got_data = true;
+
+            // Parse header
+            PacketHeader* header = (PacketHeader*)buffer;
+            uint32_t pkt_num = header->pkt_num;
+
+            // Selective Repeat logic với negotiated window size
+            if (pkt_num >= expected_seq_num && pkt_num < expected_seq_num + negotiated_window) {
+                size_t offset = (size_t)(pkt_num - 1) * chunk_size;
+                size_t data_size = recv_len - header_size;
+                const char* payload = buffer + header_size;
+                bool in_file = pkt_num <= total_packets && data_size <= chunk_size && offset + data_size <= file_size;
+                bool is_new = in_file && !received_chunks.test(pkt_num);
+
+                // Chunk hỏng: không ghi, không ACK, báo sender gửi lại ngay
+                if (is_new && crc_mode &&
+                    dataPacketCrc(buffer, header_size, payload, data_size) != ((const CrcPacketHeader*)buffer)->crc) {
+                    corrupt_packets++;
+                    NackPacket nack;
+                    memset(&nack, 0, sizeof(nack));
+                    nack.marker = CTRL_MARKER;
+                    nack.type = CTRL_NACK;
+                    nack.pkt_num = pkt_num;
+                    io.addCopy(sender_addr, &nack, sizeof(nack));
+                    nacks_sent++;
+                    if (io.full()) {
+                        io.flush();
+                    }
+                    continue;
+                }
+
+                // block_size không khớp cách chia block (packet đã qua CRC: sender
+                // lỗi): không ghi, không ACK
+                uint32_t block_size = decompressor ? ((const CompressPacketHeader*)buffer)->block_size : 0;
+                if (is_new && decompressor && !decompressor->valid(pkt_num, block_size, data_size)) {
+                    invalid_packets++;
+                    continue;
+                }
+
+                // Chunk của block nén nằm chờ cả block tới rồi giải nén một lần;
+                // block nén bớt chunk thì các chunk không được gửi coi như đã nhận
+                uint32_t padding_from = 0;
+                uint32_t padding_to = 0;
+                bool packed = is_new && decompressor &&
+                              decompressor->add(pkt_num, block_size, payload, data_size, padding_from, padding_to);
+                for (uint32_t seq = padding_from; seq < padding_to; seq++) {
+                    acceptChunk(seq, 0);
+                }
+
+                // Ghi thẳng payload vào vị trí cuối cùng. Ring của luồng ghi chưa
+                // có chỗ thì bỏ packet và không ACK để sender gửi lại sau; packet
+                // XDP đã ACK thì không được bỏ, phải chờ luồng ghi
+                if (is_new && !packed && !sink.write(offset, payload, data_size)) {
+                    if (!io.acknowledged(i)) {
+                        sink_full_drops++;
+                        continue;
+                    }
+                    sink.waitForSpace(offset, data_size);
+                    sink.write(offset, payload, data_size);
+                }
+
+                // Gửi ACK từng packet (gom vào batch); chế độ SACK gửi một SACK cuối batch
+                if (!sack_mode && !io.acknowledged(i)) {
+                    AckPacket ack;
+                    ack.ack_num = pkt_num;
+                    io.addCopy(sender_addr, &ack, sizeof(ack));
+                    acks_sent++;
+                }
+
+                if (!in_file) {
+                    // Chunk nằm ngoài file - bỏ qua
+                } else if (is_new) {
+                    acceptChunk(pkt_num, data_size);
 
-            if (pkt_num == expected_seq_num) {
-                // Packet đúng thứ tự - LƯU VÀO MEMORY
-                size_t data_size = recv_len - HEADER_SIZE;
-                received_data.insert(received_data.end(), 
-                                    buffer + HEADER_SIZE, 
-                                    buffer + HEADER_SIZE + data_size);
-                packets_received++;
-                total_bytes_received += data_size;
-                expected_seq_num++;
-
-                // Kiểm tra buffer
-                while (receive_buffer.find(expected_seq_num) != receive_buffer.end()) {
-                    BufferedPacket& buffered = receive_buffer[expected_seq_num];
-                    received_data.insert(received_data.end(), 
-                                        buffered.data.begin(), 
-                                        buffered.data.end());
-                    packets_received++;
-                    total_bytes_received += buffered.data.size();
-                    receive_buffer.erase(expected_seq_num);
-                    expected_seq_num++;
-                }
-
-            } else if (pkt_num > expected_seq_num) {
-                // Packet đến sớm - buffer
-                if (receive_buffer.find(pkt_num) == receive_buffer.end()) {
-                    BufferedPacket buffered;
-                    buffered.data.resize(recv_len - HEADER_SIZE);
-                    memcpy(buffered.data.data(), buffer + HEADER_SIZE, recv_len - HEADER_SIZE);
-                    buffered.received = true;
-                    receive_buffer[pkt_num] = buffered;
-                    out_of_order_packets++;
+                    // Chunk này có thể là mảnh còn thiếu để giải block đang giữ repair
+                    if (fec_mode) {
+                        FecDecoder::Block* block = fec.pending(pkt_num);
+                        if (block != nullptr) {
+                            tryRecover(*block);
+                        }
+                    }
                 } else {
                     duplicate_packets++;
                 }
-            } else {
+
+            } else if (pkt_num < expected_seq_num) {
                 duplicate_packets++;
+                
+                if (!sack_mode && !io.acknowledged(i)) {
+                    AckPacket ack;
+                    ack.ack_num = pkt_num;
+                    io.addCopy(sender_addr, &ack, sizeof(ack));
+                    acks_sent++;
+                }
             }
 
-        } else if (pkt_num < expected_seq_num) {
-            duplicate_packets++;
-            
-            AckPacket ack;
-            ack.ack_num = pkt_num;
-            sendto(sock, &ack, sizeof(ack), 0,
-                  (struct sockaddr*)&sender_addr, addr_len);
+            if (io.full()) {
+                io.flush();
+            }
+        }
+
+        // Chế độ SACK: một SACK cho cả batch, thêm SACK cho các vùng packet nằm
+        // xa hơn SACK_BITS sau expected_seq_num
+        if (sack_mode && got_data) {
+            SackPacket sack;
+            uint32_t sack_base = expected_seq_num + 1;
+            buildSack(sack, expected_seq_num, sack_base, received_chunks);
+            io.addCopy(sender_addr, &sack, sizeof(sack));
             acks_sent++;
+
+            std::sort(far_packets.begin(), far_packets.end());
+            uint32_t covered_until = sack_base + SACK_BITS;
+            for (uint32_t pkt_num : far_packets) {
+                if (pkt_num < covered_until) {
+                    continue;
+                }
+                uint32_t region = sack_base + (pkt_num - sack_base) / SACK_BITS * SACK_BITS;
+                buildSack(sack, expected_seq_num, region, received_chunks);
+                if (io.full()) {
+                    io.flush();
+                }
+                io.addCopy(sender_addr, &sack, sizeof(sack));
+                acks_sent++;
+                covered_until = region + SACK_BITS;
+            }
+        }
+
+        io.flush();
+
+        if (got_data) {
+            last_packet_time = std::chrono::high_resolution_clock::now();
+        }
+
+        // Đã nhận đủ: chờ các block cuối giải xong thay vì đợi vòng nhận kế tiếp
+        if (decompressor && expected_seq_num > total_packets && written_seq_num <= total_packets) {
+            decompressor->drain();
+            advanceWritten();
         }
 
         // Hiển thị tiến trình
         auto now = std::chrono::high_resolution_clock::now();
         auto progress_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_progress_time);
-        if (progress_elapsed.count() >= 500) {
+        if (config.show_progress && progress_elapsed.count() >= 500) {
             std::cout << "\rĐã nhận: " << packets_received << " packets - "
                      << std::fixed << std::setprecision(2)
                      << total_bytes_received / 1024.0 / 1024.0 << " MB - "
-                     << "Buffered: " << receive_buffer.size() << std::flush;
+                     << "Buffered: " << buffered_packets << std::flush;
             last_progress_time = now;
         }
+
+        // Lưu (và msync phần vừa ghi) ở luồng nền, vòng nhận không phải chờ đĩa
+        if (checkpoint != nullptr && now - last_checkpoint_time >= std::chrono::milliseconds(CHECKPOINT_INTERVAL_MS)) {
+            config.checkpoint_writer->submit(*checkpoint, received_chunks.words());
+            last_checkpoint_time = now;
+        }
+    }
+    bool checkpoint_saved = checkpoint != nullptr && config.checkpoint_writer->save(*checkpoint, received_chunks.words());
+    if (decompressor) {
+        decompressor->drain();
+        advanceWritten();
     }
 
-    // Kết thúc
-    auto end_time = last_packet_time;
+    // Kết thúc (khi nén: tới lúc block cuối cùng giải xong, nếu muộn hơn packet cuối)
+    auto end_time = decompressor ? std::max(last_packet_time, written_time) : last_packet_time;
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    if (config.show_progress) {
+        std::cout << std::endl;
+    }
+
+    report << "=== KẾT QUẢ NHẬN (Selective Repeat) ===" << std::endl;
+    report << "Window size đã sử dụng: " << negotiated_window << std::endl;
+    report << "Tổng thời gian: " << std::fixed << std::setprecision(3) 
+              << duration.count() / 1000.0 << " giây" << std::endl;
+    report << "Packets đã nhận: " << packets_received << std::endl;
+    report << "Payload mỗi packet: " << chunk_size << " bytes (gói IP " << chunk_size + header_size + IP_UDP_HEADERS_SIZE
+           << " bytes)" << std::endl;
+    report << "Kiểu ACK: " << (sack_mode ? "cumulative + SACK" : "từng packet") << std::endl;
+    report << "ACKs đã gửi: " << acks_sent << std::endl;
+    report << "Batch size: " << batch_size << std::endl;
+    report << "Backend: " << io.name() << std::endl;
+    report << io.receiveCall() << ": " << io.receiveStats().calls << " lần gọi, "
+              << io.receiveStats().packets << " packets, "
+              << std::setprecision(2) << io.receiveStats().packetsPerCall() << " packets/lần, "
+              << "tối đa " << io.receiveStats().max_batch << std::endl;
+    report << io.sendCall() << " (ACK): " << io.sendStats().calls << " lần gọi, "
+              << io.sendStats().packets << " ACKs, "
+              << std::setprecision(2) << io.sendStats().packetsPerCall() << " ACKs/lần, "
+              << "tối đa " << io.sendStats().max_batch << std::endl;
+    io.printStats(report);
+    report << "Packets trùng lặp: " << duplicate_packets << std::endl;
+    if (crc_mode) {
+        report << "CRC32C (" << Crc32c::instance().kernel() << "): " << corrupt_packets << " packet hỏng, "
+               << nacks_sent << " NACK" << std::endl;
+        report << "Digest XXH64: " << std::hex << std::setw(16) << std::setfill('0') << digest.digest() << std::dec
+               << std::setfill(' ') << " (" << digest.size() << " bytes) - ";
+        if (digest_status == DIGEST_MATCH) {
+            report << "khớp với sender" << std::endl;
+        } else if (digest_status == DIGEST_MISMATCH) {
+            report << "KHÔNG KHỚP với sender" << std::endl;
+        } else if (digest_status == DIGEST_INCOMPLETE) {
+            report << "chưa nhận đủ dữ liệu" << std::endl;
+        } else {
+            report << "sender không gửi digest" << std::endl;
+        }
+    }
+    if (decompressor) {
+        BlockDecompressor::Stats stats = decompressor->stats();
+        report << "Giải nén " << compressCodecName(negotiated.codec) << ": " << stats.compressed_blocks
+               << " block nén, " << stats.raw_blocks << " block gửi nguyên, " << stats.failed_blocks << " lỗi, "
+               << invalid_packets << " packet sai block_size" << std::endl;
+        if (stats.failed_blocks > 0) {
+            report << "✗ Giải nén thất bại: dữ liệu từ byte "
+                   << std::min<uint64_t>((uint64_t)(written_seq_num - 1) * chunk_size, file_size)
+                   << " của đoạn không ghi được, truyền KHÔNG thành công" << std::endl;
+        }
+        report << "Tỷ lệ nén: " << std::setprecision(2)
+               << (stats.packed_bytes > 0 ? (double)stats.raw_bytes / stats.packed_bytes : 0)
+               << "x trên các block nén, CPU giải nén " << std::setprecision(3) << stats.cpu_seconds << " s trên "
+               << config.decompress_pool->size() << " luồng" << std::endl;
+    }
+    if (fec_mode) {
+        report << "FEC: " << repairs_received << " repair nhận được, " << chunks_recovered << " chunk dựng lại ("
+               << blocks_decoded << " block, GF(256) " << Gf256::instance().kernel() << ")" << std::endl;
+    }
+    if (checkpoint != nullptr) {
+        report << "Truyền tiếp: " << resumed_packets << "/" << total_packets << " chunk có sẵn từ checkpoint, ";
+        if (expected_seq_num > total_packets) {
+            report << "đã nhận đủ" << std::endl;
+        } else {
+            report << "checkpoint " << (checkpoint_saved ? "đã lưu ở " : "KHÔNG lưu được vào ") << checkpoint->path()
+                   << std::endl;
+        }
+    }
+    report << "Đích ghi: " << sink.name() << " - packets bỏ do ring ghi đầy: " << sink_full_drops << std::endl;
+    report << "Packets không theo thứ tự: " << out_of_order_packets << std::endl;
+    report << "Packets còn trong buffer: " << buffered_packets << std::endl;
+    report << "Tổng dữ liệu đã nhận: " << std::setprecision(2) 
+              << total_bytes_received / 1024.0 / 1024.0 << " MB" << std::endl;
+    report << "Tốc độ trung bình: " << std::setprecision(2) 
+              << (total_bytes_received / 1024.0 / 1024.0) / (duration.count() / 1000.0) 
+              << " MB/s" << std::endl;
+    report << "Tốc độ trung bình: " << std::setprecision(2) 
+              << (total_bytes_received * 8.0 / 1024.0 / 1024.0) / (duration.count() / 1000.0) 
+              << " Mbps" << std::endl;
+    uint64_t contiguous_size = std::min<uint64_t>((uint64_t)(written_seq_num - 1) * chunk_size, file_size);
+    if (decompressor) {
+        report << "Goodput (dữ liệu gốc): " << std::setprecision(2)
+               << (contiguous_size * 8.0 / 1024.0 / 1024.0) / (duration.count() / 1000.0) << " Mbps" << std::endl;
+    }
 
-    std::cout << "\n\nĐang ghi dữ liệu từ memory ra file..." << std::endl;
+    // Chỉ giữ phần dữ liệu liền mạch từ đầu đoạn
+    ReceiveResult result;
+    result.packets_received = packets_received;
+    result.bytes_received = total_bytes_received;
+    result.contiguous_size = contiguous_size;
+    result.digest_status = digest_status;
+    result.decompress_failed = decompressor && decompressor->failed();
+    result.start_time = start_time;
+    result.end_time = end_time;
+    return result;
+}
 
-    // GHI DỮ LIỆU TỪ MEMORY RA FILE (không tính vào thời gian đo)
-    std::ofstream file(output_file, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Không thể tạo file output: " << output_file << std::endl;
-        close(sock);
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <port> <output_file> [original_file] [--batch N] [--window N] [--no-sack] [--xdp-ack] [--mem-mb N] [--streams N] [--chunk N] [--resume] [--compress-threads N] "
+                  << PACKET_IO_USAGE << std::endl;
         return 1;
     }
+
+    int port = std::stoi(argv[1]);
+    const char* output_file = argv[2];
+    // File gốc chỉ để so kích thước; không có thì dựa vào digest (--crc ở sender)
+    int first_option = argc > 3 && strncmp(argv[3], "--", 2) != 0 ? 4 : 3;
+    const char* original_file = first_option == 4 ? argv[3] : nullptr;
+    // FEC và CRC luôn nhận được nếu sender bật (--fec, --crc ở sender)
+    HandshakeParams preferred = {DEFAULT_WINDOW_SIZE, FEATURE_SACK | FEATURE_FEC | FEATURE_CRC | FEATURE_COMPRESS,
+                                 MAX_CHUNK_SIZE, 0};
+    size_t batch_size = DEFAULT_BATCH_SIZE;
+    size_t memory_mb = 0;  // 0 = giữ cả file trong memory, ghi ra ở cuối
+    PacketIoConfig io_config;
+    uint32_t streams = 1;  // > 1: nhận song song, mỗi stream một socket (SO_REUSEPORT) và một luồng
+    bool resume_mode = false;  // Lưu checkpoint và truyền tiếp từ checkpoint có sẵn
+    unsigned decompress_threads = std::thread::hardware_concurrency();
+
+    for (int i = first_option; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--batch" && i + 1 < argc) {
+            batch_size = std::stoul(argv[++i]);
+        } else if (arg == "--no-sack") {
+            preferred.features &= ~FEATURE_SACK;
+        } else if (arg == "--xdp-ack") {
+            // Chương trình XDP chỉ trả được ACK từng packet (SACK cần trạng thái của receiver)
+            // và ACK trước khi receiver kịp kiểm tra CRC hay giải nén block
+            io_config.xdp_ack = true;
+            preferred.features &= ~(FEATURE_SACK | FEATURE_CRC | FEATURE_COMPRESS);
+        } else if (arg == "--mem-mb" && i + 1 < argc) {
+            memory_mb = std::stoul(argv[++i]);
+        } else if (arg == "--window" && i + 1 < argc) {
+            preferred.window = std::stoul(argv[++i]);
+        } else if (arg == "--streams" && i + 1 < argc) {
+            streams = std::stoul(argv[++i]);
+        } else if (arg == "--chunk" && i + 1 < argc) {
+            preferred.chunk_size = std::max<size_t>(1, std::min<size_t>(std::stoul(argv[++i]), MAX_CHUNK_SIZE));
+        } else if (arg == "--resume") {
+            // Checkpoint đánh dấu từng chunk nhận được, không theo block đã giải nén: không nhận nén
+            resume_mode = true;
+            preferred.features |= FEATURE_RESUME;
+            preferred.features &= ~FEATURE_COMPRESS;
+        } else if (arg == "--compress-threads" && i + 1 < argc) {
+            decompress_threads = std::stoul(argv[++i]);
+        } else if (parsePacketIoOption(argc, argv, i, io_config)) {
+            // --backend, --iface, --queue, --xdp-mode, --gso
+        } else {
+            std::cerr << "Tham số không hợp lệ: " << arg << std::endl;
+            return 1;
+        }
+    }
+    batch_size = std::max<size_t>(1, std::min<size_t>(batch_size, MAX_BATCH_SIZE));
+    preferred.window = std::max<uint32_t>(1, std::min<uint32_t>(preferred.window, MAX_SCALED_WINDOW));
+    streams = std::max<uint32_t>(1, std::min<uint32_t>(streams, MAX_STREAMS));
+    if (io_config.xdp_ack) {
+        // Chương trình XDP chỉ trả ACK cho packet vừa một bản ghi của ring buffer
+        preferred.chunk_size = std::min<uint16_t>(preferred.chunk_size, XDP_ACK_MAX_PAYLOAD - HEADER_SIZE);
+    }
+    if (streams > 1) {
+        if (memory_mb > 0) {
+            std::cerr << "--streams ghi thẳng vào file đã mmap, không dùng cùng --mem-mb" << std::endl;
+            return 1;
+        }
+        if (io_config.backend == "xdp") {
+            // Mỗi queue chỉ gắn được một AF_XDP socket
+            std::cerr << "--streams dùng UDP socket cho từng stream (không dùng --backend xdp)" << std::endl;
+            io_config.backend = "udp";
+        }
+        io_config.reuse_port = true;
+        preferred.features |= FEATURE_STREAMS;
+    }
+    if (resume_mode && memory_mb > 0) {
+        // Ring của luồng ghi chỉ đưa xuống đĩa phần liền mạch, chunk đến sớm sẽ mất khi bị ngắt
+        std::cerr << "--resume ghi thẳng vào file đã mmap, không dùng cùng --mem-mb" << std::endl;
+        return 1;
+    }
+    if (memory_mb > 0) {
+        // Packet đến sớm phải nằm gọn trong ring của luồng ghi (chừa nửa ring cho phần đang ghi)
+        uint32_t ring_window = std::max<uint64_t>(1, memory_mb * 1024 * 1024 / 2 / preferred.chunk_size);
+        preferred.window = std::min(preferred.window, ring_window);
+    }
     
-    file.write(received_data.data(), received_data.size());
-    file.close();
+    std::cout << "Sử dụng giao thức: Selective Repeat với Handshake (16-bit)" << std::endl;
+
+    // Kiểm tra file gốc
+    std::streamsize original_size = -1;
+    if (original_file != nullptr) {
+        std::ifstream orig_file(original_file, std::ios::binary | std::ios::ate);
+        if (!orig_file.is_open()) {
+            std::cerr << "Không thể mở file gốc: " << original_file << std::endl;
+            return 1;
+        }
+
+        original_size = orig_file.tellg();
+        orig_file.close();
+
+        std::cout << "Kích thước file gốc: " << std::fixed << std::setprecision(2)
+                  << original_size / 1024.0 / 1024.0 << " MB" << std::endl;
+    }
+
+    // Checkpoint của lần nhận trước (mỗi stream một file). File output phải còn
+    // nguyên kích thước cũ, nếu không dữ liệu trong đó không dùng được
+    std::vector<ResumeCheckpoint> checkpoints(resume_mode ? streams : 0);
+    for (uint32_t i = 0; i < checkpoints.size(); i++) {
+        ResumeCheckpoint& checkpoint = checkpoints[i];
+        if (!checkpoint.load(ResumeCheckpoint::pathFor(output_file, i, streams))) {
+            continue;
+        }
+        struct stat st;
+        if (stat(output_file, &st) < 0 || (uint64_t)st.st_size != checkpoint.fileSize()) {
+            std::cout << "Bỏ checkpoint " << checkpoint.path() << ": file output không còn như lúc lưu" << std::endl;
+            checkpoint.remove();
+            continue;
+        }
+        std::cout << "Checkpoint: " << checkpoint.path() << " (chunk " << checkpoint.chunkSize() << " bytes)" << std::endl;
+    }
+    if (resume_mode) {
+        // Không SA_RESTART: recvmmsg/poll đang chờ trả về ngay để lưu checkpoint
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = onInterrupt;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+    }
+
+    // Mỗi stream một socket bind cùng port (SO_REUSEPORT khi --streams > 1) và
+    // một luồng: chờ handshake, gắn socket với sender đó, nhận đoạn file của
+    // stream. Mọi socket phải có trước khi sender bắt tay stream đầu tiên.
+    struct Stream {
+        std::unique_ptr<PacketIo> io;
+        HandshakeParams negotiated;
+        std::unique_ptr<FileSink> range_sink;
+        ReceiveResult result;
+        bool received = false;
+        std::ostringstream report;
+        std::thread thread;
+    };
+    std::vector<Stream> stream_list(streams);
+    for (Stream& stream : stream_list) {
+        // Đường gửi/nhận: UDP socket bind vào port, hoặc AF_XDP socket với --backend xdp
+        // (batch I/O: nhận data theo batch, gom ACK gửi một lần)
+        stream.io = openPacketIo(io_config, port, nullptr, batch_size, preferred.chunk_size + HEADER_SIZE);
+        if (!stream.io) {
+            std::cerr << "Không thể tạo hoặc bind socket" << std::endl;
+            return 1;
+        }
+        stream.io->setReceiveTimeout(TIMEOUT_SEC * 1000);
+    }
+    // Chunk lớn nhất nhận được trên backend này (AF_XDP: một frame UMEM, MTU của interface)
+    preferred.chunk_size = std::min<size_t>(preferred.chunk_size, stream_list[0].io->maxPayload() - HEADER_SIZE);
+
+    std::cout << "Backend: " << stream_list[0].io->name() << std::endl;
+    std::cout << "Chunk size tối đa: " << preferred.chunk_size << " bytes" << std::endl;
+    std::cout << "Đang lắng nghe trên port " << port;
+    if (streams > 1) {
+        std::cout << " (" << streams << " stream)";
+    }
+    std::cout << "..." << std::endl;
+
+    // ĐÍCH GHI dùng chung, tạo ở handshake đầu tiên (theo kích thước sender báo):
+    // một stream thì cả file trong memory hoặc ring giới hạn --mem-mb với luồng
+    // ghi nền; nhiều stream thì cùng ghi vào một file mmap, mỗi stream một đoạn.
+    // Mỗi chunk được ghi thẳng vào vị trí (pkt_num - 1) * chunk_size của đoạn.
+    std::unique_ptr<FileSink> sink;
+    uint64_t output_size = 0;
+    std::unique_ptr<WorkerPool> decompress_pool;  // Tạo khi stream đầu tiên thỏa thuận nén
+    std::unique_ptr<CheckpointWriter> checkpoint_writer;  // --resume: một luồng lưu checkpoint cho sink
+    std::mutex sink_mutex;
+    std::atomic<uint32_t> handshakes(0);
+    std::atomic<uint32_t> expected_streams(streams);
+    std::atomic<bool> stop_waiting(false);
+    ReceiverConfig config;
+    config.batch_size = batch_size;
+    config.show_progress = streams == 1;
+    config.decompress_pool = nullptr;
+    config.checkpoint_writer = nullptr;
+
+    auto runStream = [&](Stream& stream) {
+        // Chờ handshake và thỏa thuận window size
+        struct sockaddr_in sender_addr;
+        if (!waitForHandshake(*stream.io, sender_addr, preferred, stream.negotiated,
+                              resume_mode ? &checkpoints : nullptr, streams > 1, &stop_waiting)) {
+            return;
+        }
+        HandshakeParams& negotiated = stream.negotiated;
+
+        // Kích thước file lấy từ handshake mở rộng; sender bản cũ không gửi thì dùng file gốc
+        if (negotiated.file_size == 0 && original_size < 0) {
+            std::cerr << "Sender không báo kích thước file, cần chỉ ra file gốc" << std::endl;
+            exit(1);
+        }
+        uint64_t file_size = negotiated.file_size > 0 ? negotiated.file_size : (uint64_t)original_size;
+        if (!(negotiated.features & FEATURE_STREAMS)) {
+            negotiated.range = StreamRange{0, file_size, 0, 1, 0};
+        }
+        if (negotiated.range.count != streams) {
+            std::cout << "Cảnh báo: sender dùng " << negotiated.range.count << " stream, receiver mở "
+                      << streams << " socket" << std::endl;
+        }
+        expected_streams = std::min<uint32_t>(streams, negotiated.range.count);
+        if (++handshakes >= expected_streams) {
+            stop_waiting = true;  // Socket còn lại không chờ thêm stream nào
+        }
+
+        FileSink* stream_sink;
+        {
+            std::lock_guard<std::mutex> lock(sink_mutex);
+            if (!sink) {
+                if (original_size >= 0 && file_size != (uint64_t)original_size) {
+                    std::cout << "Cảnh báo: sender báo kích thước file " << file_size
+                              << " bytes, khác file gốc " << original_size << " bytes" << std::endl;
+                }
+                if (streams > 1 || resume_mode) {
+                    std::unique_ptr<MmapFileSink> mmap_sink(new MmapFileSink());
+                    if (mmap_sink->open(output_file, file_size, resume_mode)) {
+                        sink.reset(mmap_sink.release());
+                    }
+                } else {
+                    sink = openFileSink(output_file, file_size, memory_mb * 1024 * 1024);
+                }
+                if (!sink) {
+                    std::cerr << "Không thể tạo file output: " << output_file << std::endl;
+                    exit(1);
+                }
+                output_size = file_size;
+                if (resume_mode) {
+                    checkpoint_writer.reset(new CheckpointWriter(*sink));
+                    config.checkpoint_writer = checkpoint_writer.get();
+                }
+                std::cout << "Đích ghi: " << sink->name();
+                if (memory_mb > 0) {
+                    std::cout << " (ring " << sink->capacity() / 1024 / 1024 << " MB)";
+                }
+                std::cout << std::endl;
+            }
+            if ((negotiated.features & FEATURE_COMPRESS) && !decompress_pool) {
+                decompress_pool.reset(new WorkerPool(decompress_threads));
+                config.decompress_pool = decompress_pool.get();
+                std::cout << "Giải nén trên " << decompress_pool->size() << " luồng" << std::endl;
+            }
+            stream_sink = sink.get();
+            if (negotiated.range.offset != 0 || negotiated.range.size != file_size) {
+                stream.range_sink.reset(new RangeFileSink(*sink, negotiated.range.offset));
+                stream_sink = stream.range_sink.get();
+            }
+        }
+
+        std::cout << "Sử dụng window size: " << negotiated.window << std::endl;
+        ResumeCheckpoint* checkpoint =
+            resume_mode ? &checkpoints[std::min<uint32_t>(negotiated.range.index, streams - 1)] : nullptr;
+        stream.result = receiveFile(*stream.io, sender_addr, negotiated, *stream_sink, config, stream.report,
+                                    checkpoint);
+        stream.received = true;
+    };
+
+    if (streams == 1) {
+        runStream(stream_list[0]);
+    } else {
+        for (Stream& stream : stream_list) {
+            stream.thread = std::thread(runStream, std::ref(stream));
+        }
+        for (Stream& stream : stream_list) {
+            stream.thread.join();
+        }
+    }
+    if (!sink) {
+        std::cerr << "Handshake thất bại!" << std::endl;
+        return 1;
+    }
+
+    std::cout << "\nĐang ghi nốt dữ liệu ra file..." << std::endl;
+
+    // GHI NỐT DỮ LIỆU RA FILE (không tính vào thời gian đo).
+    // Chỉ giữ phần dữ liệu liền mạch từ đầu file: nối các đoạn theo offset tới
+    // đoạn đầu tiên còn thiếu dữ liệu (hoặc không có stream nào nhận)
+    std::vector<const Stream*> received;
+    for (const Stream& stream : stream_list) {
+        if (stream.received) {
+            received.push_back(&stream);
+        }
+    }
+    std::sort(received.begin(), received.end(), [](const Stream* a, const Stream* b) {
+        return a->negotiated.range.offset < b->negotiated.range.offset;
+    });
+    uint64_t contiguous_size = 0;
+    for (const Stream* stream : received) {
+        if (stream->negotiated.range.offset != contiguous_size) {
+            break;
+        }
+        contiguous_size += stream->result.contiguous_size;
+        if (stream->result.contiguous_size < stream->negotiated.range.size) {
+            break;
+        }
+    }
+    // --resume: chưa nhận đủ thì giữ nguyên file (cả các chunk sau lỗ hổng) cho lần truyền tiếp
+    bool complete = contiguous_size == output_size;
+    checkpoint_writer.reset();  // Mọi stream đã lưu xong lần cuối, trước khi munmap
+    if (!sink->finish(resume_mode ? output_size : contiguous_size)) {
+        std::cerr << "Không thể ghi file output: " << output_file << std::endl;
+        return 1;
+    }
     std::cout << "Đã ghi xong file!" << std::endl;
+    if (resume_mode && complete) {
+        for (ResumeCheckpoint& checkpoint : checkpoints) {
+            checkpoint.remove();
+        }
+    } else if (resume_mode) {
+        std::cout << "Chưa nhận đủ: chạy lại receiver với --resume để nhận tiếp phần còn thiếu" << std::endl;
+    }
 
-    // Lấy kích thước file thực tế
+    // Lấy kích thước file thực tế (--resume: phần liền mạch từ đầu file)
     std::ifstream check_file(output_file, std::ios::binary | std::ios::ate);
-    std::streamsize received_size = check_file.tellg();
+    std::streamsize received_size = resume_mode ? (std::streamsize)contiguous_size : (std::streamsize)check_file.tellg();
     check_file.close();
 
     // Tính toán
     int64_t data_lost = original_size - received_size;
     double loss_rate = (original_size > 0) ? (data_lost * 100.0 / original_size) : 0;
 
-    std::cout << "\n=== KẾT QUẢ NHẬN (Selective Repeat) ===" << std::endl;
-    std::cout << "Window size đã sử dụng: " << negotiated_window << std::endl;
-    std::cout << "Tổng thời gian: " << std::fixed << std::setprecision(3) 
-              << duration.count() / 1000.0 << " giây" << std::endl;
-    std::cout << "Packets đã nhận: " << packets_received << std::endl;
-    std::cout << "ACKs đã gửi: " << acks_sent << std::endl;
-    std::cout << "Packets trùng lặp: " << duplicate_packets << std::endl;
-    std::cout << "Packets không theo thứ tự: " << out_of_order_packets << std::endl;
-    std::cout << "Packets còn trong buffer: " << receive_buffer.size() << std::endl;
-    std::cout << "Tổng dữ liệu đã nhận: " << std::setprecision(2) 
-              << total_bytes_received / 1024.0 / 1024.0 << " MB" << std::endl;
+    std::cout << std::endl;
+    for (const Stream& stream : stream_list) {
+        if (!stream.received) {
+            continue;
+        }
+        if (streams > 1) {
+            std::cout << "--- Stream " << stream.negotiated.range.index << " (byte " << stream.negotiated.range.offset
+                      << " - " << stream.negotiated.range.offset + stream.negotiated.range.size << ") ---" << std::endl;
+        }
+        std::cout << stream.report.str() << std::endl;
+    }
+
+    if (streams > 1) {
+        // Tổng hợp: thời gian từ stream bắt đầu sớm nhất tới stream nhận packet cuối muộn nhất
+        std::cout << "=== TỔNG HỢP " << received.size() << " STREAM ===" << std::endl;
+        auto first_start = received[0]->result.start_time;
+        auto last_end = received[0]->result.end_time;
+        uint64_t total_bytes_received = 0;
+        uint64_t total_contiguous = 0;
+        for (const Stream* stream : received) {
+            const ReceiveResult& result = stream->result;
+            double seconds = std::chrono::duration<double>(result.end_time - result.start_time).count();
+            std::cout << "Stream " << stream->negotiated.range.index << ": " << std::fixed << std::setprecision(2)
+                      << result.bytes_received / 1024.0 / 1024.0 << " MB, " << std::setprecision(3) << seconds
+                      << " giây, " << std::setprecision(2)
+                      << (seconds > 0 ? result.bytes_received * 8.0 / 1024.0 / 1024.0 / seconds : 0) << " Mbps" << std::endl;
+            first_start = std::min(first_start, result.start_time);
+            last_end = std::max(last_end, result.end_time);
+            total_bytes_received += result.bytes_received;
+            total_contiguous += result.contiguous_size;
+        }
+        double total_seconds = std::chrono::duration<double>(last_end - first_start).count();
+        std::cout << "Tổng thời gian: " << std::setprecision(3) << total_seconds << " giây" << std::endl;
+        std::cout << "Tổng dữ liệu đã nhận: " << std::setprecision(2) << total_bytes_received / 1024.0 / 1024.0 << " MB" << std::endl;
+        std::cout << "Tốc độ tổng: " << std::setprecision(2)
+                  << (total_seconds > 0 ? total_bytes_received * 8.0 / 1024.0 / 1024.0 / total_seconds : 0)
+                  << " Mbps" << std::endl;
+        if (received[0]->negotiated.features & FEATURE_COMPRESS) {
+            std::cout << "Goodput (dữ liệu gốc): " << std::setprecision(2)
+                      << (total_seconds > 0 ? total_contiguous * 8.0 / 1024.0 / 1024.0 / total_seconds : 0)
+                      << " Mbps" << std::endl;
+        }
+        if (received[0]->negotiated.features & FEATURE_CRC) {
+            size_t matched = std::count_if(received.begin(), received.end(), [](const Stream* stream) {
+                return stream->result.digest_status == DIGEST_MATCH;
+            });
+            std::cout << "Digest khớp: " << matched << "/" << received.size() << " stream" << std::endl;
+        }
+    }
+
+    size_t decompress_failures = std::count_if(received.begin(), received.end(), [](const Stream* stream) {
+        return stream->result.decompress_failed;
+    });
+    if (decompress_failures > 0) {
+        std::cout << "✗ Giải nén lỗi ở " << decompress_failures << "/" << received.size()
+                  << " stream: file chỉ giữ phần trước block lỗi" << std::endl;
+    }
+    // Đã thỏa thuận CRC thì digest phải khớp với sender (không khớp, thiếu dữ
+    // liệu hay sender không gửi digest đều là truyền lỗi)
+    size_t digest_failures = std::count_if(received.begin(), received.end(), [](const Stream* stream) {
+        return (stream->negotiated.features & FEATURE_CRC) && stream->result.digest_status != DIGEST_MATCH;
+    });
+    int exit_code = decompress_failures > 0 || digest_failures > 0 ? 1 : 0;
+
+    if (original_size < 0) {
+        std::cout << "File nhận được: " << std::fixed << std::setprecision(2) << received_size / 1024.0 / 1024.0 << " MB" << std::endl;
+        return exit_code;
+    }
+
     std::cout << "File gốc: " << std::setprecision(2) 
               << original_size / 1024.0 / 1024.0 << " MB" << std::endl;
     std::cout << "File nhận được: " << std::setprecision(2) 
@@ -370,13 +1309,6 @@ int main(int argc, char* argv[]) {
               << data_lost / 1024.0 / 1024.0 << " MB" << std::endl;
     std::cout << "Tỷ lệ mất dữ liệu: " << std::setprecision(4) 
               << loss_rate << "%" << std::endl;
-    std::cout << "Tốc độ trung bình: " << std::setprecision(2) 
-              << (total_bytes_received / 1024.0 / 1024.0) / (duration.count() / 1000.0) 
-              << " MB/s" << std::endl;
-    std::cout << "Tốc độ trung bình: " << std::setprecision(2) 
-              << (total_bytes_received * 8.0 / 1024.0 / 1024.0) / (duration.count() / 1000.0) 
-              << " Mbps" << std::endl;
 
-    close(sock);
-    return 0;
-}
\ No newline at end of file
+    return exit_code;
+}
@@ -0,0 +1,191 @@
+#ifndef BLOCK_COMPRESSOR_H
+#define BLOCK_COMPRESSOR_H
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <algorithm>
+
+#include "../common/compress.h"
+#include "../common/worker_pool.h"
+#include "file_source.h"
+
+#define COMPRESS_LOOKAHEAD_BLOCKS 2   // Block nén trước cho mỗi luồng nén, ngoài các block window chạm tới
+
+// Nén nguồn theo block (FEATURE_COMPRESS) trên WorkerPool, đi trước cửa sổ
+// gửi: block mới được nén ngay khi slot của nó rảnh. Bên ngoài là một
+// FileSource trả về đúng payload sẽ gửi của từng chunk: chunk của block nén
+// lấy từ bản nén, chunk của block gửi nguyên trỏ thẳng vào nguồn như khi không
+// nén. Người dùng chỉ đọc các chunk trong một window (không quá window chunk
+// tính từ chunk cũ nhất còn cần), nên slot của block cũ hơn được dùng lại.
+class BlockCompressor : public FileSource {
+public:
+    struct Stats {
+        uint64_t compressed_blocks = 0;   // Block gửi dạng nén
+        uint64_t skipped_blocks = 0;      // Mẫu không nén được, bỏ qua không nén cả block
+        uint64_t stored_blocks = 0;       // Nén cả block nhưng không bớt được chunk nào
+        uint64_t raw_bytes = 0;           // Dữ liệu gốc đã qua bộ nén
+        uint64_t wire_bytes = 0;          // Payload phải gửi cho chừng ấy dữ liệu gốc
+        double cpu_seconds = 0;           // Tổng thời gian của các luồng nén
+    };
+
+    BlockCompressor(FileSource& source, uint8_t codec, size_t chunk_size, uint32_t window, WorkerPool& pool)
+        : source_(source), codec_(codec), chunk_size_(chunk_size),
+          block_bytes_((uint64_t)chunk_size * COMPRESS_BLOCK_CHUNKS),
+          blocks_((source.size() + block_bytes_ - 1) / block_bytes_),
+          pool_(pool), next_block_(0), released_block_(0), pending_(0) {
+        // Mọi block một window chạm tới, thêm phần nén trước. Nguồn đọc theo
+        // luồng thì phần nén trước phải nằm trong ring đọc trước
+        window_slots_ = (window + COMPRESS_BLOCK_CHUNKS - 1) / COMPRESS_BLOCK_CHUNKS + 2;
+        uint64_t lookahead = COMPRESS_LOOKAHEAD_BLOCKS * pool.size();
+        if (source.capacity() != UINT64_MAX) {
+            uint64_t ring_blocks = source.capacity() / block_bytes_;
+            lookahead = std::min<uint64_t>(lookahead, ring_blocks > window_slots_ ? ring_blocks - window_slots_ : 0);
+        }
+        slot_count_ = std::max<uint64_t>(1, std::min<uint64_t>(window_slots_ + lookahead, blocks_));
+        slots_.reset(new Slot[slot_count_]);
+        for (size_t i = 0; i < slot_count_; i++) {
+            slots_[i].data.resize(block_bytes_ - chunk_size_);
+        }
+        schedule();
+    }
+
+    // Các việc nén đã gửi vào pool còn trỏ tới slot
+    ~BlockCompressor() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return pending_ == 0; });
+    }
+
+    const char* name() const override { return source_.name(); }
+    uint64_t size() const override { return source_.size(); }
+    uint64_t capacity() const override { return source_.capacity(); }
+
+    const char* data(uint64_t offset, size_t len) override {
+        uint64_t block = offset / block_bytes_;
+        const Slot& slot = ready(block);
+        if (slot.size == 0) {
+            return source_.data(offset, len);
+        }
+        return slot.data.data() + (offset - block * block_bytes_);
+    }
+
+    void release(uint64_t offset) override {
+        source_.release(offset);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            released_block_ = std::max(released_block_, offset / block_bytes_);
+        }
+        schedule();
+    }
+
+    // Số byte nén của block chứa pkt_num, 0 nếu block gửi nguyên
+    uint32_t blockSize(uint32_t pkt_num) { return ready((uint64_t)(pkt_num - 1) / COMPRESS_BLOCK_CHUNKS).size; }
+
+    // Payload của chunk pkt_num trên đường truyền; 0: chunk nằm sau phần nén
+    // của block, không phải gửi
+    size_t chunkLength(uint32_t pkt_num) {
+        uint64_t offset = (uint64_t)(pkt_num - 1) * chunk_size_;
+        uint64_t block = offset / block_bytes_;
+        uint32_t size = ready(block).size;
+        if (size == 0) {
+            return std::min<uint64_t>(chunk_size_, source_.size() - offset);
+        }
+        uint64_t position = offset - block * block_bytes_;
+        return position < size ? std::min<uint64_t>(chunk_size_, size - position) : 0;
+    }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> block{UINT64_MAX};  // Block đã nén xong nằm trong slot
+        uint32_t size = 0;                         // Số byte nén, 0: gửi nguyên
+        std::vector<char> data;
+    };
+
+    // Chờ block nén xong. Đọc tới block thì mọi block cách nó từ một window trở
+    // lên đã không còn cần, slot của chúng được dùng cho các block sau
+    const Slot& ready(uint64_t block) {
+        Slot& slot = slots_[block % slot_count_];
+        if (slot.block.load(std::memory_order_acquire) != block) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (block + 1 > window_slots_) {
+                    released_block_ = std::max(released_block_, block + 1 - window_slots_);
+                }
+            }
+            schedule();
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return slot.block.load(std::memory_order_acquire) == block; });
+        }
+        return slot;
+    }
+
+    void schedule() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (next_block_ < blocks_ && next_block_ < released_block_ + slot_count_) {
+            uint64_t block = next_block_++;
+            pending_++;
+            pool_.submit([this, block] { compress(block); });
+        }
+    }
+
+    // Chạy trên luồng của pool. Bản nén phải bớt được ít nhất một chunk, nếu
+    // không block được gửi nguyên
+    void compress(uint64_t block) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t offset = block * block_bytes_;
+        size_t len = std::min<uint64_t>(block_bytes_, source_.size() - offset);
+        const char* raw = source_.data(offset, len);
+        Slot& slot = slots_[block % slot_count_];
+        size_t chunks = (len + chunk_size_ - 1) / chunk_size_;
+        size_t capacity = (chunks - 1) * chunk_size_;
+        // Nguồn không đọc được: block coi như gửi nguyên, data() của nó trả về nullptr
+        bool sampled = raw != nullptr && capacity > 0 && blockLooksCompressible(codec_, raw, len);
+        size_t size = sampled ? compressBlock(codec_, raw, len, slot.data.data(), capacity) : 0;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.raw_bytes += len;
+            stats_.wire_bytes += size > 0 ? size : len;
+            stats_.cpu_seconds += seconds;
+            if (size > 0) {
+                stats_.compressed_blocks++;
+            } else if (sampled) {
+                stats_.stored_blocks++;
+            } else {
+                stats_.skipped_blocks++;
+            }
+            slot.size = size;
+            slot.block.store(block, std::memory_order_release);
+            pending_--;
+        }
+        cv_.notify_all();
+    }
+
+    FileSource& source_;
+    uint8_t codec_;
+    size_t chunk_size_;
+    uint64_t block_bytes_;
+    uint64_t blocks_;
+    WorkerPool& pool_;
+    uint64_t window_slots_;
+    size_t slot_count_;
+    std::unique_ptr<Slot[]> slots_;
+    uint64_t next_block_;       // Block kế tiếp chưa gửi vào pool
+    uint64_t released_block_;   // Các block trước block này không còn cần
+    uint64_t pending_;          // Việc nén chưa xong
+    Stats stats_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef CONGESTION_CONTROL_H
+#define CONGESTION_CONTROL_H
+
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <memory>
+#include <algorithm>
+
+#define INITIAL_CWND 10        // IW10 (RFC 6928)
+#define MIN_CWND 2
+
+// Thông tin một đợt ACK gửi cho bộ điều khiển tắc nghẽn
+struct AckSample {
+    std::chrono::high_resolution_clock::time_point now;
+    uint32_t newly_acked;       // Số packet vừa được ACK trong đợt này
+    uint64_t delivered;         // Tổng số packet đã ACK từ đầu phiên
+    uint64_t prior_delivered;   // Giá trị delivered lớn nhất lúc gửi các packet vừa ACK
+    uint64_t inflight;          // Số packet còn đang bay sau đợt ACK
+    double rtt_us;              // Mẫu RTT (0 nếu không có mẫu hợp lệ)
+    double delivery_rate;       // Tốc độ giao packet (packets/s), 0 nếu không có
+};
+
+// Giao diện điều khiển tắc nghẽn: quyết định cwnd (đơn vị packet). Sender giữ
+// số packet đang bay <= min(cwnd, window thỏa thuận với receiver).
+class CongestionControl {
+public:
+    virtual ~CongestionControl() {}
+    virtual const char* name() const = 0;
+    virtual void onAck(const AckSample& sample) = 0;
+    // Packet pkt_num bị coi là mất; timeout = true nếu phát hiện bằng RTO.
+    // next_seq_num là packet kế tiếp sẽ gửi, dùng để chỉ giảm cwnd một lần
+    // cho mỗi cửa sổ dữ liệu.
+    virtual void onLoss(uint32_t pkt_num, bool timeout, uint32_t next_seq_num) = 0;
+    virtual double cwnd() const = 0;
+    // Tốc độ gửi gợi ý (packets/s), 0 nếu thuật toán không có mô hình tốc độ
+    virtual double pacingRate() const { return 0; }
+};
+
+// Window cố định như trước đây: luôn dùng toàn bộ window thỏa thuận
+class FixedWindowControl : public CongestionControl {
+public:
+    explicit FixedWindowControl(uint32_t max_window) : window_(max_window) {}
+    const char* name() const override { return "fixed"; }
+    void onAck(const AckSample&) override {}
+    void onLoss(uint32_t, bool, uint32_t) override {}
+    double cwnd() const override { return window_; }
+
+private:
+    double window_;
+};
+
+// AIMD kiểu NewReno: slow start tới ssthresh, sau đó tăng ~1 packet mỗi RTT;
+// mất gói (fast retransmit) thì giảm một nửa, timeout thì về cwnd = 1.
+// Chỉ giảm một lần cho các packet gửi trước recovery_point.
+class NewRenoControl : public CongestionControl {
+public:
+    explicit NewRenoControl(uint32_t max_window)
+        : max_cwnd_(max_window), cwnd_(std::min<double>(INITIAL_CWND, max_window)),
+          ssthresh_(max_window), recovery_point_(0) {}
+
+    const char* name() const override { return "reno"; }
+
+    void onAck(const AckSample& sample) override {
+        if (cwnd_ < ssthresh_) {
+            cwnd_ += sample.newly_acked;                  // Slow start
+        } else {
+            cwnd_ += (double)sample.newly_acked / cwnd_;  // Congestion avoidance
+        }
+        cwnd_ = std::min(cwnd_, max_cwnd_);
+    }
+
+    void onLoss(uint32_t pkt_num, bool timeout, uint32_t next_seq_num) override {
+        if (pkt_num < recovery_point_) {
+            return;  // Cùng một đợt mất gói đã giảm cwnd rồi
+        }
+        recovery_point_ = next_seq_num;
+        ssthresh_ = std::max<double>(cwnd_ / 2, MIN_CWND);
+        cwnd_ = timeout ? 1 : ssthresh_;
+    }
+
+    double cwnd() const override { return cwnd_; }
+
+private:
+    double max_cwnd_;
+    double cwnd_;
+    double ssthresh_;
+    uint32_t recovery_point_;
+};
+
+// Điều khiển dựa trên độ trễ kiểu BBR: ước lượng băng thông nút cổ chai
+// (max delivery rate trong ~10 vòng RTT) và min RTT (trong 10 s), đặt
+// cwnd = cwnd_gain * BDP. Các pha: STARTUP (gain 2.89 tới khi băng thông
+// không tăng 25% trong 3 vòng) -> DRAIN -> PROBE_BW (chu kỳ gain 1.25/0.75/1...).
+class BbrLikeControl : public CongestionControl {
+public:
+    explicit BbrLikeControl(uint32_t max_window)
+        : max_cwnd_(max_window), cwnd_(std::min<double>(INITIAL_CWND, max_window)),
+          state_(STARTUP), pacing_gain_(HIGH_GAIN), round_count_(0), next_round_delivered_(0),
+          full_bw_(0), full_bw_rounds_(0), min_rtt_us_(0), cycle_index_(0),
+          loss_round_(false), bw_filter_{}, bw_rounds_{} {}
+
+    const char* name() const override { return "bbr"; }
+
+    void onAck(const AckSample& sample) override {
+        // Đếm vòng RTT theo số packet đã giao
+        bool round_start = false;
+        if (sample.prior_delivered >= next_round_delivered_) {
+            next_round_delivered_ = sample.delivered;
+            round_count_++;
+            round_start = true;
+            loss_round_ = false;
+        }
+
+        if (sample.delivery_rate > 0) {
+            updateBandwidth(sample.delivery_rate);
+        }
+        if (sample.rtt_us > 0) {
+            if (min_rtt_us_ == 0 || sample.rtt_us <= min_rtt_us_ ||
+                sample.now - min_rtt_stamp_ > std::chrono::seconds(10)) {
+                min_rtt_us_ = sample.rtt_us;
+                min_rtt_stamp_ = sample.now;
+            }
+        }
+
+        if (round_start) {
+            updateState(sample);
+        }
+
+        double bdp = bandwidth() * min_rtt_us_ / 1e6;
+        if (bdp > 0 && !loss_round_) {
+            double gain = state_ == STARTUP ? HIGH_GAIN : CWND_GAIN;
+            cwnd_ = std::max<double>(gain * bdp, 4);
+        } else if (bdp <= 0) {
+            cwnd_ += sample.newly_acked;  // Chưa có mô hình: tăng như slow start
+        }
+        cwnd_ = std::min(cwnd_, max_cwnd_);
+    }
+
+    void onLoss(uint32_t, bool timeout, uint32_t) override {
+        // Mô hình không dựa vào mất gói; chỉ RTO mới thu nhỏ cwnd tới hết vòng RTT
+        if (timeout && !loss_round_) {
+            loss_round_ = true;
+            cwnd_ = 4;
+        }
+    }
+
+    double cwnd() const override { return cwnd_; }
+
+    double pacingRate() const override {
+        return pacing_gain_ * bandwidth();
+    }
+
+private:
+    enum State { STARTUP, DRAIN, PROBE_BW };
+    static constexpr double HIGH_GAIN = 2.885;  // 2 / ln(2)
+    static constexpr double CWND_GAIN = 2.0;
+    static const int BW_FILTER_ROUNDS = 10;
+
+    double bandwidth() const {
+        double bw = 0;
+        for (int i = 0; i < BW_FILTER_ROUNDS; i++) {
+            if (round_count_ - bw_rounds_[i] < BW_FILTER_ROUNDS) {
+                bw = std::max(bw, bw_filter_[i]);
+            }
+        }
+        return bw;
+    }
+
+    // Cửa sổ max theo vòng RTT: mỗi ô giữ max của một vòng
+    void updateBandwidth(double rate) {
+        int i = round_count_ % BW_FILTER_ROUNDS;
+        if (bw_rounds_[i] != round_count_) {
+            bw_rounds_[i] = round_count_;
+            bw_filter_[i] = 0;
+        }
+        bw_filter_[i] = std::max(bw_filter_[i], rate);
+    }
+
+    void updateState(const AckSample& sample) {
+        double bw = bandwidth();
+        switch (state_) {
+        case STARTUP:
+            if (bw >= full_bw_ * 1.25) {
+                full_bw_ = bw;
+                full_bw_rounds_ = 0;
+            } else if (++full_bw_rounds_ >= 3) {
+                state_ = DRAIN;
+                pacing_gain_ = 1.0 / HIGH_GAIN;
+            }
+            break;
+        case DRAIN:
+            if (sample.inflight <= bw * min_rtt_us_ / 1e6) {
+                state_ = PROBE_BW;
+                cycle_index_ = 0;
+                pacing_gain_ = PROBE_GAINS[0];
+            }
+            break;
+        case PROBE_BW:
+            cycle_index_ = (cycle_index_ + 1) % 8;
+            pacing_gain_ = PROBE_GAINS[cycle_index_];
+            break;
+        }
+    }
+
+    static constexpr double PROBE_GAINS[8] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+
+    double max_cwnd_;
+    double cwnd_;
+    State state_;
+    double pacing_gain_;
+    uint64_t round_count_;
+    uint64_t next_round_delivered_;
+    double full_bw_;
+    int full_bw_rounds_;
+    double min_rtt_us_;
+    std::chrono::high_resolution_clock::time_point min_rtt_stamp_;
+    int cycle_index_;
+    bool loss_round_;
+    double bw_filter_[BW_FILTER_ROUNDS];
+    uint64_t bw_rounds_[BW_FILTER_ROUNDS];
+};
+
+// Tạo bộ điều khiển theo tên (--cc), nullptr nếu tên không hợp lệ
+inline std::unique_ptr<CongestionControl> createCongestionControl(const std::string& name, uint32_t max_window) {
+    if (name == "reno") {
+        return std::unique_ptr<CongestionControl>(new NewRenoControl(max_window));
+    }
+    if (name == "bbr") {
+        return std::unique_ptr<CongestionControl>(new BbrLikeControl(max_window));
+    }
+    if (name == "fixed") {
+        return std::unique_ptr<CongestionControl>(new FixedWindowControl(max_window));
+    }
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef FILE_SOURCE_H
+#define FILE_SOURCE_H
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../common/mirror_ring.h"
+
+#define STREAM_READ_BLOCK (1024 * 1024)   // Mỗi lần pread của luồng I/O
+#define MMAP_CHECK_BLOCK (4 * 1024 * 1024) // Đoạn mmap nạp trước một lần khi chạm tới đầu tiên
+#define MMAP_RESTAT_MS 100                 // Chu kỳ fstat lại kích thước file nguồn mmap
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22              // Linux 5.14+, header cũ chưa có
+#endif
+
+// Nguồn dữ liệu cho sender: trả về con trỏ tới một đoạn của file theo offset,
+// để payload được gửi thẳng từ đó (iovec/sendto) mà không copy thêm.
+class FileSource {
+public:
+    virtual ~FileSource() {}
+    virtual const char* name() const = 0;
+    virtual uint64_t size() const = 0;
+    // len byte tại offset; con trỏ hợp lệ cho tới khi release() vượt qua offset.
+    // nullptr nếu không đọc được (lỗi I/O, file bị cắt ngắn giữa chừng): người
+    // gửi dừng truyền và báo lỗi
+    virtual const char* data(uint64_t offset, size_t len) = 0;
+    // Sender không cần các byte trước offset nữa (đã được ACK)
+    virtual void release(uint64_t offset) { (void)offset; }
+    // Số byte chưa release tối đa giữ được cùng lúc (window phải nằm gọn trong đó)
+    virtual uint64_t capacity() const { return UINT64_MAX; }
+};
+
+// mmap toàn bộ file (chỉ đọc). Dữ liệu nằm trong page cache dùng chung, không
+// phải cấp phát và đọc trước cả file: truyền bắt đầu ngay, page được nạp khi
+// chạm tới, MADV_SEQUENTIAL/MADV_WILLNEED cho kernel đọc trước.
+// Chạm vào trang sau EOF (file bị cắt ngắn) hay trang nạp lỗi sẽ gây SIGBUS,
+// nên data() trả về nullptr cho phần sau kích thước fstat gần nhất (fstat lại
+// mỗi MMAP_RESTAT_MS), và lần đầu chạm tới mỗi đoạn MMAP_CHECK_BLOCK thì nạp
+// trước cả đoạn bằng MADV_POPULATE_READ (lỗi trả về thay vì SIGBUS). File bị
+// cắt giữa hai lần fstat vẫn có thể SIGBUS khi tính CRC/nén phần vừa mất.
+// data() gọi đồng thời được (nhiều stream qua RangeFileSource).
+class MmapFileSource : public FileSource {
+public:
+    MmapFileSource() : fd_(-1), size_(0), map_(nullptr), stat_size_(0), stat_time_ns_(0) {}
+
+    ~MmapFileSource() override {
+        if (map_ != nullptr) {
+            munmap(map_, size_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool open(const char* path) {
+        fd_ = ::open(path, O_RDONLY);
+        if (fd_ < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd_, &st) < 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        size_ = st.st_size;
+        stat_size_.store(size_, std::memory_order_relaxed);
+        stat_time_ns_.store(nowNs(), std::memory_order_relaxed);
+        if (size_ == 0) {
+            return true;  // mmap không nhận độ dài 0
+        }
+
+        void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        map_ = (char*)map;
+        madvise(map_, size_, MADV_SEQUENTIAL);
+        madvise(map_, size_, MADV_WILLNEED);
+        blocks_.reset(new std::atomic<uint8_t>[(size_ + MMAP_CHECK_BLOCK - 1) / MMAP_CHECK_BLOCK]());
+        return true;
+    }
+
+    const char* name() const override { return "mmap"; }
+    uint64_t size() const override { return size_; }
+
+    const char* data(uint64_t offset, size_t len) override {
+        if (len == 0) {
+            return map_ + offset;
+        }
+        int64_t now = nowNs();
+        if (now - stat_time_ns_.load(std::memory_order_relaxed) >= (int64_t)MMAP_RESTAT_MS * 1000000) {
+            stat_time_ns_.store(now, std::memory_order_relaxed);
+            restat();
+        }
+        if (offset + len > stat_size_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        uint64_t last = (offset + len - 1) / MMAP_CHECK_BLOCK;
+        for (uint64_t block = offset / MMAP_CHECK_BLOCK; block <= last; block++) {
+            uint8_t state = blocks_[block].load(std::memory_order_acquire);
+            if (state == BLOCK_UNCHECKED) {
+                state = checkBlock(block);
+                blocks_[block].store(state, std::memory_order_release);
+            }
+            if (state == BLOCK_FAILED) {
+                return nullptr;
+            }
+        }
+        return map_ + offset;
+    }
+
+private:
+    enum : uint8_t { BLOCK_UNCHECKED = 0, BLOCK_OK = 1, BLOCK_FAILED = 2 };
+
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Kích thước chỉ giảm: file dài thêm thì vẫn chỉ gửi size_ byte đã mmap
+    void restat() {
+        struct stat st;
+        uint64_t size = fstat(fd_, &st) < 0 ? 0 : std::min<uint64_t>(size_, st.st_size);
+        uint64_t current = stat_size_.load(std::memory_order_relaxed);
+        while (size < current && !stat_size_.compare_exchange_weak(current, size, std::memory_order_release)) {
+        }
+    }
+
+    // File còn đủ dài và các trang của đoạn nạp được. Hai stream cùng kiểm tra
+    // một đoạn cũng không sao, kết quả như nhau.
+    uint8_t checkBlock(uint64_t block) {
+        uint64_t start = block * MMAP_CHECK_BLOCK;
+        uint64_t end = std::min<uint64_t>(size_, start + MMAP_CHECK_BLOCK);
+        restat();
+        if (stat_size_.load(std::memory_order_acquire) < end) {
+            return BLOCK_FAILED;
+        }
+        // Kernel cũ không có MADV_POPULATE_READ (EINVAL): chỉ dựa vào fstat
+        if (madvise(map_ + start, end - start, MADV_POPULATE_READ) < 0 && errno != EINVAL) {
+            return BLOCK_FAILED;
+        }
+        return BLOCK_OK;
+    }
+
+    int fd_;
+    uint64_t size_;
+    char* map_;
+    std::unique_ptr<std::atomic<uint8_t>[]> blocks_;   // BLOCK_* của từng đoạn MMAP_CHECK_BLOCK
+    std::atomic<uint64_t> stat_size_;                  // Kích thước file theo lần fstat gần nhất
+    std::atomic<int64_t> stat_time_ns_;                // Thời điểm (steady_clock) của lần fstat đó
+};
+
+// Đọc file theo luồng cho file lớn hơn RAM: luồng I/O riêng pread trước vào
+// ring cố định memory_bytes, sender trả chỗ bằng release() khi dữ liệu đã
+// được ACK. Bộ nhớ dùng không phụ thuộc kích thước file; data() chỉ chờ khi
+// luồng I/O chưa đọc tới, và trả về nullptr khi luồng I/O đã dừng vì lỗi
+// đọc. Người dùng phải giữ phần chưa release (window) nhỏ hơn ring, nếu không
+// data() sẽ chờ mãi.
+class StreamingFileSource : public FileSource {
+public:
+    StreamingFileSource() : fd_(-1), size_(0), loaded_(0), released_(0), stop_(false), error_(false) {}
+
+    ~StreamingFileSource() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        if (reader_.joinable()) {
+            reader_.join();
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool open(const char* path, size_t memory_bytes) {
+        fd_ = ::open(path, O_RDONLY);
+        if (fd_ < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd_, &st) < 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        size_ = st.st_size;
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        if (!ring_.create(std::max<size_t>(memory_bytes, STREAM_READ_BLOCK))) {
+            return false;
+        }
+        reader_ = std::thread(&StreamingFileSource::readLoop, this);
+        return true;
+    }
+
+    const char* name() const override { return "stream"; }
+    uint64_t size() const override { return size_; }
+    uint64_t capacity() const override { return ring_.size(); }
+
+    const char* data(uint64_t offset, size_t len) override {
+        uint64_t end = offset + len;
+        if (loaded_.load(std::memory_order_acquire) < end) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return error_ || loaded_.load(std::memory_order_acquire) >= end; });
+            if (loaded_.load(std::memory_order_acquire) < end) {
+                return nullptr;
+            }
+        }
+        return ring_.at(offset);
+    }
+
+    void release(uint64_t offset) override {
+        if (offset <= released_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            released_.store(offset, std::memory_order_release);
+        }
+        cv_.notify_all();
+    }
+
+private:
+    void readLoop() {
+        while (true) {
+            uint64_t loaded = loaded_.load(std::memory_order_relaxed);
+            if (loaded >= size_) {
+                return;
+            }
+
+            uint64_t limit;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&] {
+                    return stop_ || loaded < released_.load(std::memory_order_acquire) + ring_.size();
+                });
+                if (stop_) {
+                    return;
+                }
+                limit = released_.load(std::memory_order_acquire) + ring_.size();
+            }
+
+            size_t n = std::min<uint64_t>({(uint64_t)STREAM_READ_BLOCK, limit - loaded, size_ - loaded});
+            ssize_t r = pread(fd_, ring_.at(loaded), n, loaded);
+            if (r <= 0) {
+                // Lỗi đọc hoặc file bị cắt ngắn: data() của phần chưa đọc trả về nullptr
+                std::lock_guard<std::mutex> lock(mutex_);
+                error_ = true;
+                cv_.notify_all();
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                loaded_.store(loaded + r, std::memory_order_release);
+            }
+            cv_.notify_all();
+        }
+    }
+
+    int fd_;
+    uint64_t size_;
+    MirrorRing ring_;
+    std::atomic<uint64_t> loaded_;     // Đã đọc vào ring tới offset này
+    std::atomic<uint64_t> released_;   // Sender không cần dữ liệu trước offset này nữa
+    bool stop_;
+    bool error_;                       // Luồng I/O dừng vì lỗi đọc
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread reader_;
+};
+
+// Đoạn [offset, offset + size) của một nguồn khác, cho từng stream khi truyền
+// song song. Nguồn gốc phải cho đọc đồng thời (mmap), offset tính từ đầu đoạn.
+class RangeFileSource : public FileSource {
+public:
+    RangeFileSource(FileSource& base, uint64_t offset, uint64_t size) : base_(base), offset_(offset), size_(size) {}
+
+    const char* name() const override { return base_.name(); }
+    uint64_t size() const override { return size_; }
+    const char* data(uint64_t offset, size_t len) override { return base_.data(offset_ + offset, len); }
+
+private:
+    FileSource& base_;
+    uint64_t offset_;
+    uint64_t size_;
+};
+
+// Mở file nguồn, nullptr nếu không mở được. memory_bytes = 0: mmap cả file;
+// > 0: đọc theo luồng với ring giới hạn memory_bytes.
+inline std::unique_ptr<FileSource> openFileSource(const char* path, size_t memory_bytes = 0) {
+    if (memory_bytes > 0) {
+        std::unique_ptr<StreamingFileSource> source(new StreamingFileSource());
+        if (!source->open(path, memory_bytes)) {
+            return nullptr;
+        }
+        return std::unique_ptr<FileSource>(source.release());
+    }
+
+    std::unique_ptr<MmapFileSource> source(new MmapFileSource());
+    if (!source->open(path)) {
+        return nullptr;
+    }
+    return std::unique_ptr<FileSource>(source.release());
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef LOSS_DETECTOR_H
+#define LOSS_DETECTOR_H
+
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <deque>
+
+#define DUPTHRESH 3              // Số packet phía sau đã được ACK để coi lỗ hổng là mất (FACK)
+#define REORDER_WINDOW_DIV 4     // Cửa sổ reordering của RACK = min RTT / 4
+
+// Phát hiện mất gói từ ACK của các packet phía sau, không chờ RTO:
+//  - FACK: đã có ít nhất DUPTHRESH packet có số thứ tự lớn hơn được ACK
+//  - RACK: một packet gửi SAU nó đã được ACK và nó đã bay quá
+//    RTT của packet đó + reordering window
+// Cả hai đều yêu cầu có packet gửi sau được ACK, nên packet vừa gửi lại
+// (send_time mới) không bị đánh dấu mất lần nữa cho tới khi dữ liệu gửi sau
+// lần gửi lại đó được ACK.
+class LossDetector {
+public:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    LossDetector() : highest_acked_(0), rack_rtt_(0), has_rack_(false) {}
+
+    // Gọi cho mỗi packet vừa được ACK
+    void onAck(uint32_t pkt_num, Clock::time_point send_time, Clock::time_point ack_time,
+               bool retransmitted, double min_rtt_us) {
+        highest_acked_ = std::max(highest_acked_, pkt_num);
+
+        // ACK của packet gửi lại mà tới quá sớm có thể là ACK cho lần gửi trước
+        auto rtt = ack_time - send_time;
+        if (retransmitted && std::chrono::duration<double, std::micro>(rtt).count() < min_rtt_us) {
+            return;
+        }
+        if (!has_rack_ || send_time >= rack_xmit_time_) {
+            rack_xmit_time_ = send_time;
+            rack_rtt_ = rtt;
+            has_rack_ = true;
+        }
+    }
+
+    uint32_t highestAcked() const { return highest_acked_; }
+
+    bool isLost(uint32_t pkt_num, Clock::time_point send_time, Clock::time_point now, double min_rtt_us) const {
+        if (!has_rack_ || send_time >= rack_xmit_time_) {
+            return false;  // Chưa có packet nào gửi sau nó được ACK
+        }
+        if (highest_acked_ >= pkt_num + DUPTHRESH) {
+            return true;
+        }
+        auto reorder_window = std::chrono::nanoseconds((int64_t)(min_rtt_us * 1000 / REORDER_WINDOW_DIV));
+        return now - send_time >= rack_rtt_ + reorder_window;
+    }
+
+private:
+    uint32_t highest_acked_;
+    Clock::time_point rack_xmit_time_;
+    Clock::duration rack_rtt_;
+    bool has_rack_;
+};
+
+// Packet cần xét cho fast retransmit, để mỗi batch ACK không phải quét lại
+// cả window từ base tới packet cao nhất đã ACK:
+//  - holes: lỗ hổng (chưa ACK) lộ ra khi packet cao nhất được ACK tăng, theo
+//    pkt_num, cũng là thứ tự gửi lần đầu
+//  - retransmitted: packet vừa gửi lại, theo thời điểm gửi lại
+// Trong mỗi hàng, packet phía trước chưa bị coi là mất thì packet phía sau
+// (cao hơn hoặc gửi muộn hơn) cũng chưa, nên scan() dừng ở mục đầu tiên chưa
+// quyết được: mỗi mục chỉ được xét thêm một lần mỗi batch ACK.
+class LossCandidates {
+public:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    struct Entry {
+        uint32_t pkt_num;
+        Clock::time_point send_time;   // Lần gửi mà mục này theo dõi
+    };
+
+    LossCandidates() : next_hole_(1) {}
+
+    // Packet từ lần gọi trước tới end (không gồm end) đã nằm dưới packet cao
+    // nhất được ACK: thêm những packet chưa ACK vào holes
+    template <typename Unacked>
+    void discover(uint32_t base, uint32_t end, Unacked unacked) {
+        for (uint32_t pkt_num = std::max(next_hole_, base); pkt_num < end; pkt_num++) {
+            Clock::time_point send_time;
+            if (unacked(pkt_num, send_time)) {
+                holes_.push_back(Entry{pkt_num, send_time});
+            }
+        }
+        next_hole_ = std::max(next_hole_, end);
+    }
+
+    void addRetransmit(uint32_t pkt_num, Clock::time_point send_time) {
+        retransmitted_.push_back(Entry{pkt_num, send_time});
+    }
+
+    // resolve(entry): true nếu mục đã xong (đã ACK, đã gửi lại, hoặc vừa được
+    // gửi lại vì mất), false nếu chưa quyết được và phải chờ batch ACK sau
+    template <typename Resolve>
+    void scan(Resolve resolve) {
+        scanQueue(holes_, resolve);
+        scanQueue(retransmitted_, resolve);
+    }
+
+private:
+    template <typename Resolve>
+    static void scanQueue(std::deque<Entry>& queue, Resolve& resolve) {
+        while (!queue.empty()) {
+            Entry entry = queue.front();  // resolve có thể thêm mục mới vào cuối hàng
+            if (!resolve(entry)) {
+                break;
+            }
+            queue.pop_front();
+        }
+    }
+
+    uint32_t next_hole_;                 // Packet đầu tiên chưa qua discover()
+    std::deque<Entry> holes_;
+    std::deque<Entry> retransmitted_;
+};
+
+#endif
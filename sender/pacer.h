@@ -0,0 +1,140 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <time.h>
+#include <sys/prctl.h>
+
+#define PACING_BURST_US 100            // Bucket chứa tối đa lượng token của 100 µs
+#define PACING_MIN_BURST_BYTES 3000    // Nhưng luôn đủ cho ~2 packet
+#define PACING_SPIN_NS 20000           // 20 µs cuối của mỗi lần chờ thì spin thay vì ngủ
+
+// Giảm timer slack của tiến trình (mặc định 50 µs) để nanosleep/ppoll thức
+// dậy đúng lúc; khoảng cách giữa các packet khi pacing chỉ vài µs.
+inline void setFineTimerSlack() {
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+}
+
+// Token bucket độ phân giải nano giây để dàn đều packet theo tốc độ mục tiêu.
+// Token (byte) nạp liên tục theo rate, bucket giới hạn burst ở PACING_BURST_US.
+// Được gửi khi token >= 0; mỗi lần gửi trừ đúng số byte nên token có thể âm
+// (packet lớn hơn burst vẫn đi được, packet sau chờ bù lại). rate = 0 là không pacing.
+class Pacer {
+public:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    Pacer() : rate_(0), tokens_(0), started_(false), bytes_(0), waits_(0),
+              target_integral_(0), paced_seconds_(0) {}
+
+    // Tốc độ mục tiêu tính bằng byte/s (0 = không giới hạn)
+    void setRate(double bytes_per_sec, Clock::time_point now) {
+        refill(now);
+        rate_ = std::max(bytes_per_sec, 0.0);
+        tokens_ = std::min(tokens_, burst());
+    }
+
+    double rate() const { return rate_; }
+    bool enabled() const { return rate_ > 0; }
+
+    bool ready(Clock::time_point now) {
+        refill(now);
+        return rate_ <= 0 || tokens_ >= 0;
+    }
+
+    // Thời điểm sớm nhất được gửi packet tiếp theo
+    Clock::time_point readyTime(Clock::time_point now) {
+        refill(now);
+        if (rate_ <= 0 || tokens_ >= 0) {
+            return now;
+        }
+        return now + std::chrono::nanoseconds((int64_t)std::ceil(-tokens_ / rate_ * 1e9));
+    }
+
+    void consume(Clock::time_point now, size_t bytes) {
+        refill(now);
+        if (!started_) {
+            started_ = true;
+            first_send_ = now;
+        }
+        last_send_ = now;
+        bytes_ += bytes;
+        if (rate_ > 0) {
+            tokens_ -= bytes;
+        }
+    }
+
+    // Chờ tới khi được gửi: ngủ bằng clock_nanosleep, spin đoạn cuối cho chính xác
+    void wait() {
+        Clock::time_point now = Clock::now();
+        Clock::time_point target = readyTime(now);
+        if (target <= now) {
+            return;
+        }
+        waits_++;
+
+        auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(target - now);
+        if (remaining.count() > PACING_SPIN_NS) {
+            int64_t sleep_ns = remaining.count() - PACING_SPIN_NS;
+            struct timespec ts;
+            ts.tv_sec = sleep_ns / 1000000000;
+            ts.tv_nsec = sleep_ns % 1000000000;
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, nullptr);
+        }
+        while (Clock::now() < target) {
+        }
+    }
+
+    void countWait() { waits_++; }
+
+    uint64_t waits() const { return waits_; }
+    uint64_t bytes() const { return bytes_; }
+
+    // Tốc độ thực tế (byte/s) giữa packet đầu và packet cuối
+    double achievedRate() const {
+        double seconds = std::chrono::duration<double>(last_send_ - first_send_).count();
+        return seconds > 0 ? bytes_ / seconds : 0;
+    }
+
+    // Tốc độ mục tiêu trung bình theo thời gian (chỉ tính lúc có pacing)
+    double averageTargetRate() const {
+        return paced_seconds_ > 0 ? target_integral_ / paced_seconds_ : 0;
+    }
+
+private:
+    double burst() const {
+        return std::max(rate_ * PACING_BURST_US / 1e6, (double)PACING_MIN_BURST_BYTES);
+    }
+
+    void refill(Clock::time_point now) {
+        if (last_refill_ == Clock::time_point()) {
+            last_refill_ = now;
+            return;
+        }
+        if (now <= last_refill_) {
+            return;
+        }
+        double seconds = std::chrono::duration<double>(now - last_refill_).count();
+        last_refill_ = now;
+        if (rate_ > 0) {
+            tokens_ = std::min(tokens_ + rate_ * seconds, burst());
+            target_integral_ += rate_ * seconds;
+            paced_seconds_ += seconds;
+        }
+    }
+
+    double rate_;
+    double tokens_;
+    Clock::time_point last_refill_;
+    bool started_;
+    Clock::time_point first_send_;
+    Clock::time_point last_send_;
+    uint64_t bytes_;
+    uint64_t waits_;
+    double target_integral_;
+    double paced_seconds_;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef RTT_ESTIMATOR_H
+#define RTT_ESTIMATOR_H
+
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#define INITIAL_RTO_MS 500       // RTO khi chưa có mẫu RTT nào
+#define MIN_RTO_US 1000          // 1 ms - RTT trong LAN chỉ vài chục µs
+#define MAX_RTO_US 60000000      // 60 s
+#define RTO_GRANULARITY_US 100   // Sai số đồng hồ/lập lịch (G trong RFC 6298)
+
+// Ước lượng RTT và tính RTO theo RFC 6298:
+//   SRTT   = 7/8 SRTT + 1/8 R
+//   RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|
+//   RTO    = SRTT + max(G, 4 * RTTVAR), nhân đôi mỗi lần gửi lại (backoff)
+// Chỉ lấy mẫu từ packet chưa từng gửi lại (Karn). Các mẫu còn được đưa vào
+// histogram log-linear để báo cáo min/avg/p99 mà không phải lưu từng mẫu.
+class RttEstimator {
+public:
+    RttEstimator() : srtt_us_(0), rttvar_us_(0), rto_us_(INITIAL_RTO_MS * 1000.0),
+                     samples_(0), sum_us_(0), min_us_(0), max_us_(0), histogram_{} {}
+
+    void addSample(std::chrono::nanoseconds rtt) {
+        double r = std::max<double>(rtt.count() / 1000.0, 1.0);
+
+        if (samples_ == 0) {
+            srtt_us_ = r;
+            rttvar_us_ = r / 2;
+            min_us_ = r;
+            max_us_ = r;
+        } else {
+            rttvar_us_ = 0.75 * rttvar_us_ + 0.25 * std::fabs(srtt_us_ - r);
+            srtt_us_ = 0.875 * srtt_us_ + 0.125 * r;
+            min_us_ = std::min(min_us_, r);
+            max_us_ = std::max(max_us_, r);
+        }
+
+        rto_us_ = srtt_us_ + std::max<double>(RTO_GRANULARITY_US, 4 * rttvar_us_);
+        rto_us_ = std::min<double>(std::max<double>(rto_us_, MIN_RTO_US), MAX_RTO_US);
+
+        samples_++;
+        sum_us_ += r;
+        histogram_[bucketOf((uint64_t)r)]++;
+    }
+
+    // RTO cho packet đã gửi lại retry_count lần (exponential backoff)
+    std::chrono::microseconds rto(int retry_count) const {
+        double value = rto_us_ * std::ldexp(1.0, std::min(retry_count, 30));
+        return std::chrono::microseconds((int64_t)std::min<double>(value, MAX_RTO_US));
+    }
+
+    bool hasSamples() const { return samples_ > 0; }
+    uint64_t samples() const { return samples_; }
+    double srttUs() const { return srtt_us_; }
+    double rttvarUs() const { return rttvar_us_; }
+    double minUs() const { return min_us_; }
+    double maxUs() const { return max_us_; }
+    double avgUs() const { return samples_ > 0 ? sum_us_ / samples_ : 0; }
+
+    // Percentile xấp xỉ (sai số ~6%) từ histogram
+    double percentileUs(double p) const {
+        if (samples_ == 0) {
+            return 0;
+        }
+        uint64_t target = (uint64_t)std::ceil(p / 100.0 * samples_);
+        uint64_t seen = 0;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += histogram_[i];
+            if (seen >= std::max<uint64_t>(target, 1)) {
+                return std::min(std::max(bucketMid(i), min_us_), max_us_);
+            }
+        }
+        return max_us_;
+    }
+
+private:
+    // 16 bucket cho mỗi lũy thừa của 2 (đơn vị µs)
+    static const int SUB_BUCKETS = 16;
+    static const int HISTOGRAM_BUCKETS = 48 * SUB_BUCKETS;
+
+    static int bucketOf(uint64_t us) {
+        if (us < SUB_BUCKETS) {
+            return (int)us;
+        }
+        int msb = 63 - __builtin_clzll(us);
+        int index = (msb - 3) * SUB_BUCKETS + (int)((us >> (msb - 4)) & (SUB_BUCKETS - 1));
+        return std::min(index, HISTOGRAM_BUCKETS - 1);
+    }
+
+    static double bucketMid(int index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        int msb = index / SUB_BUCKETS + 3;
+        double low = (double)(SUB_BUCKETS + index % SUB_BUCKETS) * std::ldexp(1.0, msb - 4);
+        return low + std::ldexp(1.0, msb - 4) / 2;
+    }
+
+    double srtt_us_;
+    double rttvar_us_;
+    double rto_us_;
+    uint64_t samples_;
+    double sum_us_;
+    double min_us_;
+    double max_us_;
+    uint64_t histogram_[HISTOGRAM_BUCKETS];
+};
+
+#endif
@@ -1,5 +1,4 @@
 #include <iostream>
-#include <fstream>
 #include <cstring>
 #include <vector>
 #include <sys/socket.h>
@@ -9,38 +8,50 @@
 #include <unistd.h>
 #include <chrono>
 #include <iomanip>
+#include <memory>
+#include <string>
+
+#include "file_source.h"
 
 #define CHUNK_SIZE 1024
 
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <file_path> <receiver_ip> <port>" << std::endl;
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <file_path> <receiver_ip> <port> [--mem-mb N]" << std::endl;
         return 1;
     }
 
     const char* file_path = argv[1];
     const char* receiver_ip = argv[2];
     int port = std::stoi(argv[3]);
+    size_t memory_mb = 0;  // 0 = mmap cả file
+
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--mem-mb" && i + 1 < argc) {
+            memory_mb = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Tham số không hợp lệ: " << arg << std::endl;
+            return 1;
+        }
+    }
 
-    // Mở file
-    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
+    // Mở file: mmap cả file, hoặc đọc theo luồng với bộ nhớ giới hạn (--mem-mb)
+    std::unique_ptr<FileSource> source = openFileSource(file_path, memory_mb * 1024 * 1024);
+    if (!source) {
         std::cerr << "Không thể mở file: " << file_path << std::endl;
         return 1;
     }
 
-    std::streamsize file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    uint64_t file_size = source->size();
 
     std::cout << "Kích thước file: " << file_size << " bytes (" 
               << std::fixed << std::setprecision(2) << file_size / 1024.0 / 1024.0 << " MB)" << std::endl;
-
-    // ĐỌC TOÀN BỘ FILE VÀO MEMORY
-    std::cout << "Đang đọc file vào memory..." << std::endl;
-    std::vector<char> file_data(file_size);
-    file.read(file_data.data(), file_size);
-    file.close();
-    std::cout << "Đã đọc xong file vào memory!" << std::endl;
+    std::cout << "Nguồn dữ liệu: " << source->name();
+    if (memory_mb > 0) {
+        std::cout << " (ring " << source->capacity() / 1024 / 1024 << " MB)";
+    }
+    std::cout << std::endl;
 
     // Tạo TCP socket
     int sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -87,8 +98,14 @@ int main(int argc, char* argv[]) {
         // Gửi dữ liệu qua TCP
         ssize_t total_sent_chunk = 0;
         while (total_sent_chunk < chunk_size) {
-            ssize_t sent = send(sock, file_data.data() + offset + total_sent_chunk, 
-                               chunk_size - total_sent_chunk, 0);
+            const char* data = source->data(offset + total_sent_chunk, chunk_size - total_sent_chunk);
+            if (data == nullptr) {
+                std::cerr << "\nLỗi đọc file nguồn tại offset " << offset + total_sent_chunk
+                          << " (lỗi I/O hoặc file bị cắt ngắn)" << std::endl;
+                close(sock);
+                return 1;
+            }
+            ssize_t sent = send(sock, data, chunk_size - total_sent_chunk, 0);
             if (sent < 0) {
                 std::cerr << "\nLỗi gửi dữ liệu" << std::endl;
                 close(sock);
@@ -100,6 +117,7 @@ int main(int argc, char* argv[]) {
         total_sent += chunk_size;
         chunks_sent++;
         offset += chunk_size;
+        source->release(offset);  // Đã nằm trong socket buffer của kernel
 
         // Hiển thị tiến trình
         if (chunks_sent % 100 == 0) {
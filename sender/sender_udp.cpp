@@ -1,6 +1,6 @@
 #include <iostream>
-#include <fstream>
 #include <cstring>
+#include <cerrno>
 #include <vector>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -8,38 +8,58 @@
 #include <unistd.h>
 #include <chrono>
 #include <iomanip>
+#include <memory>
+#include <string>
+
+#include "../common/batch_io.h"
+#include "file_source.h"
+#include "pacer.h"
 
 #define CHUNK_SIZE 1024
 
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <file_path> <receiver_ip> <port>" << std::endl;
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <file_path> <receiver_ip> <port> [--rate Mbps] [--mem-mb N] [--gso]" << std::endl;
         return 1;
     }
 
     const char* file_path = argv[1];
     const char* receiver_ip = argv[2];
     int port = std::stoi(argv[3]);
+    double rate_mbps = 0;  // 0 = gửi nhanh nhất có thể như trước
+    size_t memory_mb = 0;  // 0 = mmap cả file
+    bool gso = false;      // UDP GSO: mỗi sendmsg một super-buffer nhiều chunk
+
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--rate" && i + 1 < argc) {
+            rate_mbps = std::stod(argv[++i]);
+        } else if (arg == "--mem-mb" && i + 1 < argc) {
+            memory_mb = std::stoul(argv[++i]);
+        } else if (arg == "--gso") {
+            gso = true;
+        } else {
+            std::cerr << "Tham số không hợp lệ: " << arg << std::endl;
+            return 1;
+        }
+    }
 
-    // Mở file
-    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
+    // Mở file: mmap cả file, hoặc đọc theo luồng với bộ nhớ giới hạn (--mem-mb)
+    std::unique_ptr<FileSource> source = openFileSource(file_path, memory_mb * 1024 * 1024);
+    if (!source) {
         std::cerr << "Không thể mở file: " << file_path << std::endl;
         return 1;
     }
 
-    std::streamsize file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    uint64_t file_size = source->size();
 
     std::cout << "Kích thước file: " << file_size << " bytes (" 
               << std::fixed << std::setprecision(2) << file_size / 1024.0 / 1024.0 << " MB)" << std::endl;
-
-    // ĐỌC TOÀN BỘ FILE VÀO MEMORY
-    std::cout << "Đang đọc file vào memory..." << std::endl;
-    std::vector<char> file_data(file_size);
-    file.read(file_data.data(), file_size);
-    file.close();
-    std::cout << "Đã đọc xong file vào memory!" << std::endl;
+    std::cout << "Nguồn dữ liệu: " << source->name();
+    if (memory_mb > 0) {
+        std::cout << " (ring " << source->capacity() / 1024 / 1024 << " MB)";
+    }
+    std::cout << std::endl;
 
     // Tính số packet
     uint64_t total_packets = (file_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
@@ -61,34 +81,90 @@ int main(int argc, char* argv[]) {
 
     std::cout << "Đang kết nối đến " << receiver_ip << ":" << port << "..." << std::endl;
 
+    // GSO: kernel cắt super-buffer thành các datagram CHUNK_SIZE byte ở cuối đường gửi
+    size_t segments_per_send = 1;
+    int gso_error = 0;  // errno khiến GSO bị tắt giữa chừng
+    if (gso) {
+        int segment_size = CHUNK_SIZE;
+        if (setsockopt(sock, SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size)) == 0) {
+            segments_per_send = std::min<size_t>(UDP_GSO_MAX_SEGMENTS, UDP_GSO_MAX_BYTES / CHUNK_SIZE);
+            std::cout << "UDP GSO: " << segments_per_send << " chunk mỗi lần gửi" << std::endl;
+        } else {
+            std::cerr << "Không bật được UDP GSO: " << strerror(errno) << std::endl;
+        }
+    }
+
+    // Pacing: dàn đều packet theo --rate thay vì dồn hết vào socket buffer
+    Pacer pacer;
+    if (rate_mbps > 0) {
+        setFineTimerSlack();
+        std::cout << "Pacing: " << std::setprecision(2) << rate_mbps << " Mbps" << std::endl;
+    }
+
     // Bắt đầu đo thời gian
     auto start_time = std::chrono::high_resolution_clock::now();
+    pacer.setRate(rate_mbps * 1000000.0 / 8, start_time);
 
     uint64_t packets_sent = 0;
     uint64_t total_bytes_sent = 0;
+    uint64_t sends = 0;
+    uint64_t next_progress = 100;
     size_t offset = 0;
 
     std::cout << "Bắt đầu gửi dữ liệu từ memory (UDP)..." << std::endl;
 
     // Gửi dữ liệu từ memory
     while (offset < file_size) {
-        size_t chunk_size = std::min((size_t)CHUNK_SIZE, file_size - offset);
+        // Một chunk, hoặc với GSO tối đa segments_per_send chunk liền nhau trong file
+        size_t chunk_size = std::min((size_t)CHUNK_SIZE * segments_per_send, file_size - offset);
+
+        pacer.wait();
+        pacer.consume(std::chrono::high_resolution_clock::now(), chunk_size);
 
         // Gửi packet trực tiếp từ memory
-        ssize_t sent = sendto(sock, file_data.data() + offset, chunk_size, 0,
+        const char* data = source->data(offset, chunk_size);
+        if (data == nullptr) {
+            std::cerr << "\nLỗi đọc file nguồn tại offset " << offset << " (lỗi I/O hoặc file bị cắt ngắn)" << std::endl;
+            close(sock);
+            return 1;
+        }
+        ssize_t sent = sendto(sock, data, chunk_size, 0,
                              (struct sockaddr*)&receiver_addr, sizeof(receiver_addr));
 
-        if (sent < 0) {
-            std::cerr << "Lỗi gửi packet " << packets_sent << std::endl;
+        if (sent < 0 && segments_per_send > 1 && (errno == EIO || errno == EINVAL)) {
+            // setsockopt nhận UDP_SEGMENT nhưng thiết bị/đường đi không nhận GSO:
+            // tắt hẳn, gửi lại super-buffer này từng chunk
+            gso_error = errno;
+            int segment_size = 0;
+            setsockopt(sock, SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size));
+            segments_per_send = 1;
+            std::cerr << "\nUDP GSO bị từ chối (" << strerror(gso_error) << "), gửi từng chunk" << std::endl;
+            for (size_t done = 0; done < chunk_size; done += CHUNK_SIZE) {
+                size_t len = std::min((size_t)CHUNK_SIZE, chunk_size - done);
+                ssize_t part = sendto(sock, data + done, len, 0,
+                                      (struct sockaddr*)&receiver_addr, sizeof(receiver_addr));
+                if (part < 0) {
+                    std::cerr << "Lỗi gửi packet " << (offset + done) / CHUNK_SIZE << std::endl;
+                } else {
+                    total_bytes_sent += part;
+                    packets_sent++;
+                }
+                sends++;
+            }
+        } else if (sent < 0) {
+            std::cerr << "Lỗi gửi packet " << offset / CHUNK_SIZE << std::endl;
+            sends++;
         } else {
             total_bytes_sent += sent;
+            packets_sent += (chunk_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            sends++;
         }
-
-        packets_sent++;
         offset += chunk_size;
+        source->release(offset);
 
         // Hiển thị tiến trình
-        if (packets_sent % 100 == 0) {
+        if (packets_sent >= next_progress) {
+            next_progress = packets_sent + 100;
             float progress = (float)packets_sent / total_packets * 100;
             auto current_time = std::chrono::high_resolution_clock::now();
             auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -109,8 +185,19 @@ int main(int argc, char* argv[]) {
     std::cout << "Tổng thời gian: " << std::fixed << std::setprecision(3) 
               << duration.count() / 1000.0 << " giây" << std::endl;
     std::cout << "Tổng số packets đã gửi: " << packets_sent << std::endl;
+    if (segments_per_send > 1) {
+        std::cout << "Số lần gửi (GSO): " << sends << std::endl;
+    } else if (gso_error != 0) {
+        std::cout << "UDP GSO: tắt giữa chừng (" << strerror(gso_error) << "), "
+                  << sends << " lần gửi" << std::endl;
+    }
     std::cout << "Tổng dữ liệu đã gửi: " << std::setprecision(2) 
               << total_bytes_sent / 1024.0 / 1024.0 << " MB" << std::endl;
+    if (pacer.enabled()) {
+        std::cout << "Pacing mục tiêu: " << std::setprecision(2) << pacer.averageTargetRate() * 8 / 1e6
+                  << " Mbps - thực tế: " << pacer.achievedRate() * 8 / 1e6
+                  << " Mbps (" << pacer.waits() << " lần chờ)" << std::endl;
+    }
     std::cout << "Tốc độ trung bình: " << std::setprecision(2) 
               << (total_bytes_sent / 1024.0 / 1024.0) / (duration.count() / 1000.0) 
               << " MB/s" << std::endl;
@@ -2,94 +2,137 @@
 #include <fstream>
 #include <cstring>
 #include <sys/socket.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <chrono>
+#include <cmath>
 #include <iomanip>
+#include <memory>
 #include <vector>
-#include <map>
+#include <string>
 #include <algorithm>
+#include <sstream>
+#include <thread>
+
+#include "../common/packet_io.h"
+#include "../common/protocol.h"
+#include "../common/fec.h"
+#include "../common/checksum.h"
+#include "rtt_estimator.h"
+#include "timer_wheel.h"
+#include "congestion_control.h"
+#include "pacer.h"
+#include "loss_detector.h"
+#include "file_source.h"
+#include "block_compressor.h"
 
-#define CHUNK_SIZE 972
-#define HEADER_SIZE 4
-#define ACK_TIMEOUT_MS 500
-#define DEFAULT_WINDOW_SIZE 5
-#define MAX_WINDOW_SIZE 8191
 #define HANDSHAKE_TIMEOUT_MS 2000
 #define MAX_HANDSHAKE_RETRIES 5
+#define PMTU_PROBE_TIMEOUT_MS 200
+#define PMTU_PROBE_RETRIES 3   // Probe mất cả 3 lần: coi như MTU đó không qua
+#define CWND_SAMPLE_MS 100   // Chu kỳ ghi lại cwnd để báo cáo
+#define PACING_GAIN 2.0      // Tốc độ pacing = gain * cwnd / SRTT (như tcp_pacing_ss_ratio)
+#define FEC_LOSS_EWMA 0.125  // Trọng số mẫu mới khi ước lượng tỷ lệ mất theo block
+#define FEC_REPAIR_GAIN 4.0  // Repair thêm cho mỗi packet dự kiến mất trong block
+#define DIGEST_TIMEOUT_MS 200
+#define DIGEST_RETRIES 5
+#define RESUME_TIMEOUT_MS 200
+#define RESUME_RETRIES 5
 
-// Handshake flags (3 bits cuối)
-#define SYN 0x01   // 0000 0001 - Yêu cầu kết nối
-#define ACK 0x02   // 0000 0010 - Xác nhận
-#define FIN 0x04   // 0000 0100 - Kết thúc kết nối
-
-// Handshake packet structure (16 bits = 2 bytes)
-// Format: [13 bits: window_size][3 bits: flags]
-struct HandshakePacket {
-    uint16_t data;  // 13 bits window size + 3 bits flags
-    
-    // Set window size (13 bits đầu)
-    void setWindowSize(uint16_t window_size) {
-        if (window_size > MAX_WINDOW_SIZE) {
-            window_size = MAX_WINDOW_SIZE;
-        }
-        data = (window_size << 3) | (data & 0x07);
-    }
-    
-    // Get window size
-    uint16_t getWindowSize() const {
-        return (data >> 3) & 0x1FFF;  // Lấy 13 bits đầu
-    }
-    
-    // Set flags (3 bits cuối)
-    void setFlags(uint8_t flags) {
-        data = (data & 0xFFF8) | (flags & 0x07);
-    }
-    
-    // Get flags
-    uint8_t getFlags() const {
-        return data & 0x07;  // Lấy 3 bits cuối
-    }
+// Lý do gửi lại một packet (chỉ mất gói mới là tín hiệu tắc nghẽn)
+enum RetransmitReason {
+    RETRANSMIT_TIMEOUT,
+    RETRANSMIT_FAST,
+    RETRANSMIT_CORRUPT   // Receiver báo sai CRC (NACK)
 };
 
-struct PacketHeader {
-    uint32_t pkt_num;
+struct WindowSlot {
+    CompressPacketHeader header; // Header gửi kèm (dài theo dataHeaderSize), payload lấy thẳng từ file nguồn
+    size_t payload_size;
+    std::chrono::high_resolution_clock::time_point send_time;
+    int retry_count;
+    uint64_t delivered_at_send;   // Số packet đã giao lúc gửi (ước lượng delivery rate)
+    std::chrono::high_resolution_clock::time_point delivered_time_at_send;
 };
 
-struct AckPacket {
-    uint32_t ack_num;
+// Một điểm cwnd theo thời gian
+struct CwndSample {
+    double elapsed_ms;
+    double cwnd;
+    uint64_t inflight;
+    double srtt_us;
 };
 
-struct WindowPacket {
-    std::vector<char> data;
-    uint32_t pkt_num;
-    std::chrono::high_resolution_clock::time_point send_time;
-    bool acked;
-    int retry_count;
+// Sliding window dạng ring buffer: packet pkt_num nằm ở slot pkt_num % capacity.
+// Slot chỉ giữ header và metadata (payload đọc thẳng từ file nguồn), được cấp
+// phát một lần sau handshake, nên đường gửi/nhận ACK không cấp phát bộ nhớ và
+// mọi thao tác đều O(1).
+class SendWindow {
+public:
+    explicit SendWindow(uint32_t capacity)
+        : capacity_(capacity),
+          slots_(capacity),
+          acked_((capacity + 63) / 64, 0) {}
+
+    uint32_t capacity() const { return capacity_; }
+
+    uint32_t index(uint32_t pkt_num) const { return pkt_num % capacity_; }
+    WindowSlot& slot(uint32_t pkt_num) { return slots_[pkt_num % capacity_]; }
+    WindowSlot& slotAt(uint32_t index) { return slots_[index]; }
+
+    // Bitmap các slot đã được ACK
+    bool isAcked(uint32_t pkt_num) const {
+        uint32_t idx = pkt_num % capacity_;
+        return (acked_[idx / 64] >> (idx % 64)) & 1;
+    }
+
+    void setAcked(uint32_t pkt_num, bool value) {
+        uint32_t idx = pkt_num % capacity_;
+        if (value) {
+            acked_[idx / 64] |= (1ULL << (idx % 64));
+        } else {
+            acked_[idx / 64] &= ~(1ULL << (idx % 64));
+        }
+    }
+
+private:
+    uint32_t capacity_;
+    std::vector<WindowSlot> slots_;
+    std::vector<uint64_t> acked_;
 };
 
-bool performHandshake(int sock, struct sockaddr_in& receiver_addr, uint16_t proposed_window, uint16_t& negotiated_window) {
+bool performHandshake(PacketIo& io, struct sockaddr_in& receiver_addr, const HandshakeParams& proposed,
+                      HandshakeParams& negotiated) {
     std::cout << "\n=== BẮT ĐẦU HANDSHAKE ===" << std::endl;
-    std::cout << "Window size đề xuất: " << proposed_window << std::endl;
+    std::cout << "Window size đề xuất: " << proposed.window << std::endl;
     
-    HandshakePacket syn_packet;
-    HandshakePacket response;
+    HandshakeExtPacket syn_packet;
+    HandshakePacket legacy_syn;
+    char response[sizeof(HandshakeExtPacket)];
     struct sockaddr_in response_addr;
-    socklen_t addr_len = sizeof(response_addr);
     
     // Bước 1: Gửi SYN với window size đề xuất
     for (int retry = 0; retry < MAX_HANDSHAKE_RETRIES; retry++) {
-        syn_packet.setWindowSize(proposed_window);
-        syn_packet.setFlags(SYN);
+        // Nửa sau số lần thử dùng handshake 2 byte cho receiver phiên bản cũ
+        bool legacy = retry >= (MAX_HANDSHAKE_RETRIES + 1) / 2;
+        syn_packet.init(proposed, SYN);
+        legacy_syn.data = 0;
+        legacy_syn.setWindowSize(std::min<uint32_t>(proposed.window, MAX_WINDOW_SIZE));
+        legacy_syn.setFlags(SYN);
         
-        std::cout << "Bước 1: Gửi SYN với window_size=" << syn_packet.getWindowSize() 
-                  << " đến receiver..." << std::endl;
+        std::cout << "Bước 1: Gửi SYN" << (legacy ? " (16-bit)" : "") << " với window_size="
+                  << (legacy ? legacy_syn.getWindowSize() : syn_packet.window()) << " đến receiver..." << std::endl;
         
-        ssize_t sent = sendto(sock, &syn_packet, sizeof(syn_packet), 0,
-                             (struct sockaddr*)&receiver_addr, sizeof(receiver_addr));
+        bool sent;
+        if (legacy) {
+            sent = io.sendTo(receiver_addr, &legacy_syn, sizeof(HandshakePacket));
+        } else {
+            sent = io.sendTo(receiver_addr, &syn_packet, syn_packet.size());
+        }
         
-        if (sent < 0) {
+        if (!sent) {
             std::cerr << "Lỗi khi gửi SYN" << std::endl;
             continue;
         }
@@ -97,25 +140,60 @@ bool performHandshake(int sock, struct sockaddr_in& receiver_addr, uint16_t prop
         // Đợi SYN-ACK với timeout
         auto start_time = std::chrono::high_resolution_clock::now();
         while (true) {
-            ssize_t recv_len = recvfrom(sock, &response, sizeof(response), 0,
-                                       (struct sockaddr*)&response_addr, &addr_len);
+            ssize_t recv_len = io.receiveFrom(response, sizeof(response), response_addr);
+
+            HandshakePacket reply;
+            bool ext_reply = false;
+            bool valid = false;
+            if (recv_len == sizeof(HandshakePacket)) {
+                memcpy(&reply, response, sizeof(reply));
+                valid = true;
+                // Receiver bản cũ: window 13 bit, chunk size cố định, không có tính năng mở rộng
+                negotiated = HandshakeParams{reply.getWindowSize(), 0, CHUNK_SIZE, proposed.file_size};
+            } else if (recv_len > 0 && HandshakeExtPacket::matches(response, recv_len)) {
+                const HandshakeExtPacket* ext_packet = (const HandshakeExtPacket*)response;
+                reply = ext_packet->base;
+                ext_reply = true;
+                valid = true;
+                negotiated = ext_packet->params();
+                negotiated.features &= proposed.features;
+                negotiated.chunk_size = std::min(negotiated.chunk_size, proposed.chunk_size);
+                negotiated.file_size = proposed.file_size;
+                negotiated.range = proposed.range;
+                // Receiver chỉ được nhận hoặc bỏ codec sender đề xuất; block nén
+                // hỏng không được phát hiện nếu không có CRC
+                if (negotiated.codec != proposed.codec || !(negotiated.features & FEATURE_CRC)) {
+                    negotiated.features &= ~FEATURE_COMPRESS;
+                    negotiated.codec = COMPRESS_NONE;
+                }
+            }
             
-            if (recv_len > 0 && (response.getFlags() & (SYN | ACK)) == (SYN | ACK)) {
-                negotiated_window = response.getWindowSize();
-                std::cout << "Bước 2: Nhận được SYN-ACK từ receiver" << std::endl;
-                std::cout << "        Window size được thỏa thuận: " << negotiated_window << std::endl;
+            if (valid && (reply.getFlags() & (SYN | ACK)) == (SYN | ACK)) {
+                std::cout << "Bước 2: Nhận được SYN-ACK" << (ext_reply ? "" : " (16-bit)") << " từ receiver" << std::endl;
+                std::cout << "        Window size được thỏa thuận: " << negotiated.window << std::endl;
                 
-                // Bước 3: Gửi ACK với window size đã thỏa thuận
-                HandshakePacket ack_packet;
-                ack_packet.setWindowSize(negotiated_window);
-                ack_packet.setFlags(ACK);
+                // Bước 3: Gửi ACK với các tham số đã thỏa thuận (cùng định dạng với SYN-ACK)
+                HandshakeExtPacket ack_packet;
+                ack_packet.init(negotiated, ACK);
                 
                 std::cout << "Bước 3: Gửi ACK để hoàn tất handshake" << std::endl;
-                sendto(sock, &ack_packet, sizeof(ack_packet), 0,
-                      (struct sockaddr*)&receiver_addr, sizeof(receiver_addr));
+                if (ext_reply) {
+                    io.sendTo(receiver_addr, &ack_packet, ack_packet.size());
+                } else {
+                    HandshakePacket legacy_ack;
+                    legacy_ack.data = 0;
+                    legacy_ack.setWindowSize(negotiated.window);
+                    legacy_ack.setFlags(ACK);
+                    io.sendTo(receiver_addr, &legacy_ack, sizeof(HandshakePacket));
+                }
                 
                 std::cout << "✓ Handshake thành công!" << std::endl;
-                std::cout << "✓ Window size cuối cùng: " << negotiated_window << std::endl;
+                std::cout << "✓ Window size cuối cùng: " << negotiated.window << std::endl;
+                std::cout << "✓ Chunk size: " << negotiated.chunk_size << " bytes" << std::endl;
+                std::cout << "✓ Kiểu ACK: " << ((negotiated.features & FEATURE_SACK) ? "cumulative + SACK" : "từng packet") << std::endl;
+                if (negotiated.features & FEATURE_COMPRESS) {
+                    std::cout << "✓ Nén: " << compressCodecName(negotiated.codec) << std::endl;
+                }
                 std::cout << "=== KẾT THÚC HANDSHAKE ===\n" << std::endl;
                 return true;
             }
@@ -134,166 +212,756 @@ bool performHandshake(int sock, struct sockaddr_in& receiver_addr, uint16_t prop
     return false;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <file_path> <receiver_ip> <port>" << std::endl;
-        return 1;
+// Gửi probe payload size byte, true nếu receiver xác nhận trong thời gian chờ.
+// Probe vượt MTU đã biết (interface hoặc ICMP "fragmentation needed" từ
+// router) bị kernel từ chối ngay với EMSGSIZE nhờ IP_PMTUDISC_DO.
+bool sendPathProbe(PacketIo& io, const struct sockaddr_in& receiver_addr, size_t size, uint32_t& seq) {
+    std::vector<char> probe(size, 0);
+    char response[sizeof(SackPacket)];
+    struct sockaddr_in response_addr;
+
+    for (int retry = 0; retry < PMTU_PROBE_RETRIES; retry++) {
+        ProbePacket header;
+        memset(&header, 0, sizeof(header));
+        header.marker = CTRL_MARKER;
+        header.type = CTRL_PROBE;
+        header.size = size;
+        header.seq = ++seq;
+        memcpy(probe.data(), &header, sizeof(header));
+        if (!io.sendTo(receiver_addr, probe.data(), size)) {
+            return false;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(PMTU_PROBE_TIMEOUT_MS);
+        while (std::chrono::steady_clock::now() < deadline) {
+            ssize_t len = io.receiveFrom(response, sizeof(response), response_addr);
+            if (len > 0 && ProbePacket::matches(response, len)) {
+                const ProbePacket* reply = (const ProbePacket*)response;
+                if (reply->seq == header.seq && reply->size == size) {
+                    return true;
+                }
+            }
+        }
     }
+    return false;
+}
 
-    const char* file_path = argv[1];
-    const char* receiver_ip = argv[2];
-    int port = std::stoi(argv[3]);
-    uint16_t proposed_window = DEFAULT_WINDOW_SIZE;
+// Chọn chunk size đề xuất trong handshake: dò path MTU bằng các probe tăng dần
+// (chunk mặc định, rồi các MTU thường gặp, cuối cùng là giới hạn max_chunk) và
+// dừng ở probe đầu tiên không qua. Receiver không trả lời probe nào (bản cũ):
+// giữ CHUNK_SIZE.
+uint16_t probeChunkSize(PacketIo& io, const struct sockaddr_in& receiver_addr, uint16_t max_chunk) {
+    static const size_t common_mtus[] = {1500, 4352, 9000};  // Ethernet, FDDI, jumbo frame
 
-    std::cout << "Sử dụng giao thức: Selective Repeat với Handshake (16-bit)" << std::endl;
+    if (io.udpSocket() >= 0) {
+        int pmtu = IP_PMTUDISC_DO;  // Cấm phân mảnh, kể cả ở máy gửi
+        setsockopt(io.udpSocket(), IPPROTO_IP, IP_MTU_DISCOVER, &pmtu, sizeof(pmtu));
+    }
 
-    // Mở file
-    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
-        std::cerr << "Không thể mở file: " << file_path << std::endl;
-        return 1;
+    max_chunk = std::min<size_t>(max_chunk, io.maxPayload() - HEADER_SIZE);
+    size_t max_size = max_chunk + HEADER_SIZE;
+    std::vector<size_t> sizes;
+    sizes.push_back(std::min<size_t>(CHUNK_SIZE, max_chunk) + HEADER_SIZE);
+    for (size_t mtu : common_mtus) {
+        size_t size = mtu - IP_UDP_HEADERS_SIZE;
+        if (size > sizes.back() && size < max_size) {
+            sizes.push_back(size);
+        }
+    }
+    if (max_size > sizes.back()) {
+        sizes.push_back(max_size);
     }
 
-    std::streamsize file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    std::cout << "Dò path MTU tới receiver..." << std::endl;
+    uint32_t seq = 0;
+    size_t confirmed = 0;
+    for (size_t size : sizes) {
+        if (!sendPathProbe(io, receiver_addr, size, seq)) {
+            std::cout << "  MTU " << size + IP_UDP_HEADERS_SIZE << ": không qua" << std::endl;
+            break;
+        }
+        std::cout << "  MTU " << size + IP_UDP_HEADERS_SIZE << ": OK" << std::endl;
+        confirmed = size;
+    }
+    if (confirmed == 0) {
+        std::cout << "Receiver không trả lời probe, dùng chunk mặc định " << CHUNK_SIZE << " bytes" << std::endl;
+        return std::min<uint16_t>(CHUNK_SIZE, max_chunk);
+    }
+    std::cout << "Path MTU: " << confirmed + IP_UDP_HEADERS_SIZE << " bytes -> chunk size đề xuất "
+              << confirmed - HEADER_SIZE << " bytes" << std::endl;
+    return confirmed - HEADER_SIZE;
+}
 
-    std::cout << "Kích thước file: " << file_size << " bytes (" 
-              << std::fixed << std::setprecision(2) << file_size / 1024.0 / 1024.0 << " MB)" << std::endl;
+// Kết thúc truyền khi có FEATURE_CRC: gửi XXH64 của đoạn dữ liệu đã gửi và chờ
+// receiver trả kết quả so sánh. false nếu receiver không trả lời.
+bool exchangeDigest(PacketIo& io, const struct sockaddr_in& receiver_addr, const Xxh64& digest, DigestPacket& reply) {
+    DigestPacket request;
+    memset(&request, 0, sizeof(request));
+    request.marker = CTRL_MARKER;
+    request.type = CTRL_DIGEST;
+    request.status = DIGEST_REQUEST;
+    request.size = digest.size();
+    request.digest = digest.digest();
 
-    // ĐỌC TOÀN BỘ FILE VÀO MEMORY
-    std::cout << "Đang đọc file vào memory..." << std::endl;
-    std::vector<char> file_data(file_size);
-    file.read(file_data.data(), file_size);
-    file.close();
-    std::cout << "Đã đọc xong file vào memory!" << std::endl;
-
-    // Tính số packet
-    uint64_t total_packets = (file_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
-    std::cout << "Tổng số packets: " << total_packets << std::endl;
-
-    // Tạo UDP socket
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        std::cerr << "Không thể tạo socket" << std::endl;
-        return 1;
+    char buffer[sizeof(SackPacket)];
+    struct sockaddr_in addr;
+    for (int retry = 0; retry < DIGEST_RETRIES; retry++) {
+        io.sendTo(receiver_addr, &request, sizeof(request));
+        auto deadline = std::chrono::high_resolution_clock::now() + std::chrono::milliseconds(DIGEST_TIMEOUT_MS);
+        while (std::chrono::high_resolution_clock::now() < deadline) {
+            ssize_t len = io.receiveFrom(buffer, sizeof(buffer), addr);
+            if (len > 0 && DigestPacket::matches(buffer, len) &&
+                ((const DigestPacket*)buffer)->status != DIGEST_REQUEST) {
+                memcpy(&reply, buffer, sizeof(reply));
+                return true;
+            }
+        }
     }
+    return false;
+}
 
-    // Set socket timeout cho handshake
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 100000; // 100ms
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+// Truyền tiếp (FEATURE_RESUME): xin bitmap các chunk receiver đã có, mỗi đợt
+// tối đa RESUME_PIPELINE trang còn thiếu. false nếu receiver không trả lời đủ.
+bool fetchResumeBitmap(PacketIo& io, const struct sockaddr_in& receiver_addr, uint64_t total_packets,
+                       std::vector<uint64_t>& bits) {
+    uint64_t words = (total_packets + 1 + 63) / 64;
+    uint32_t pages = (words + RESUME_PAGE_WORDS - 1) / RESUME_PAGE_WORDS;
+    bits.assign(words, 0);
+    std::vector<bool> received(pages, false);
+    uint32_t remaining = pages;
 
-    // Cấu hình địa chỉ receiver
-    struct sockaddr_in receiver_addr;
-    memset(&receiver_addr, 0, sizeof(receiver_addr));
-    receiver_addr.sin_family = AF_INET;
-    receiver_addr.sin_port = htons(port);
-    inet_pton(AF_INET, receiver_ip, &receiver_addr.sin_addr);
-
-    // Thực hiện handshake và thỏa thuận window size
-    uint16_t negotiated_window;
-    if (!performHandshake(sock, receiver_addr, proposed_window, negotiated_window)) {
-        std::cerr << "Không thể kết nối đến receiver!" << std::endl;
-        close(sock);
-        return 1;
+    ResumePacket request;
+    memset(&request, 0, sizeof(request));
+    request.marker = CTRL_MARKER;
+    request.type = CTRL_RESUME;
+    ResumePacket reply;
+    struct sockaddr_in addr;
+    for (int retry = 0; retry < RESUME_RETRIES && remaining > 0; retry++) {
+        uint32_t page = 0;
+        while (page < pages) {
+            uint32_t requested = 0;
+            for (; page < pages && requested < RESUME_PIPELINE; page++) {
+                if (!received[page]) {
+                    request.page = page;
+                    io.sendTo(receiver_addr, &request, ResumePacket::headerSize());
+                    requested++;
+                }
+            }
+            auto deadline = std::chrono::high_resolution_clock::now() + std::chrono::milliseconds(RESUME_TIMEOUT_MS);
+            while (requested > 0 && std::chrono::high_resolution_clock::now() < deadline) {
+                ssize_t len = io.receiveFrom((char*)&reply, sizeof(reply), addr);
+                if (len != sizeof(reply) || !ResumePacket::matches((const char*)&reply, len) ||
+                    reply.pages != pages || reply.page >= pages || received[reply.page]) {
+                    continue;
+                }
+                size_t first = (size_t)reply.page * RESUME_PAGE_WORDS;
+                memcpy(&bits[first], reply.bits, std::min<size_t>(RESUME_PAGE_WORDS, words - first) * sizeof(uint64_t));
+                received[reply.page] = true;
+                remaining--;
+                requested--;
+            }
+        }
     }
+    return remaining == 0;
+}
 
-    std::cout << "Sử dụng window size: " << negotiated_window << std::endl;
+// Tham số gửi dùng chung cho mọi stream
+struct SenderConfig {
+    size_t batch_size;
+    std::string cc_name;
+    std::string cwnd_log_path;  // Rỗng: không ghi
+    double rate_mbps;           // > 0: pacing cố định; 0: theo cwnd/RTT
+    bool pacing;
+    bool fast_retransmit;
+    uint32_t fec_k;             // Chunk mỗi block FEC (có FEATURE_FEC)
+    WorkerPool* compress_pool;  // Luồng nén dùng chung cho mọi stream (có FEATURE_COMPRESS)
+    bool show_progress;         // In tiến trình ra stdout (chỉ khi có một stream)
+};
 
-    // Đổi timeout cho data transfer
-    tv.tv_usec = 10000; // 10ms
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+// Kết quả gửi của một stream (cho bảng tổng hợp khi truyền song song)
+struct TransferResult {
+    uint64_t bytes_sent;
+    uint64_t file_bytes;        // Dữ liệu gốc của đoạn (khác bytes_sent khi nén)
+    uint64_t packets;
+    uint64_t retransmissions;
+    int digest_status;          // DIGEST_* receiver trả lời, -1 nếu không kiểm tra hoặc không có trả lời
+    bool source_error;          // Dừng giữa chừng vì không đọc được file nguồn
+    bool receiver_stopped;      // Receiver báo dừng nhận giữa chừng (giải nén lỗi)
+    double rtt_avg_us;
+    std::chrono::high_resolution_clock::time_point start_time;
+    std::chrono::high_resolution_clock::time_point end_time;
+};
+
+// Gửi source (cả file, hoặc đoạn file của một stream) bằng Selective Repeat
+// sau khi handshake xong. Báo cáo chi tiết ghi vào report.
+TransferResult sendFile(PacketIo& io, const struct sockaddr_in& receiver_addr, FileSource& source,
+                        const HandshakeParams& negotiated, const SenderConfig& config, std::ostream& report) {
+    uint64_t file_size = source.size();
+    size_t batch_size = config.batch_size;
+    const std::string& cc_name = config.cc_name;
+    double rate_mbps = config.rate_mbps;
+    bool pacing = config.pacing;
+    bool fast_retransmit = config.fast_retransmit;
+
+    // Tính số packet theo chunk size đã thỏa thuận
+    size_t chunk_size = negotiated.chunk_size;
+    uint64_t total_packets = (file_size + chunk_size - 1) / chunk_size;
+    report << "Tổng số packets: " << total_packets << std::endl;
 
     // Bắt đầu đo thời gian (SAU khi handshake hoàn tất)
     auto start_time = std::chrono::high_resolution_clock::now();
     auto last_progress_time = start_time;
 
-    // Sliding window với negotiated window size
-    std::map<uint32_t, WindowPacket> window;
+    // Truyền tiếp: chunk receiver đã có từ lần trước không được gửi lại. Không
+    // lấy được bitmap thì gửi cả đoạn như bình thường.
+    bool resume_mode = false;
+    std::vector<uint64_t> resume_bits;
+    uint64_t resumed_packets = 0;
+    uint64_t resumed_bytes = 0;
+    if (negotiated.features & FEATURE_RESUME) {
+        resume_mode = fetchResumeBitmap(io, receiver_addr, total_packets, resume_bits);
+        if (!resume_mode) {
+            report << "Không lấy được bitmap truyền tiếp, gửi lại toàn bộ" << std::endl;
+        }
+    }
+    auto receiverHas = [&](uint32_t pkt_num) {
+        return resume_mode && ((resume_bits[pkt_num / 64] >> (pkt_num % 64)) & 1);
+    };
+
+    // Nén: payload đi trên đường truyền lấy từ wire (bản nén của từng block, hoặc
+    // chính nguồn với block gửi nguyên); digest vẫn tính trên dữ liệu gốc
+    std::unique_ptr<BlockCompressor> compressor;
+    if ((negotiated.features & FEATURE_COMPRESS) && config.compress_pool != nullptr) {
+        compressor.reset(new BlockCompressor(source, negotiated.codec, chunk_size, std::max<uint32_t>(negotiated.window, 1),
+                                             *config.compress_pool));
+    }
+    FileSource& wire = compressor ? *compressor : source;
+    uint64_t padding_packets = 0;
+
+    // Sliding window với negotiated window size (cấp phát một lần)
+    SendWindow window(std::max<uint32_t>(negotiated.window, 1));
     uint32_t base = 1;
     uint32_t next_seq_num = 1;
     
     uint64_t total_bytes_sent = 0;
     uint64_t total_retransmissions = 0;
+    uint64_t timeout_retransmissions = 0;
+    uint64_t fast_retransmissions = 0;
+    uint64_t corrupt_retransmissions = 0;
     uint64_t acks_received = 0;
+    uint64_t sacks_received = 0;
+    uint64_t poll_waits = 0;
+
+    // RTO thích nghi theo RTT đo được
+    RttEstimator rtt;
+
+    // cwnd do bộ điều khiển tắc nghẽn quyết định, luôn bị chặn bởi window
+    // receiver đã quảng bá trong handshake
+    std::unique_ptr<CongestionControl> cc = createCongestionControl(cc_name, window.capacity());
+    uint64_t delivered = 0;                 // Tổng số packet đã được ACK
+    auto delivered_time = start_time;       // Thời điểm delivered thay đổi gần nhất
+    uint32_t acked_in_window = 0;           // Packet đã ACK nhưng còn nằm trong [base, next_seq_num)
+    std::vector<CwndSample> cwnd_history;
+    auto last_cwnd_sample_time = start_time;
+
+    // Số packet trong window đang được cwnd cho phép
+    auto effectiveWindow = [&]() {
+        return std::max<uint32_t>(1, std::min<uint32_t>((uint32_t)cc->cwnd(), window.capacity()));
+    };
+
+    // Pacing: dàn đều packet theo --rate, hoặc theo tốc độ của bộ điều khiển
+    // tắc nghẽn (BBR), hoặc PACING_GAIN * cwnd / SRTT khi đã có mẫu RTT
+    Pacer pacer;
+    bool crc_mode = (negotiated.features & FEATURE_CRC) != 0;
+    size_t header_size = dataHeaderSize(negotiated.features);
+    size_t wire_packet_size = header_size + chunk_size;
+    auto pacingTarget = [&]() -> double {
+        if (!pacing) {
+            return 0;
+        }
+        if (rate_mbps > 0) {
+            return rate_mbps * 1000000.0 / 8;
+        }
+        double packets_per_sec = cc->pacingRate();
+        if (packets_per_sec <= 0 && rtt.hasSamples()) {
+            packets_per_sec = PACING_GAIN * cc->cwnd() / (rtt.srttUs() / 1e6);
+        }
+        return packets_per_sec * wire_packet_size;
+    };
+    if (pacing) {
+        setFineTimerSlack();
+    }
+
+    // Deadline gửi lại của từng slot nằm trong timer wheel: mỗi vòng lặp chỉ
+    // chạm các entry đã tới hạn, ACK hủy timer trong O(1)
+    TimerWheel retransmit_timers(window.capacity(), start_time);
+
+    // Thông tin gom lại cho mỗi đợt ACK để báo cho bộ điều khiển tắc nghẽn
+    AckSample ack_sample;
+
+    // Phát hiện lỗ hổng từ ACK của packet phía sau (FACK + RACK)
+    LossDetector loss_detector;
+    LossCandidates loss_candidates;
+
+    // FEC: mỗi block fec_k chunk liền nhau được mã hóa khi gửi lần đầu, m repair
+    // gửi ngay sau chunk cuối. m theo tỷ lệ mất ước lượng từ số lần gửi lại
+    // trong lúc block còn bay (tức phần FEC chưa che được), nên tự tăng khi
+    // repair không đủ và giảm dần khi đường truyền sạch.
+    bool fec_mode = (negotiated.features & FEATURE_FEC) != 0 && config.fec_k > 0;
+    uint32_t fec_k = std::min<uint32_t>(config.fec_k, FEC_MAX_K);
+    std::unique_ptr<FecEncoder> fec;
+    uint32_t fec_repairs = 1;
+    double fec_loss = 0;
+    uint64_t fec_retransmissions_at_close = 0;
+    uint64_t fec_blocks = 0;            // Block đã gửi repair (block đóng theo thứ tự)
+    uint64_t repairs_sent = 0;
+    uint64_t repair_bytes_sent = 0;
+    std::vector<std::chrono::high_resolution_clock::time_point> fec_repair_times;  // Theo block, vòng
+    // Block mới từ pkt_num first; block receiver đã có đủ (truyền tiếp) không cần repair
+    auto beginFecBlock = [&](uint32_t first) {
+        uint32_t last = std::min<uint64_t>(first + fec_k - 1, total_packets);
+        bool needed = false;
+        for (uint32_t seq = first; seq <= last && !needed; seq++) {
+            needed = !receiverHas(seq);
+        }
+        fec->begin(first, needed ? fec_repairs : 0);
+    };
+    if (fec_mode) {
+        fec.reset(new FecEncoder(chunk_size));
+        beginFecBlock(1);
+        fec_repair_times.resize(window.capacity() / fec_k + 2);
+    }
 
-    std::cout << "Bắt đầu truyền dữ liệu từ memory với Selective Repeat..." << std::endl;
+    // Gửi repair của block đang mã hóa (chunk cuối là last) và cập nhật số repair
+    // cho block sau. RTO của các chunk chưa được ACK trong block tính lại từ lúc
+    // gửi repair: receiver chỉ dựng được chunk thiếu khi repair tới nơi.
+    auto closeFecBlock = [&](uint32_t last, std::chrono::high_resolution_clock::time_point now) {
+        for (uint32_t j = 0; j < fec->repairs(); j++) {
+            size_t len;
+            char* repair = fec->repair(j, len);
+            if (crc_mode) {
+                ((RepairHeader*)repair)->crc = packetCrc(repair, offsetof(RepairHeader, crc), repair + sizeof(RepairHeader),
+                                                         len - sizeof(RepairHeader));
+            }
+            io.add(receiver_addr, repair, sizeof(RepairHeader), repair + sizeof(RepairHeader), len - sizeof(RepairHeader));
+            pacer.consume(now, len);
+            repairs_sent++;
+            repair_bytes_sent += len;
+            if (io.full()) {
+                io.flush();
+            }
+        }
+        io.flush();  // Buffer repair được dùng lại cho block sau
+        fec_repair_times[fec_blocks % fec_repair_times.size()] = now;
+        fec_blocks++;
+        for (uint32_t seq = std::max(base, last + 1 - fec->count()); seq <= last; seq++) {
+            if (!window.isAcked(seq) && window.slot(seq).retry_count == 0) {
+                retransmit_timers.schedule(window.index(seq), now + rtt.rto(0));
+            }
+        }
+
+        double sample = (double)(total_retransmissions - fec_retransmissions_at_close) / fec->count();
+        fec_retransmissions_at_close = total_retransmissions;
+        if (fec->repairs() == 0) {
+            return;  // Block không gửi gì (receiver đã có đủ), không phải mẫu tỷ lệ mất
+        }
+        fec_loss += FEC_LOSS_EWMA * (sample - fec_loss);
+        uint32_t wanted = 1 + (uint32_t)std::ceil(FEC_REPAIR_GAIN * fec_loss * fec_k);
+        fec_repairs = std::max<uint32_t>(1, std::min<uint32_t>({wanted, FEC_MAX_REPAIR, fec_k}));
+    };
+
+    // Nguồn không đọc được (lỗi I/O, file bị cắt ngắn): dừng vòng gửi
+    bool source_error = false;
+    uint64_t source_error_offset = 0;
+    auto failSource = [&](uint64_t offset) {
+        if (!source_error) {
+            source_error = true;
+            source_error_offset = offset;
+        }
+    };
+    // Receiver không nhận tiếp được (block giải nén lỗi) và gửi trả lời digest
+    // không ai hỏi: dừng luôn thay vì gửi lại mãi
+    bool receiver_stopped = false;
+    DigestPacket digest_reply;
+    int digest_status = -1;
 
-    while (base <= total_packets) {
+    // Đánh dấu packet đã được ACK; lấy mẫu RTT nếu packet chưa từng gửi lại (Karn)
+    auto ackPacket = [&](uint32_t seq, std::chrono::high_resolution_clock::time_point ack_time) {
+        if (window.isAcked(seq)) {
+            return;
+        }
+        window.setAcked(seq, true);
+        retransmit_timers.cancel(window.index(seq));
+        delivered++;
+        acked_in_window++;
+        ack_sample.newly_acked++;
+
+        WindowSlot& pkt = window.slot(seq);
+        if (pkt.retry_count == 0) {
+            rtt.addSample(ack_time - pkt.send_time);
+            ack_sample.rtt_us = std::chrono::duration<double, std::micro>(ack_time - pkt.send_time).count();
+        }
+        loss_detector.onAck(seq, pkt.send_time, ack_time, pkt.retry_count > 0, rtt.minUs());
+
+        // Delivery rate: số packet giao được kể từ lúc gửi packet này, chia cho
+        // khoảng thời gian tương ứng (như tcp_rate.c)
+        if (pkt.delivered_at_send >= ack_sample.prior_delivered) {
+            ack_sample.prior_delivered = pkt.delivered_at_send;
+            double interval = std::chrono::duration<double>(ack_time - pkt.delivered_time_at_send).count();
+            if (interval > 0) {
+                ack_sample.delivery_rate = (delivered - pkt.delivered_at_send) / interval;
+            }
+        }
+    };
+
+    // Gửi lại packet ở slot index
+    auto retransmitPacket = [&](uint32_t index, std::chrono::high_resolution_clock::time_point now,
+                                RetransmitReason reason) {
+        WindowSlot& pkt = window.slotAt(index);
+        uint32_t seq = pkt.header.pkt_num;
+        const char* payload = wire.data((uint64_t)(seq - 1) * chunk_size, pkt.payload_size);
+        if (payload == nullptr) {
+            failSource((uint64_t)(seq - 1) * chunk_size);
+            return;
+        }
+
+        pkt.send_time = now;
+        pkt.retry_count++;
+        pkt.delivered_at_send = delivered;
+        pkt.delivered_time_at_send = delivered_time;
+        if (reason != RETRANSMIT_CORRUPT) {
+            cc->onLoss(seq, reason == RETRANSMIT_TIMEOUT, next_seq_num);
+        }
+        retransmit_timers.schedule(index, now + rtt.rto(pkt.retry_count));
+        if (fast_retransmit && seq < loss_detector.highestAcked()) {
+            loss_candidates.addRetransmit(seq, now);
+        }
+
+        // Dựng lại iovec từ file nguồn thay vì giữ bản sao dữ liệu
+        io.add(receiver_addr, &pkt.header, header_size, payload, pkt.payload_size);
+        // Gửi lại không chờ pacer nhưng vẫn tiêu token, packet mới sẽ chờ bù
+        pacer.consume(now, header_size + pkt.payload_size);
+        total_retransmissions++;
+        if (reason == RETRANSMIT_TIMEOUT) {
+            timeout_retransmissions++;
+        } else if (reason == RETRANSMIT_FAST) {
+            fast_retransmissions++;
+        } else {
+            corrupt_retransmissions++;
+        }
+
+        if (io.full()) {
+            io.flush();
+        }
+    };
+
+    // XXH64 của cả đoạn, cập nhật khi gửi lần đầu (theo thứ tự pkt_num). Khi
+    // nén, chunk đầu của mỗi block mang cả block dữ liệu gốc vào digest
+    Xxh64 digest;
+    auto digestChunk = [&](uint32_t seq, const char* payload, size_t len) {
+        if (!compressor) {
+            digest.update(payload, len);
+        } else if ((seq - 1) % COMPRESS_BLOCK_CHUNKS == 0) {
+            uint64_t offset = (uint64_t)(seq - 1) * chunk_size;
+            size_t block_len = std::min<uint64_t>((uint64_t)chunk_size * COMPRESS_BLOCK_CHUNKS, file_size - offset);
+            const char* block = source.data(offset, block_len);
+            if (block == nullptr) {
+                failSource(offset);
+                return;
+            }
+            digest.update(block, block_len);
+        }
+    };
+
+    report << "Bắt đầu truyền dữ liệu từ memory với Selective Repeat..." << std::endl;
+
+    while (base <= total_packets && !source_error && !receiver_stopped) {
         auto now = std::chrono::high_resolution_clock::now();
+        pacer.setRate(pacingTarget(), now);
+        uint32_t base_before_send = base;
 
-        // Gửi các packet mới trong window
-        while (next_seq_num < base + negotiated_window && next_seq_num <= total_packets) {
-            WindowPacket pkt;
-            pkt.pkt_num = next_seq_num;
-            pkt.acked = false;
-            pkt.retry_count = 0;
+        // Gửi các packet mới trong window (khi pacer còn token)
+        while (next_seq_num < base + window.capacity() && next_seq_num <= total_packets &&
+               (next_seq_num - base) - acked_in_window < effectiveWindow() &&
+               pacer.ready(std::chrono::high_resolution_clock::now())) {
+            size_t offset = (size_t)(next_seq_num - 1) * chunk_size;
+            size_t chunk_len = compressor ? compressor->chunkLength(next_seq_num)
+                                          : std::min<uint64_t>(chunk_size, file_size - offset);
 
-            size_t offset = (next_seq_num - 1) * CHUNK_SIZE;
-            size_t chunk_size = std::min((size_t)CHUNK_SIZE, file_data.size() - offset);
+            // Chunk nằm sau phần nén của block: không có gì để gửi, receiver tự
+            // đánh dấu đã nhận khi thấy block_size
+            if (chunk_len == 0) {
+                if (base == next_seq_num) {
+                    base++;
+                } else {
+                    window.setAcked(next_seq_num, true);
+                    acked_in_window++;
+                }
+                padding_packets++;
+                next_seq_num++;
+                continue;
+            }
 
-            pkt.data.resize(HEADER_SIZE + chunk_size);
-            PacketHeader* header = (PacketHeader*)pkt.data.data();
-            header->pkt_num = next_seq_num;
-            memcpy(pkt.data.data() + HEADER_SIZE, file_data.data() + offset, chunk_size);
+            // Receiver đã có chunk này: không gửi, coi như đã được ACK. Vẫn đọc
+            // dữ liệu khi digest hoặc block FEC đang dựng cần tới nó
+            if (receiverHas(next_seq_num)) {
+                bool encode = fec_mode && fec->repairs() > 0;
+                const char* payload = (crc_mode || encode) ? wire.data(offset, chunk_len) : nullptr;
+                if ((crc_mode || encode) && payload == nullptr) {
+                    failSource(offset);
+                    break;
+                }
+                if (crc_mode) {
+                    digestChunk(next_seq_num, payload, chunk_len);
+                }
+                if (base == next_seq_num) {
+                    base++;
+                } else {
+                    window.setAcked(next_seq_num, true);
+                    acked_in_window++;
+                }
+                resumed_packets++;
+                resumed_bytes += chunk_len;
 
+                if (fec_mode) {
+                    fec->add(payload, chunk_len);
+                    if (fec->count() == fec_k || next_seq_num == total_packets) {
+                        closeFecBlock(next_seq_num, now);
+                        beginFecBlock(next_seq_num + 1);
+                    }
+                }
+                next_seq_num++;
+                continue;
+            }
+
+            const char* payload = wire.data(offset, chunk_len);
+            if (payload == nullptr) {
+                failSource(offset);
+                break;
+            }
+            WindowSlot& pkt = window.slot(next_seq_num);
+            pkt.header.pkt_num = next_seq_num;
+            pkt.retry_count = 0;
+            pkt.delivered_at_send = delivered;
+            pkt.delivered_time_at_send = delivered_time;
+            window.setAcked(next_seq_num, false);
+            pkt.payload_size = chunk_len;
+            pkt.header.crc = 0;
+            pkt.header.block_size = compressor ? compressor->blockSize(next_seq_num) : 0;
+
+            // iovec payload trỏ thẳng vào file nguồn (mmap) hoặc bản nén, không copy ở user space
             pkt.send_time = now;
-            ssize_t sent = sendto(sock, pkt.data.data(), pkt.data.size(), 0,
-                                 (struct sockaddr*)&receiver_addr, sizeof(receiver_addr));
+            if (crc_mode) {
+                pkt.header.crc = dataPacketCrc(&pkt.header, header_size, payload, pkt.payload_size);
+                digestChunk(next_seq_num, payload, pkt.payload_size);
+            }
+            io.add(receiver_addr, &pkt.header, header_size, payload, pkt.payload_size);
+            retransmit_timers.schedule(window.index(next_seq_num), now + rtt.rto(0));
+            pacer.consume(std::chrono::high_resolution_clock::now(), header_size + pkt.payload_size);
+            total_bytes_sent += pkt.payload_size;
 
-            if (sent > 0) {
-                window[next_seq_num] = pkt;
-                total_bytes_sent += (sent - HEADER_SIZE);
+            if (io.full()) {
+                io.flush();
             }
-            
+
+            if (fec_mode) {
+                fec->add(payload, pkt.payload_size);
+                if (fec->count() == fec_k || next_seq_num == total_packets) {
+                    closeFecBlock(next_seq_num, now);
+                    beginFecBlock(next_seq_num + 1);
+                }
+            }
+
             next_seq_num++;
         }
+        io.flush();
+        if (base != base_before_send) {
+            wire.release((uint64_t)(base - 1) * chunk_size);
+        }
 
-        // Kiểm tra timeout và gửi lại
-        for (auto& pair : window) {
-            uint32_t seq = pair.first;
-            WindowPacket& pkt = pair.second;
-            
-            if (!pkt.acked) {
-                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - pkt.send_time);
-                
-                if (elapsed.count() >= ACK_TIMEOUT_MS) {
-                    pkt.send_time = now;
-                    pkt.retry_count++;
-                    
-                    sendto(sock, pkt.data.data(), pkt.data.size(), 0,
-                          (struct sockaddr*)&receiver_addr, sizeof(receiver_addr));
-                    total_retransmissions++;
+        // Đọc hết ACK đang chờ trong socket (không block)
+        uint32_t old_base = base;
+        uint64_t delivered_before = delivered;
+        int ack_count;
+        while ((ack_count = io.receive(MSG_DONTWAIT)) > 0) {
+            auto ack_time = std::chrono::high_resolution_clock::now();
+            ack_sample = AckSample();
+            ack_sample.now = ack_time;
+
+            for (int i = 0; i < ack_count; i++) {
+                const char* ack_data = io.data(i);
+                size_t ack_len = io.length(i);
+
+                if (isControlPacket(ack_data, ack_len)) {
+                    // Chunk tới nơi nhưng sai CRC: gửi lại ngay nếu vẫn chưa được ACK
+                    if (controlType(ack_data) == CTRL_NACK && ack_len >= sizeof(NackPacket)) {
+                        uint32_t seq = ((const NackPacket*)ack_data)->pkt_num;
+                        if (seq >= base && seq < next_seq_num && !window.isAcked(seq)) {
+                            retransmitPacket(window.index(seq), ack_time, RETRANSMIT_CORRUPT);
+                        }
+                        continue;
+                    }
+                    if (DigestPacket::matches(ack_data, ack_len) &&
+                        ((const DigestPacket*)ack_data)->status != DIGEST_REQUEST) {
+                        memcpy(&digest_reply, ack_data, sizeof(digest_reply));
+                        digest_status = digest_reply.status;
+                        receiver_stopped = true;
+                        continue;
+                    }
+                    if (controlType(ack_data) != CTRL_SACK || ack_len < sizeof(SackPacket)) {
+                        continue;  // SYN-ACK gửi lại hoặc gói điều khiển khác
+                    }
+
+                    // Cumulative ACK: mọi packet < cum_ack đã tới receiver
+                    const SackPacket* sack = (const SackPacket*)ack_data;
+                    acks_received++;
+                    sacks_received++;
+
+                    uint32_t cum_ack = std::min(sack->cum_ack, next_seq_num);
+                    for (uint32_t seq = base; seq < cum_ack; seq++) {
+                        ackPacket(seq, ack_time);
+                    }
+
+                    // SACK bitmap: các packet đã tới nhưng còn nằm sau lỗ hổng
+                    for (int w = 0; w < SACK_BITS / 64; w++) {
+                        uint64_t bits = sack->sack[w];
+                        while (bits != 0) {
+                            uint32_t seq = sack->sack_base + w * 64 + __builtin_ctzll(bits);
+                            bits &= bits - 1;
+                            if (seq >= base && seq < next_seq_num) {
+                                ackPacket(seq, ack_time);
+                            }
+                        }
+                    }
+                    continue;
+                }
+
+                if (ack_len < sizeof(AckPacket)) {
+                    continue;
                 }
+
+                const AckPacket* ack = (const AckPacket*)ack_data;
+                uint32_t ack_num = ack->ack_num;
+                acks_received++;
+
+                if (ack_num >= base && ack_num < next_seq_num) {
+                    ackPacket(ack_num, ack_time);
+                }
+            }
+
+            if (ack_sample.newly_acked > 0) {
+                ack_sample.delivered = delivered;
+                ack_sample.inflight = (next_seq_num - base) - acked_in_window;
+                cc->onAck(ack_sample);
+                delivered_time = ack_time;
             }
         }
 
-        // Nhận ACK
-        AckPacket ack;
-        struct sockaddr_in ack_addr;
-        socklen_t ack_addr_len = sizeof(ack_addr);
-        
-        ssize_t ack_recv = recvfrom(sock, &ack, sizeof(ack), 0,
-                                   (struct sockaddr*)&ack_addr, &ack_addr_len);
+        while (base < next_seq_num && window.isAcked(base)) {
+            window.setAcked(base, false);
+            acked_in_window--;
+            base++;
+        }
+        if (base != old_base) {
+            wire.release((uint64_t)(base - 1) * chunk_size);
+        }
 
-        if (ack_recv > 0) {
-            uint32_t ack_num = ack.ack_num;
-            acks_received++;
+        // Fast retransmit: có ACK mới thì xét các lỗ hổng trước packet cao nhất
+        // đã được ACK, gửi lại ngay những packet FACK/RACK coi là mất. Chỉ
+        // xét các mục trong loss_candidates, không quét lại cả window
+        if (fast_retransmit && delivered != delivered_before) {
+            auto scan_time = std::chrono::high_resolution_clock::now();
+            loss_candidates.discover(base, std::min(loss_detector.highestAcked(), next_seq_num),
+                                     [&](uint32_t seq, std::chrono::high_resolution_clock::time_point& send_time) {
+                if (window.isAcked(seq)) {
+                    return false;
+                }
+                send_time = window.slot(seq).send_time;
+                return true;
+            });
+            loss_candidates.scan([&](const LossCandidates::Entry& entry) {
+                uint32_t seq = entry.pkt_num;
+                if (seq < base || window.isAcked(seq)) {
+                    return true;
+                }
+                WindowSlot& pkt = window.slot(seq);
+                if (pkt.send_time != entry.send_time) {
+                    return true;  // Đã gửi lại sau đó, lần gửi mới có mục riêng
+                }
+                auto send_time = pkt.send_time;
+                if (fec_mode) {
+                    // Chunk của block có repair: chỉ coi là mất khi packet gửi sau
+                    // repair được ACK (receiver đã có cơ hội dựng lại chunk đó)
+                    uint64_t block = (seq - 1) / fec_k;
+                    if (block >= fec_blocks) {
+                        return false;  // Block chưa gửi repair
+                    }
+                    send_time = std::max(send_time, fec_repair_times[block % fec_repair_times.size()]);
+                }
+                if (!loss_detector.isLost(seq, send_time, scan_time, rtt.minUs())) {
+                    return false;
+                }
+                retransmitPacket(window.index(seq), scan_time, RETRANSMIT_FAST);
+                return true;
+            });
+            io.flush();
+        }
 
-            if (window.find(ack_num) != window.end()) {
-                window[ack_num].acked = true;
+        // Gửi lại các packet có timer đã tới hạn (RTO có backoff theo retry_count).
+        // Chạy sau khi đã đọc hết ACK: ACK nằm sẵn trong socket thì không tính là timeout
+        auto expire_time = std::chrono::high_resolution_clock::now();
+        retransmit_timers.expire(expire_time, [&](uint32_t index) {
+            // Chunk trong block FEC chưa gửi repair: chờ repair thêm tối đa một RTO
+            WindowSlot& pkt = window.slotAt(index);
+            if (fec_mode && pkt.retry_count == 0 && (pkt.header.pkt_num - 1) / fec_k >= fec_blocks &&
+                expire_time - pkt.send_time < 2 * rtt.rto(0)) {
+                retransmit_timers.schedule(index, pkt.send_time + 2 * rtt.rto(0));
+                return;
             }
-            
-            while (window.find(base) != window.end() && window[base].acked) {
-                window.erase(base);
-                base++;
+            retransmitPacket(index, expire_time, RETRANSMIT_TIMEOUT);
+        });
+        io.flush();
+        uint64_t inflight = (next_seq_num - base) - acked_in_window;
+
+        if (now - last_cwnd_sample_time >= std::chrono::milliseconds(CWND_SAMPLE_MS)) {
+            cwnd_history.push_back({std::chrono::duration<double, std::milli>(now - start_time).count(),
+                                    cc->cwnd(), inflight, rtt.srttUs()});
+            last_cwnd_sample_time = now;
+        }
+
+        // Chỉ chờ khi window/cwnd thực sự đầy (hoặc đã gửi hết) và chưa tới hạn gửi lại:
+        // ngủ đúng tới khi có ACK hoặc tới deadline gửi lại gần nhất. Nếu chỉ
+        // thiếu token pacing thì ngủ tới lúc pacer cho gửi (ACK tới vẫn đánh thức).
+        bool window_full = next_seq_num >= base + window.capacity() || next_seq_num > total_packets ||
+                           inflight >= effectiveWindow();
+        bool pacing_blocked = !window_full && base <= total_packets &&
+                              !pacer.ready(std::chrono::high_resolution_clock::now());
+        std::chrono::high_resolution_clock::time_point next_deadline;
+        if (!retransmit_timers.nextDeadline(next_deadline)) {
+            next_deadline = now + rtt.rto(0);
+        }
+        if (pacing_blocked) {
+            next_deadline = std::min(next_deadline, pacer.readyTime(std::chrono::high_resolution_clock::now()));
+            pacer.countWait();
+        }
+        if ((window_full && base == old_base && base <= total_packets) || pacing_blocked) {
+            auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                next_deadline - std::chrono::high_resolution_clock::now());
+            if (wait.count() > 0) {
+                struct pollfd pfd;
+                pfd.fd = io.fd();
+                pfd.events = POLLIN;
+                struct timespec ts;
+                ts.tv_sec = wait.count() / 1000000000;
+                ts.tv_nsec = wait.count() % 1000000000;
+                ppoll(&pfd, 1, &ts, nullptr);
+                poll_waits++;
             }
         }
 
         // Hiển thị tiến trình
         auto progress_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_progress_time);
-        if (progress_elapsed.count() >= 500) {
+        if (config.show_progress && progress_elapsed.count() >= 500) {
             float progress = (float)(base - 1) / total_packets * 100;
             auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time);
             double speed = (total_bytes_sent / 1024.0 / 1024.0) / (elapsed.count() / 1000.0);
@@ -302,6 +970,7 @@ int main(int argc, char* argv[]) {
                      << " (" << std::fixed << std::setprecision(1) << progress << "%) - "
                      << std::setprecision(2) << speed << " MB/s - "
                      << "Window: [" << base << "-" << (next_seq_num - 1) << "] - "
+                     << "cwnd: " << std::setprecision(1) << cc->cwnd() << " - "
                      << "Retrans: " << total_retransmissions << std::flush;
             
             last_progress_time = now;
@@ -312,24 +981,477 @@ int main(int argc, char* argv[]) {
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
 
-    std::cout << "\n\n=== KẾT QUẢ GỬI (Selective Repeat) ===" << std::endl;
-    std::cout << "Window size đã sử dụng: " << negotiated_window << std::endl;
-    std::cout << "Tổng thời gian: " << std::fixed << std::setprecision(3) 
+    // Xác nhận toàn vẹn cả đoạn bằng digest (không tính vào thời gian truyền)
+    if (crc_mode && !source_error && !receiver_stopped && exchangeDigest(io, receiver_addr, digest, digest_reply)) {
+        digest_status = digest_reply.status;
+    }
+
+    if (config.show_progress) {
+        std::cout << "\n" << std::endl;
+    }
+    if (source_error) {
+        report << "✗ Lỗi đọc file nguồn tại offset " << source_error_offset
+               << " (lỗi I/O hoặc file bị cắt ngắn), dừng truyền" << std::endl;
+    }
+    if (receiver_stopped) {
+        report << "✗ Receiver dừng nhận giữa chừng (giải nén block lỗi), dừng truyền" << std::endl;
+    }
+    report << "=== KẾT QUẢ GỬI (Selective Repeat) ===" << std::endl;
+    report << "Window size đã sử dụng: " << negotiated.window << std::endl;
+    report << "Tổng thời gian: " << std::fixed << std::setprecision(3) 
               << duration.count() / 1000.0 << " giây" << std::endl;
-    std::cout << "Tổng số packets: " << total_packets << std::endl;
-    std::cout << "ACKs nhận được: " << acks_received << std::endl;
-    std::cout << "Tổng số lần truyền lại: " << total_retransmissions << std::endl;
-    std::cout << "Tỷ lệ truyền lại: " << std::setprecision(2)
+    report << "Tổng số packets: " << total_packets << std::endl;
+    report << "Payload mỗi packet: " << chunk_size << " bytes (gói IP " << wire_packet_size + IP_UDP_HEADERS_SIZE
+           << " bytes)" << std::endl;
+    report << "Kiểu ACK: " << ((negotiated.features & FEATURE_SACK) ? "cumulative + SACK" : "từng packet") << std::endl;
+    report << "ACKs nhận được: " << acks_received << " (SACK: " << sacks_received << ")" << std::endl;
+    report << "Tổng số lần truyền lại: " << total_retransmissions << " (timeout: " << timeout_retransmissions
+              << ", fast retransmit: " << fast_retransmissions;
+    if (crc_mode) {
+        report << ", sai CRC: " << corrupt_retransmissions;
+    }
+    report << ")" << std::endl;
+    report << "Tỷ lệ truyền lại: " << std::setprecision(2)
               << (total_packets > 0 ? (total_retransmissions * 100.0 / total_packets) : 0) << "%" << std::endl;
-    std::cout << "Tổng dữ liệu đã gửi: " << std::setprecision(2) 
+    report << "Tổng dữ liệu đã gửi: " << std::setprecision(2) 
               << total_bytes_sent / 1024.0 / 1024.0 << " MB" << std::endl;
-    std::cout << "Tốc độ trung bình: " << std::setprecision(2) 
+    if (negotiated.features & FEATURE_RESUME) {
+        report << "Truyền tiếp: bỏ qua " << resumed_packets << "/" << total_packets << " chunk receiver đã có ("
+               << std::setprecision(2) << resumed_bytes / 1024.0 / 1024.0 << " MB)" << std::endl;
+    }
+    if (compressor) {
+        BlockCompressor::Stats stats = compressor->stats();
+        report << "Nén " << compressCodecName(negotiated.codec) << ": " << stats.compressed_blocks << " block nén, "
+               << stats.skipped_blocks << " bỏ qua (mẫu không nén được), " << stats.stored_blocks
+               << " gửi nguyên (nén không bớt được chunk)" << std::endl;
+        report << "Tỷ lệ nén: " << std::setprecision(2)
+               << (stats.wire_bytes > 0 ? (double)stats.raw_bytes / stats.wire_bytes : 0) << "x ("
+               << stats.raw_bytes / 1024.0 / 1024.0 << " MB -> " << stats.wire_bytes / 1024.0 / 1024.0 << " MB), "
+               << padding_packets << " chunk không phải gửi, CPU nén " << std::setprecision(3) << stats.cpu_seconds
+               << " s trên " << config.compress_pool->size() << " luồng" << std::endl;
+    }
+    if (fec_mode) {
+        report << "FEC: block " << fec_k << " chunk, " << repairs_sent << " repair (" << std::setprecision(2)
+               << (fec_blocks > 0 ? (double)repairs_sent / fec_blocks : 0) << "/block, m cuối " << fec_repairs
+               << "), overhead " << (total_bytes_sent > 0 ? repair_bytes_sent * 100.0 / total_bytes_sent : 0)
+               << "%, tỷ lệ mất ước lượng " << fec_loss * 100 << "%, GF(256) " << Gf256::instance().kernel() << std::endl;
+    }
+    if (crc_mode) {
+        report << "CRC32C từng chunk: " << Crc32c::instance().kernel() << std::endl;
+        report << "Digest XXH64: " << std::hex << std::setw(16) << std::setfill('0') << digest.digest() << std::dec
+               << std::setfill(' ') << " (" << digest.size() << " bytes) - receiver: ";
+        if (digest_status == DIGEST_MATCH) {
+            report << "khớp" << std::endl;
+        } else if (digest_status == DIGEST_MISMATCH) {
+            report << "KHÔNG KHỚP (receiver tính được " << std::hex << std::setw(16) << std::setfill('0')
+                   << digest_reply.digest << std::dec << std::setfill(' ') << ")" << std::endl;
+        } else if (digest_status == DIGEST_INCOMPLETE) {
+            report << "chưa nhận đủ dữ liệu" << std::endl;
+        } else {
+            report << "không trả lời" << std::endl;
+        }
+    }
+    report << "Mẫu RTT: " << rtt.samples() << std::endl;
+    report << "RTT min/avg/p99: " << std::setprecision(1) << rtt.minUs() << " / "
+              << rtt.avgUs() << " / " << rtt.percentileUs(99) << " µs" << std::endl;
+    report << "SRTT: " << rtt.srttUs() << " µs - RTTVAR: " << rtt.rttvarUs()
+              << " µs - RTO cuối: " << rtt.rto(0).count() << " µs" << std::endl;
+    report << "Điều khiển tắc nghẽn: " << cc->name() << std::endl;
+    if (!cwnd_history.empty()) {
+        double cwnd_min = cwnd_history[0].cwnd, cwnd_max = cwnd_history[0].cwnd, cwnd_sum = 0;
+        for (const CwndSample& sample : cwnd_history) {
+            cwnd_min = std::min(cwnd_min, sample.cwnd);
+            cwnd_max = std::max(cwnd_max, sample.cwnd);
+            cwnd_sum += sample.cwnd;
+        }
+        report << "cwnd min/avg/max: " << std::setprecision(1) << cwnd_min << " / "
+                  << cwnd_sum / cwnd_history.size() << " / " << cwnd_max
+                  << " packets (" << cwnd_history.size() << " mẫu, mỗi " << CWND_SAMPLE_MS << " ms)" << std::endl;
+    }
+    report << "cwnd cuối: " << std::setprecision(1) << cc->cwnd() << " packets" << std::endl;
+    if (!config.cwnd_log_path.empty()) {
+        std::ofstream cwnd_log(config.cwnd_log_path);
+        if (cwnd_log.is_open()) {
+            cwnd_log << "elapsed_ms,cwnd,inflight,srtt_us\n";
+            for (const CwndSample& sample : cwnd_history) {
+                cwnd_log << sample.elapsed_ms << "," << sample.cwnd << ","
+                         << sample.inflight << "," << sample.srtt_us << "\n";
+            }
+            report << "Đã ghi cwnd theo thời gian vào: " << config.cwnd_log_path << std::endl;
+        } else {
+            std::cerr << "Không thể ghi file cwnd: " << config.cwnd_log_path << std::endl;
+        }
+    }
+    if (pacer.averageTargetRate() > 0) {
+        report << "Pacing mục tiêu: " << std::setprecision(2) << pacer.averageTargetRate() * 8 / 1e6
+                  << " Mbps - thực tế: " << pacer.achievedRate() * 8 / 1e6
+                  << " Mbps (" << pacer.waits() << " lần chờ)" << std::endl;
+    } else {
+        report << "Pacing: tắt" << std::endl;
+    }
+    report << "Batch size: " << batch_size << std::endl;
+    report << "Số lần chờ ACK (ppoll): " << poll_waits << std::endl;
+    report << "Backend: " << io.name() << std::endl;
+    report << io.sendCall() << ": " << io.sendStats().calls << " lần gọi, "
+              << io.sendStats().packets << " packets, "
+              << std::setprecision(2) << io.sendStats().packetsPerCall() << " packets/lần, "
+              << "tối đa " << io.sendStats().max_batch << std::endl;
+    report << io.receiveCall() << " (ACK): " << io.receiveStats().calls << " lần gọi, "
+              << io.receiveStats().packets << " ACKs, "
+              << std::setprecision(2) << io.receiveStats().packetsPerCall() << " ACKs/lần, "
+              << "tối đa " << io.receiveStats().max_batch << std::endl;
+    io.printStats(report);
+    report << "Tốc độ trung bình: " << std::setprecision(2) 
               << (total_bytes_sent / 1024.0 / 1024.0) / (duration.count() / 1000.0) 
               << " MB/s" << std::endl;
-    std::cout << "Tốc độ trung bình: " << std::setprecision(2) 
+    report << "Tốc độ trung bình: " << std::setprecision(2) 
               << (total_bytes_sent * 8.0 / 1024.0 / 1024.0) / (duration.count() / 1000.0) 
               << " Mbps" << std::endl;
+    if (compressor) {
+        report << "Goodput (dữ liệu gốc): " << std::setprecision(2)
+               << (file_size * 8.0 / 1024.0 / 1024.0) / (duration.count() / 1000.0) << " Mbps" << std::endl;
+    }
+
+    TransferResult result;
+    result.bytes_sent = total_bytes_sent;
+    result.file_bytes = file_size;
+    result.packets = total_packets;
+    result.retransmissions = total_retransmissions;
+    result.digest_status = digest_status;
+    result.source_error = source_error;
+    result.receiver_stopped = receiver_stopped;
+    result.rtt_avg_us = rtt.avgUs();
+    result.start_time = start_time;
+    result.end_time = end_time;
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <file_path> <receiver_ip> <port> [--batch N] [--window N] [--no-sack]"
+                  << " [--rate Mbps | --no-pacing] [--no-fast-retransmit] [--mem-mb N]"
+                  << " [--cc reno|bbr|fixed] [--cwnd-log file.csv] [--streams N] [--chunk N] [--no-pmtu-probe] [--fec K] [--crc]"
+                  << " [--compress lz4|zstd] [--compress-threads N] "
+                  PACKET_IO_USAGE << std::endl;
+        return 1;
+    }
+
+    const char* file_path = argv[1];
+    const char* receiver_ip = argv[2];
+    int port = std::stoi(argv[3]);
+    // Luôn đề nghị truyền tiếp: receiver chỉ nhận khi có checkpoint (--resume ở receiver)
+    HandshakeParams proposed = {DEFAULT_WINDOW_SIZE, FEATURE_SACK | FEATURE_RESUME, CHUNK_SIZE, 0};
+    size_t batch_size = DEFAULT_BATCH_SIZE;
+    std::string cc_name = "reno";
+    const char* cwnd_log_path = nullptr;
+    double rate_mbps = 0;   // > 0: pacing cố định; 0: theo cwnd/RTT
+    bool pacing = true;
+    bool fast_retransmit = true;
+    size_t memory_mb = 0;   // 0 = mmap cả file
+    uint32_t streams = 1;   // > 1: truyền song song, mỗi stream một đoạn file
+    size_t max_chunk = MAX_CHUNK_SIZE;  // --chunk: giới hạn trên của chunk size
+    bool pmtu_probe = true;  // false: không dò path MTU, đề xuất luôn --chunk (mặc định CHUNK_SIZE)
+    uint32_t fec_k = 0;      // > 0: FEC, mỗi block K chunk kèm repair
+    unsigned compress_threads = std::thread::hardware_concurrency();
+    PacketIoConfig io_config;
+
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--batch" && i + 1 < argc) {
+            batch_size = std::stoul(argv[++i]);
+        } else if (arg == "--no-sack") {
+            proposed.features &= ~FEATURE_SACK;
+        } else if (arg == "--window" && i + 1 < argc) {
+            proposed.window = std::stoul(argv[++i]);
+        } else if (arg == "--rate" && i + 1 < argc) {
+            rate_mbps = std::stod(argv[++i]);
+        } else if (arg == "--no-pacing") {
+            pacing = false;
+        } else if (arg == "--mem-mb" && i + 1 < argc) {
+            memory_mb = std::stoul(argv[++i]);
+        } else if (arg == "--no-fast-retransmit") {
+            fast_retransmit = false;
+        } else if (arg == "--cc" && i + 1 < argc) {
+            cc_name = argv[++i];
+        } else if (arg == "--cwnd-log" && i + 1 < argc) {
+            cwnd_log_path = argv[++i];
+        } else if (arg == "--streams" && i + 1 < argc) {
+            streams = std::stoul(argv[++i]);
+        } else if (arg == "--chunk" && i + 1 < argc) {
+            max_chunk = std::stoul(argv[++i]);
+        } else if (arg == "--no-pmtu-probe") {
+            pmtu_probe = false;
+        } else if (arg == "--crc") {
+            proposed.features |= FEATURE_CRC;
+        } else if (arg == "--fec" && i + 1 < argc) {
+            fec_k = std::min<uint32_t>(std::stoul(argv[++i]), FEC_MAX_K);
+        } else if (arg == "--compress" && i + 1 < argc) {
+            proposed.codec = parseCompressCodec(argv[++i]);
+            if (proposed.codec == COMPRESS_NONE) {
+                std::cerr << "Codec nén không hợp lệ: " << argv[i] << " (lz4 hoặc zstd)" << std::endl;
+                return 1;
+            }
+            if (!compressCodecSupported(proposed.codec)) {
+                std::cerr << "Bản build này không có " << argv[i] << " (cần biên dịch với -DHAVE_ZSTD -lzstd)" << std::endl;
+                return 1;
+            }
+            proposed.features |= FEATURE_COMPRESS;
+        } else if (arg == "--compress-threads" && i + 1 < argc) {
+            compress_threads = std::stoul(argv[++i]);
+        } else if (parsePacketIoOption(argc, argv, i, io_config)) {
+            // --backend, --iface, --queue, --xdp-mode, --dst-mac, --gso
+        } else {
+            std::cerr << "Tham số không hợp lệ: " << arg << std::endl;
+            return 1;
+        }
+    }
+    batch_size = std::max<size_t>(1, std::min<size_t>(batch_size, MAX_BATCH_SIZE));
+    proposed.window = std::max<uint32_t>(1, std::min<uint32_t>(proposed.window, MAX_SCALED_WINDOW));
+    streams = std::max<uint32_t>(1, std::min<uint32_t>(streams, MAX_STREAMS));
+    bool chunk_given = max_chunk != MAX_CHUNK_SIZE;
+    max_chunk = std::max<size_t>(1, std::min<size_t>(max_chunk, MAX_CHUNK_SIZE));
+    if (streams > 1 && memory_mb > 0) {
+        std::cerr << "--streams cần mmap cả file nguồn, không dùng cùng --mem-mb" << std::endl;
+        return 1;
+    }
+    if (streams > 1 && io_config.backend == "xdp") {
+        // Mỗi queue chỉ gắn được một AF_XDP socket
+        std::cerr << "--streams dùng UDP socket cho từng stream (không dùng --backend xdp)" << std::endl;
+        io_config.backend = "udp";
+    }
+    if (fec_k > 0 && (proposed.features & FEATURE_COMPRESS)) {
+        // Repair mã hóa theo chunk gốc, còn block nén gửi ít chunk hơn
+        std::cerr << "--fec chưa dùng được cùng --compress" << std::endl;
+        return 1;
+    }
+    if (proposed.features & FEATURE_COMPRESS) {
+        // Một chunk hỏng làm hỏng cả block khi giải nén: luôn kiểm tra CRC từng chunk
+        proposed.features |= FEATURE_CRC;
+    }
+    if (!createCongestionControl(cc_name, 1)) {
+        std::cerr << "Thuật toán điều khiển tắc nghẽn không hợp lệ: " << cc_name << std::endl;
+        return 1;
+    }
+
+    std::cout << "Sử dụng giao thức: Selective Repeat với Handshake (16-bit)" << std::endl;
+
+    // Mở file: mmap cả file, hoặc đọc theo luồng với bộ nhớ giới hạn (--mem-mb)
+    std::unique_ptr<FileSource> source = openFileSource(file_path, memory_mb * 1024 * 1024);
+    if (!source) {
+        std::cerr << "Không thể mở file: " << file_path << std::endl;
+        return 1;
+    }
+
+    uint64_t file_size = source->size();
+
+    std::cout << "Kích thước file: " << file_size << " bytes (" 
+              << std::fixed << std::setprecision(2) << file_size / 1024.0 / 1024.0 << " MB)" << std::endl;
+    std::cout << "Nguồn dữ liệu: " << source->name();
+    if (memory_mb > 0) {
+        std::cout << " (ring " << source->capacity() / 1024 / 1024 << " MB)";
+    }
+    std::cout << std::endl;
+    proposed.file_size = file_size;
+
+    // Cấu hình địa chỉ receiver
+    struct sockaddr_in receiver_addr;
+    memset(&receiver_addr, 0, sizeof(receiver_addr));
+    receiver_addr.sin_family = AF_INET;
+    receiver_addr.sin_port = htons(port);
+    inet_pton(AF_INET, receiver_ip, &receiver_addr.sin_addr);
+
+    SenderConfig config;
+    config.batch_size = batch_size;
+    config.cc_name = cc_name;
+    config.cwnd_log_path = cwnd_log_path != nullptr ? cwnd_log_path : "";
+    config.rate_mbps = rate_mbps / streams;  // --rate là tổng của mọi stream
+    config.pacing = pacing;
+    config.fast_retransmit = fast_retransmit;
+    config.fec_k = fec_k;
+    config.show_progress = streams == 1;
+
+    // Một pool nén cho mọi stream: tổng số luồng nén không phụ thuộc --streams
+    std::unique_ptr<WorkerPool> compress_pool;
+    if (proposed.features & FEATURE_COMPRESS) {
+        compress_pool.reset(new WorkerPool(compress_threads));
+        std::cout << "Nén " << compressCodecName(proposed.codec) << " trên " << compress_pool->size() << " luồng" << std::endl;
+    }
+    config.compress_pool = compress_pool.get();
+
+    // Mỗi stream: socket riêng (port tạm riêng), handshake riêng, luồng riêng gửi
+    // một đoạn liền nhau của file (chia theo chunk). Handshake lần lượt từng
+    // stream: receiver chỉ gắn socket kế tiếp với stream mới khi stream trước
+    // đã bắt tay xong. Một stream thì gửi luôn trên luồng chính như trước.
+    struct Stream {
+        std::unique_ptr<PacketIo> io;
+        std::unique_ptr<FileSource> range_source;
+        HandshakeParams negotiated;
+        SenderConfig config;
+        TransferResult result;
+        std::ostringstream report;
+        std::thread thread;
+    };
+    std::vector<Stream> stream_list(streams);
+    uint64_t total_chunks = 0;
+    bool handshake_ok = true;
+
+    for (uint32_t i = 0; i < streams; i++) {
+        Stream& stream = stream_list[i];
+
+        // Đường gửi/nhận: UDP socket, hoặc AF_XDP socket với --backend xdp
+        // (batch I/O: header + payload của mỗi packet gom vào một lần gửi)
+        stream.io = openPacketIo(io_config, 0, &receiver_addr, batch_size, sizeof(SackPacket));
+        if (!stream.io) {
+            std::cerr << "Không thể tạo socket" << std::endl;
+            handshake_ok = false;
+            break;
+        }
+        std::cout << "Backend: " << stream.io->name() << std::endl;
+
+        // Timeout cho probe và handshake
+        stream.io->setReceiveTimeout(100);
+
+        // Chunk size đề xuất: dò path MTU một lần trên stream đầu, mọi stream dùng chung
+        if (i == 0) {
+            if (pmtu_probe) {
+                proposed.chunk_size = probeChunkSize(*stream.io, receiver_addr, max_chunk);
+            } else {
+                proposed.chunk_size = std::min<size_t>(chunk_given ? max_chunk : CHUNK_SIZE,
+                                                       stream.io->maxPayload() - HEADER_SIZE);
+            }
+            if (fec_k > 0) {
+                proposed.features |= FEATURE_FEC;
+            }
+            // Header CRC và repair packet dài hơn header 4 byte, vẫn phải qua được path MTU
+            proposed.chunk_size -= std::min<size_t>(proposed.chunk_size - 1,
+                                                    packetHeaderSize(proposed.features) - HEADER_SIZE);
+            total_chunks = (file_size + proposed.chunk_size - 1) / proposed.chunk_size;
+
+            // Dữ liệu chưa được ACK phải nằm gọn trong ring đọc trước (giữ nửa ring để đọc trước)
+            if (source->capacity() != UINT64_MAX) {
+                uint32_t ring_window = std::max<uint64_t>(1, source->capacity() / 2 / proposed.chunk_size);
+                if (proposed.window > ring_window) {
+                    std::cout << "Giới hạn window theo --mem-mb: " << ring_window << " packets" << std::endl;
+                    proposed.window = ring_window;
+                }
+            }
+        }
+
+        HandshakeParams stream_proposed = proposed;
+        FileSource* stream_source = source.get();
+        stream.config = config;
+        if (streams > 1) {
+            uint64_t first = std::min(total_chunks * i / streams * proposed.chunk_size, file_size);
+            uint64_t last = std::min(total_chunks * (i + 1) / streams * proposed.chunk_size, file_size);
+            stream_proposed.features |= FEATURE_STREAMS;
+            stream_proposed.range = StreamRange{first, last - first, (uint16_t)i, (uint16_t)streams, 0};
+            stream.range_source.reset(new RangeFileSource(*source, first, last - first));
+            stream_source = stream.range_source.get();
+            if (!config.cwnd_log_path.empty()) {
+                stream.config.cwnd_log_path = config.cwnd_log_path + "." + std::to_string(i);
+            }
+            std::cout << "\n--- Stream " << i << "/" << streams << ": byte " << first << " - " << last << " ---" << std::endl;
+        }
+
+        // Thực hiện handshake và thỏa thuận window size
+        if (!performHandshake(*stream.io, receiver_addr, stream_proposed, stream.negotiated)) {
+            std::cerr << "Không thể kết nối đến receiver!" << std::endl;
+            handshake_ok = false;
+            break;
+        }
+        if (streams > 1 && !(stream.negotiated.features & FEATURE_STREAMS)) {
+            std::cerr << "Receiver không hỗ trợ truyền song song (chạy receiver với --streams)" << std::endl;
+            handshake_ok = false;
+            break;
+        }
+
+        if ((proposed.features & FEATURE_COMPRESS) && !(stream.negotiated.features & FEATURE_COMPRESS)) {
+            std::cout << "Receiver không nhận nén " << compressCodecName(proposed.codec) << ", gửi dữ liệu nguyên" << std::endl;
+        }
+
+        std::cout << "Sử dụng window size: " << stream.negotiated.window << std::endl;
+        if (streams == 1) {
+            stream.result = sendFile(*stream.io, receiver_addr, *stream_source, stream.negotiated,
+                                     stream.config, std::cout);
+        } else {
+            stream.thread = std::thread([&stream, &receiver_addr, stream_source] {
+                stream.result = sendFile(*stream.io, receiver_addr, *stream_source, stream.negotiated,
+                                         stream.config, stream.report);
+            });
+        }
+    }
+
+    for (Stream& stream : stream_list) {
+        if (stream.thread.joinable()) {
+            stream.thread.join();
+        }
+    }
+    if (!handshake_ok) {
+        return 1;
+    }
+    // Đã thỏa thuận CRC thì receiver phải xác nhận digest khớp (không khớp,
+    // thiếu dữ liệu hay không trả lời đều là truyền lỗi)
+    bool crc_mode = stream_list[0].negotiated.features & FEATURE_CRC;
+    if (streams == 1) {
+        const TransferResult& result = stream_list[0].result;
+        bool failed = result.source_error || result.receiver_stopped || (crc_mode && result.digest_status != DIGEST_MATCH);
+        return failed ? 1 : 0;
+    }
+
+    // Báo cáo từng stream, rồi tổng hợp: thời gian tính từ stream bắt đầu sớm
+    // nhất tới stream kết thúc muộn nhất
+    auto first_start = stream_list[0].result.start_time;
+    auto last_end = stream_list[0].result.end_time;
+    uint64_t total_bytes_sent = 0;
+    uint64_t total_file_bytes = 0;
+    uint64_t total_retransmissions = 0;
+    uint32_t digests_matched = 0;
+    uint32_t source_errors = 0;
+    uint32_t receivers_stopped = 0;
+    for (uint32_t i = 0; i < streams; i++) {
+        std::cout << "\n--- Stream " << i << " ---\n" << stream_list[i].report.str();
+        first_start = std::min(first_start, stream_list[i].result.start_time);
+        last_end = std::max(last_end, stream_list[i].result.end_time);
+    }
+
+    std::cout << "\n=== TỔNG HỢP " << streams << " STREAM ===" << std::endl;
+    for (uint32_t i = 0; i < streams; i++) {
+        const TransferResult& result = stream_list[i].result;
+        double seconds = std::chrono::duration<double>(result.end_time - result.start_time).count();
+        std::cout << "Stream " << i << ": " << std::fixed << std::setprecision(2)
+                  << result.bytes_sent / 1024.0 / 1024.0 << " MB, " << std::setprecision(3) << seconds << " giây, "
+                  << std::setprecision(2) << (seconds > 0 ? result.bytes_sent * 8.0 / 1024.0 / 1024.0 / seconds : 0)
+                  << " Mbps, truyền lại " << result.retransmissions << "/" << result.packets
+                  << ", RTT avg " << std::setprecision(1) << result.rtt_avg_us << " µs" << std::endl;
+        total_bytes_sent += result.bytes_sent;
+        total_file_bytes += result.file_bytes;
+        total_retransmissions += result.retransmissions;
+        digests_matched += result.digest_status == DIGEST_MATCH;
+        source_errors += result.source_error;
+        receivers_stopped += result.receiver_stopped;
+    }
+    double total_seconds = std::chrono::duration<double>(last_end - first_start).count();
+    std::cout << "Tổng thời gian: " << std::setprecision(3) << total_seconds << " giây" << std::endl;
+    std::cout << "Tổng số lần truyền lại: " << total_retransmissions << std::endl;
+    std::cout << "Tổng dữ liệu đã gửi: " << std::setprecision(2) << total_bytes_sent / 1024.0 / 1024.0 << " MB" << std::endl;
+    std::cout << "Tốc độ tổng: " << std::setprecision(2)
+              << (total_seconds > 0 ? total_bytes_sent * 8.0 / 1024.0 / 1024.0 / total_seconds : 0) << " Mbps" << std::endl;
+    if (compress_pool) {
+        std::cout << "Goodput (dữ liệu gốc): " << std::setprecision(2)
+                  << (total_seconds > 0 ? total_file_bytes * 8.0 / 1024.0 / 1024.0 / total_seconds : 0) << " Mbps" << std::endl;
+    }
+    if (crc_mode) {
+        std::cout << "Digest khớp: " << digests_matched << "/" << streams << " stream" << std::endl;
+    }
+    if (source_errors > 0) {
+        std::cout << "Dừng vì lỗi đọc file nguồn: " << source_errors << "/" << streams << " stream" << std::endl;
+    }
+    if (receivers_stopped > 0) {
+        std::cout << "Receiver dừng nhận (giải nén lỗi): " << receivers_stopped << "/" << streams << " stream" << std::endl;
+    }
+    if (source_errors > 0 || receivers_stopped > 0 || (crc_mode && digests_matched < streams)) {
+        return 1;
+    }
 
-    close(sock);
     return 0;
-}
\ No newline at end of file
+}
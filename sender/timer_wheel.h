@@ -0,0 +1,159 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#define TIMER_WHEEL_TICK_US 100
+#define TIMER_WHEEL_BUCKETS 8192   // Tầm nhìn một vòng: 8192 * 100 µs ~ 819 ms
+
+// Hashed timing wheel cho deadline gửi lại.
+// Mỗi entry (id = slot trong SendWindow) nằm trong danh sách liên kết đôi của
+// bucket deadline_tick % TIMER_WHEEL_BUCKETS, nên schedule/cancel đều O(1).
+// expire() chỉ duyệt các bucket từ lần xử lý trước tới hiện tại; entry có
+// deadline ở vòng sau được giữ lại. Bitmap bucket khác rỗng giúp tìm deadline
+// gần nhất mà không phải duyệt cả bánh xe.
+class TimerWheel {
+public:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    TimerWheel(uint32_t entries, Clock::time_point start)
+        : start_(start),
+          processed_tick_(0),
+          size_(0),
+          entries_(entries),
+          heads_(TIMER_WHEEL_BUCKETS, NONE),
+          occupied_(TIMER_WHEEL_BUCKETS / 64, 0) {}
+
+    size_t size() const { return size_; }
+
+    void schedule(uint32_t id, Clock::time_point deadline) {
+        cancel(id);
+
+        uint64_t tick = tickOf(deadline, true);
+        if (tick <= processed_tick_) {
+            tick = processed_tick_ + 1;  // Đã quá hạn: chạy ở lần expire kế tiếp
+        }
+
+        Entry& e = entries_[id];
+        e.deadline_tick = tick;
+        e.bucket = (int32_t)(tick % TIMER_WHEEL_BUCKETS);
+        e.prev = NONE;
+        e.next = heads_[e.bucket];
+        if (e.next != NONE) {
+            entries_[e.next].prev = id;
+        }
+        heads_[e.bucket] = id;
+        occupied_[e.bucket / 64] |= (1ULL << (e.bucket % 64));
+        size_++;
+    }
+
+    void cancel(uint32_t id) {
+        Entry& e = entries_[id];
+        if (e.bucket == NONE) {
+            return;
+        }
+
+        if (e.prev != NONE) {
+            entries_[e.prev].next = e.next;
+        } else {
+            heads_[e.bucket] = e.next;
+            if (e.next == NONE) {
+                occupied_[e.bucket / 64] &= ~(1ULL << (e.bucket % 64));
+            }
+        }
+        if (e.next != NONE) {
+            entries_[e.next].prev = e.prev;
+        }
+
+        e.bucket = NONE;
+        size_--;
+    }
+
+    // Gọi callback(id) cho mọi entry đã tới hạn. Callback được phép schedule lại id.
+    template <typename Callback>
+    void expire(Clock::time_point now, Callback callback) {
+        uint64_t now_tick = tickOf(now, false);
+        if (now_tick <= processed_tick_) {
+            return;
+        }
+
+        // Quá một vòng thì mỗi bucket chỉ cần duyệt một lần
+        uint64_t first = processed_tick_ + 1;
+        if (now_tick - processed_tick_ > TIMER_WHEEL_BUCKETS) {
+            first = now_tick - TIMER_WHEEL_BUCKETS + 1;
+        }
+        processed_tick_ = now_tick;
+
+        for (uint64_t tick = first; tick <= now_tick; tick++) {
+            uint32_t bucket = tick % TIMER_WHEEL_BUCKETS;
+            if (!((occupied_[bucket / 64] >> (bucket % 64)) & 1)) {
+                continue;
+            }
+
+            int32_t id = heads_[bucket];
+            while (id != NONE) {
+                int32_t next = entries_[id].next;
+                if (entries_[id].deadline_tick <= now_tick) {
+                    cancel(id);
+                    callback((uint32_t)id);
+                }
+                id = next;
+            }
+        }
+    }
+
+    // Thời điểm của bucket khác rỗng gần nhất (có thể sớm hơn deadline thật
+    // nếu entry trong đó thuộc vòng sau). Trả về false nếu không còn entry.
+    bool nextDeadline(Clock::time_point& deadline) const {
+        if (size_ == 0) {
+            return false;
+        }
+
+        uint64_t tick = processed_tick_ + 1;
+        for (uint32_t scanned = 0; scanned <= TIMER_WHEEL_BUCKETS; ) {
+            uint32_t bucket = tick % TIMER_WHEEL_BUCKETS;
+            uint64_t bits = occupied_[bucket / 64] >> (bucket % 64);
+            if (bits != 0) {
+                tick += __builtin_ctzll(bits);
+                deadline = start_ + std::chrono::microseconds(tick * TIMER_WHEEL_TICK_US);
+                return true;
+            }
+            uint32_t skip = 64 - bucket % 64;
+            tick += skip;
+            scanned += skip;
+        }
+        return false;
+    }
+
+private:
+    static const int32_t NONE = -1;
+
+    struct Entry {
+        uint64_t deadline_tick = 0;
+        int32_t bucket = NONE;
+        int32_t prev = NONE;
+        int32_t next = NONE;
+    };
+
+    // Deadline làm tròn lên, thời điểm hiện tại làm tròn xuống: timer không
+    // bao giờ chạy sớm, chỉ có thể trễ tối đa một tick
+    uint64_t tickOf(Clock::time_point t, bool round_up) const {
+        if (t <= start_) {
+            return 0;
+        }
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t - start_).count();
+        uint64_t tick_ns = TIMER_WHEEL_TICK_US * 1000ULL;
+        return round_up ? (ns + tick_ns - 1) / tick_ns : ns / tick_ns;
+    }
+
+    Clock::time_point start_;
+    uint64_t processed_tick_;
+    size_t size_;
+    std::vector<Entry> entries_;
+    std::vector<int32_t> heads_;
+    std::vector<uint64_t> occupied_;
+};
+
+#endif